@@ -0,0 +1,530 @@
+#include "archive.h"
+#include "platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Central directories are read this much at a time; tar headers in smaller
+// pieces, since member data usually lies between them.
+#define ARCHIVE_ZIP_READ_SIZE (64u * 1024u)
+#define ARCHIVE_TAR_READ_SIZE (16u * 1024u)
+
+// Members between cancellation checks.
+#define ARCHIVE_CANCEL_CHECK 256
+
+#define ZIP_END_SIGNATURE 0x06054b50u
+#define ZIP_END64_LOCATOR_SIGNATURE 0x07064b50u
+#define ZIP_END64_SIGNATURE 0x06064b50u
+#define ZIP_CENTRAL_SIGNATURE 0x02014b50u
+#define ZIP_END_SIZE 22
+#define ZIP_END_SEARCH (ZIP_END_SIZE + 65535)   // the end record plus the longest comment
+#define ZIP_END64_LOCATOR_SIZE 20
+#define ZIP_END64_SIZE 56
+#define ZIP_CENTRAL_SIZE 46
+#define ZIP_FLAG_UTF8 0x0800
+
+#define TAR_BLOCK 512
+#define TAR_META_MAX (1024u * 1024u)      // larger long names and pax headers are skipped
+
+// Unix epoch in FILETIME seconds.
+#define ARCHIVE_EPOCH_SECONDS 11644473600LL
+
+typedef struct {
+    HANDLE file;
+    uint64_t file_size;
+    size_t read_size;
+
+    unsigned char *data;              // a window of the file
+    size_t capacity;
+    size_t length;
+    uint64_t offset;                  // file offset of data[0]
+
+    char *name;                       // the current member's name
+    size_t name_capacity;
+} archive_reader_t;
+
+// Code points of CP437 bytes 0x80-0xFF, the encoding of zip names written
+// without the UTF-8 flag.
+static const uint16_t cp437_high[128] = {
+    0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7, 0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+    0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9, 0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+    0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA, 0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+    0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556, 0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+    0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F, 0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+    0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B, 0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+    0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4, 0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+    0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248, 0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0
+};
+
+static uint16_t read16(const unsigned char *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t read32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t read64(const unsigned char *p) {
+    return (uint64_t)read32(p) | (uint64_t)read32(p + 4) << 32;
+}
+
+archive_format_t archive_format_for_path(const char *path) {
+    const char *ext = path ? strrchr(path, '.') : NULL;
+    if (!ext) return ARCHIVE_NONE;
+    ext++;
+
+    if (_stricmp(ext, "zip") == 0 || _stricmp(ext, "jar") == 0) return ARCHIVE_ZIP;
+    if (_stricmp(ext, "tar") == 0) return ARCHIVE_TAR;
+    return ARCHIVE_NONE;
+}
+
+// Makes count bytes at offset available. The pointer is valid until the
+// next call; NULL past the end of the file or on a read error.
+static const unsigned char* archive_read(archive_reader_t *reader, uint64_t offset, size_t count) {
+    if (offset >= reader->offset && count <= reader->length &&
+        offset - reader->offset <= reader->length - count) {
+        return reader->data + (offset - reader->offset);
+    }
+    if (offset > reader->file_size || count > reader->file_size - offset) return NULL;
+
+    size_t want = count > reader->read_size ? count : reader->read_size;
+    if (want > reader->capacity) {
+        unsigned char *grown = realloc(reader->data, want);
+        if (!grown) return NULL;
+        reader->data = grown;
+        reader->capacity = want;
+    }
+
+    size_t got = 0;
+    if (!platform_read_at(reader->file, offset, reader->data, want, &got)) {
+        reader->length = 0;
+        return NULL;
+    }
+    reader->offset = offset;
+    reader->length = got;
+    return got >= count ? reader->data : NULL;
+}
+
+static char* archive_name_reserve(archive_reader_t *reader, size_t size) {
+    if (size > reader->name_capacity) {
+        char *grown = realloc(reader->name, size);
+        if (!grown) return NULL;
+        reader->name = grown;
+        reader->name_capacity = size;
+    }
+    return reader->name;
+}
+
+static FILETIME archive_unix_time(int64_t seconds) {
+    FILETIME ft = {0};
+    if (seconds < -ARCHIVE_EPOCH_SECONDS) return ft;
+    uint64_t ticks = (uint64_t)(seconds + ARCHIVE_EPOCH_SECONDS) * 10000000ull;
+    ft.dwLowDateTime = (DWORD)ticks;
+    ft.dwHighDateTime = (DWORD)(ticks >> 32);
+    return ft;
+}
+
+// Leading "/" and "./" are dropped and a trailing "/" marks a directory.
+static bool archive_emit(archive_entry_callback_t callback, void *user_data, char *name,
+                         uint64_t size, FILETIME mtime, bool is_directory) {
+    while (name[0] == '/' || (name[0] == '.' && name[1] == '/')) {
+        name += name[0] == '/' ? 1 : 2;
+    }
+    size_t length = strlen(name);
+    if (length > 0 && name[length - 1] == '/') {
+        is_directory = true;
+        while (length > 0 && name[length - 1] == '/') {
+            name[--length] = '\0';
+        }
+    }
+    if (length == 0) return true;
+
+    archive_entry_t entry;
+    entry.name = name;
+    entry.size = size;
+    entry.mtime = mtime;
+    entry.is_directory = is_directory;
+    return callback(&entry, user_data);
+}
+
+static size_t utf8_encode(char *out, uint32_t cp) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | cp >> 6);
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    out[0] = (char)(0xE0 | cp >> 12);
+    out[1] = (char)(0x80 | (cp >> 6 & 0x3F));
+    out[2] = (char)(0x80 | (cp & 0x3F));
+    return 3;
+}
+
+// Backslashes written by some Windows tools become '/'.
+static char* zip_entry_name(archive_reader_t *reader, const unsigned char *raw, size_t length, bool utf8) {
+    char *name = archive_name_reserve(reader, length * 3 + 1);
+    if (!name) return NULL;
+
+    size_t n = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = raw[i];
+        if (c == '\0') break;
+        if (utf8 || c < 0x80) {
+            name[n++] = c == '\\' ? '/' : (char)c;
+        } else {
+            n += utf8_encode(name + n, cp437_high[c - 0x80]);
+        }
+    }
+    name[n] = '\0';
+    return name;
+}
+
+// Zip64 sizes, and timestamps finer than the DOS fields: NTFS times win
+// over Unix ones.
+static void zip_parse_extra(const unsigned char *extra, size_t length, uint32_t size32,
+                            uint64_t *size, FILETIME *mtime) {
+    bool ntfs_time = false;
+    size_t pos = 0;
+    while (pos + 4 <= length) {
+        uint16_t id = read16(extra + pos);
+        size_t field_length = read16(extra + pos + 2);
+        const unsigned char *body = extra + pos + 4;
+        if (field_length > length - pos - 4) break;
+
+        if (id == 0x0001 && size32 == 0xFFFFFFFFu && field_length >= 8) {
+            *size = read64(body);
+        } else if (id == 0x000A && field_length >= 4) {
+            size_t tag_pos = 4;
+            while (tag_pos + 4 <= field_length) {
+                uint16_t tag = read16(body + tag_pos);
+                size_t tag_length = read16(body + tag_pos + 2);
+                if (tag_length > field_length - tag_pos - 4) break;
+                if (tag == 1 && tag_length >= 8) {
+                    uint64_t ticks = read64(body + tag_pos + 4);
+                    mtime->dwLowDateTime = (DWORD)ticks;
+                    mtime->dwHighDateTime = (DWORD)(ticks >> 32);
+                    ntfs_time = true;
+                }
+                tag_pos += 4 + tag_length;
+            }
+        } else if (id == 0x5455 && field_length >= 5 && (body[0] & 1) && !ntfs_time) {
+            *mtime = archive_unix_time((int32_t)read32(body + 1));
+        }
+        pos += 4 + field_length;
+    }
+}
+
+static FILETIME zip_dos_time(uint16_t time, uint16_t date) {
+    SYSTEMTIME st = {0};
+    st.wYear = (WORD)(1980 + (date >> 9));
+    st.wMonth = (WORD)(date >> 5 & 0x0F);
+    st.wDay = (WORD)(date & 0x1F);
+    st.wHour = (WORD)(time >> 11);
+    st.wMinute = (WORD)(time >> 5 & 0x3F);
+    st.wSecond = (WORD)((time & 0x1F) * 2);
+
+    FILETIME ft = {0};
+    if (!SystemTimeToFileTime(&st, &ft)) {
+        memset(&ft, 0, sizeof(ft));
+    }
+    return ft;
+}
+
+static bool zip_list(archive_reader_t *reader, cancel_token_t *cancel,
+                     archive_entry_callback_t callback, void *user_data) {
+    uint64_t file_size = reader->file_size;
+    if (file_size < ZIP_END_SIZE) return false;
+
+    // The end record is followed only by its comment, so it is the last
+    // signature whose comment fits.
+    size_t tail = file_size < ZIP_END_SEARCH ? (size_t)file_size : ZIP_END_SEARCH;
+    const unsigned char *data = archive_read(reader, file_size - tail, tail);
+    if (!data) return false;
+
+    size_t end = SIZE_MAX;
+    for (size_t i = tail - ZIP_END_SIZE + 1; i-- > 0;) {
+        if (read32(data + i) == ZIP_END_SIGNATURE && read16(data + i + 20) <= tail - ZIP_END_SIZE - i) {
+            end = i;
+            break;
+        }
+    }
+    if (end == SIZE_MAX) return false;
+
+    uint64_t end_offset = file_size - tail + end;
+    uint64_t count = read16(data + end + 10);
+    uint64_t offset = read32(data + end + 16);
+    if (count == 0xFFFF || offset == 0xFFFFFFFFu || read32(data + end + 12) == 0xFFFFFFFFu) {
+        if (end_offset < ZIP_END64_LOCATOR_SIZE) return false;
+        const unsigned char *locator = archive_read(reader, end_offset - ZIP_END64_LOCATOR_SIZE, ZIP_END64_LOCATOR_SIZE);
+        if (!locator || read32(locator) != ZIP_END64_LOCATOR_SIGNATURE) return false;
+        const unsigned char *end64 = archive_read(reader, read64(locator + 8), ZIP_END64_SIZE);
+        if (!end64 || read32(end64) != ZIP_END64_SIGNATURE) return false;
+        count = read64(end64 + 32);
+        offset = read64(end64 + 48);
+    }
+
+    for (uint64_t i = 0; i < count; i++) {
+        if (i % ARCHIVE_CANCEL_CHECK == 0 && cancel_token_check(cancel)) return true;
+
+        const unsigned char *header = archive_read(reader, offset, ZIP_CENTRAL_SIZE);
+        if (!header || read32(header) != ZIP_CENTRAL_SIGNATURE) return false;
+
+        size_t name_length = read16(header + 28);
+        size_t extra_length = read16(header + 30);
+        size_t record = ZIP_CENTRAL_SIZE + name_length + extra_length + read16(header + 32);
+        header = archive_read(reader, offset, record);
+        if (!header) return false;
+
+        uint32_t size32 = read32(header + 24);
+        uint64_t size = size32;
+        FILETIME mtime = zip_dos_time(read16(header + 12), read16(header + 14));
+        zip_parse_extra(header + ZIP_CENTRAL_SIZE + name_length, extra_length, size32, &size, &mtime);
+
+        char *name = zip_entry_name(reader, header + ZIP_CENTRAL_SIZE, name_length,
+                                    (read16(header + 8) & ZIP_FLAG_UTF8) != 0);
+        if (!name) return false;
+        if (!archive_emit(callback, user_data, name, size, mtime, false)) return true;
+
+        offset += record;
+    }
+    return true;
+}
+
+// Octal, possibly space or NUL padded, or the base-256 form GNU tar uses
+// for values that do not fit (negative ones read as 0).
+static uint64_t tar_number(const unsigned char *field, size_t length) {
+    if (field[0] & 0x80) {
+        if (field[0] == 0xFF) return 0;
+        uint64_t value = field[0] & 0x7F;
+        for (size_t i = 1; i < length; i++) {
+            value = value << 8 | field[i];
+        }
+        return value;
+    }
+
+    size_t i = 0;
+    while (i < length && field[i] == ' ') i++;
+    uint64_t value = 0;
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = value * 8 + (uint64_t)(field[i] - '0');
+    }
+    return value;
+}
+
+// The checksum field counts as spaces; old tars summed signed bytes.
+static bool tar_checksum_ok(const unsigned char *header) {
+    uint64_t stored = tar_number(header + 148, 8);
+    uint64_t unsigned_sum = 0;
+    int64_t signed_sum = 0;
+    for (size_t i = 0; i < TAR_BLOCK; i++) {
+        unsigned char c = i >= 148 && i < 156 ? ' ' : header[i];
+        unsigned_sum += c;
+        signed_sum += (signed char)c;
+    }
+    return stored == unsigned_sum || (int64_t)stored == signed_sum;
+}
+
+static bool tar_block_is_zero(const unsigned char *header) {
+    for (size_t i = 0; i < TAR_BLOCK; i++) {
+        if (header[i]) return false;
+    }
+    return true;
+}
+
+static char* archive_strndup(const unsigned char *data, size_t length) {
+    const unsigned char *nul = memchr(data, '\0', length);
+    if (nul) length = (size_t)(nul - data);
+
+    char *copy = malloc(length + 1);
+    if (!copy) return NULL;
+    memcpy(copy, data, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+// What a pax extended header says about the member that follows.
+typedef struct {
+    char *path;                       // from a pax header or a GNU long name
+    bool has_size;
+    uint64_t size;
+    bool has_mtime;
+    int64_t mtime;
+} tar_override_t;
+
+static void tar_override_clear(tar_override_t *override) {
+    free(override->path);
+    memset(override, 0, sizeof(*override));
+}
+
+// Records are "<length> <key>=<value>\n".
+static void tar_parse_pax(const unsigned char *data, size_t length, tar_override_t *override) {
+    size_t pos = 0;
+    while (pos < length) {
+        size_t record = 0;
+        size_t i = pos;
+        while (i < length && data[i] >= '0' && data[i] <= '9' && record <= length) {
+            record = record * 10 + (size_t)(data[i++] - '0');
+        }
+        if (record == 0 || record > length - pos || i >= pos + record || data[i] != ' ') break;
+
+        const unsigned char *key = data + i + 1;
+        const unsigned char *end = data + pos + record - 1;     // the '\n'
+        const unsigned char *equals = key < end ? memchr(key, '=', (size_t)(end - key)) : NULL;
+        if (equals) {
+            size_t key_length = (size_t)(equals - key);
+            const unsigned char *value = equals + 1;
+            size_t value_length = (size_t)(end - value);
+
+            if (key_length == 4 && memcmp(key, "path", 4) == 0) {
+                free(override->path);
+                override->path = archive_strndup(value, value_length);
+            } else if (key_length == 4 && memcmp(key, "size", 4) == 0) {
+                uint64_t size = 0;
+                for (size_t k = 0; k < value_length && value[k] >= '0' && value[k] <= '9'; k++) {
+                    size = size * 10 + (uint64_t)(value[k] - '0');
+                }
+                override->size = size;
+                override->has_size = true;
+            } else if (key_length == 5 && memcmp(key, "mtime", 5) == 0) {
+                bool negative = value_length > 0 && value[0] == '-';
+                int64_t seconds = 0;
+                for (size_t k = negative ? 1 : 0; k < value_length && value[k] >= '0' && value[k] <= '9'; k++) {
+                    seconds = seconds * 10 + (value[k] - '0');
+                }
+                override->mtime = negative ? -seconds : seconds;
+                override->has_mtime = true;
+            }
+        }
+        pos += record;
+    }
+}
+
+// ustar splits long names into a prefix and a name, neither NUL-terminated
+// when full.
+static char* tar_entry_name(archive_reader_t *reader, const unsigned char *header) {
+    size_t prefix_length = 0;
+    if (memcmp(header + 257, "ustar", 5) == 0) {
+        while (prefix_length < 155 && header[345 + prefix_length]) prefix_length++;
+    }
+    size_t name_length = 0;
+    while (name_length < 100 && header[name_length]) name_length++;
+
+    char *name = archive_name_reserve(reader, prefix_length + name_length + 2);
+    if (!name) return NULL;
+
+    size_t n = 0;
+    if (prefix_length > 0) {
+        memcpy(name, header + 345, prefix_length);
+        n = prefix_length;
+        name[n++] = '/';
+    }
+    memcpy(name + n, header, name_length);
+    name[n + name_length] = '\0';
+    return name;
+}
+
+static bool tar_list(archive_reader_t *reader, cancel_token_t *cancel,
+                     archive_entry_callback_t callback, void *user_data) {
+    tar_override_t override;
+    memset(&override, 0, sizeof(override));
+
+    uint64_t offset = 0;
+    size_t headers = 0;
+    bool ok = true;
+
+    while (reader->file_size - offset >= TAR_BLOCK) {
+        if (++headers % ARCHIVE_CANCEL_CHECK == 0 && cancel_token_check(cancel)) break;
+
+        const unsigned char *header = archive_read(reader, offset, TAR_BLOCK);
+        if (!header) {
+            ok = false;
+            break;
+        }
+        if (tar_block_is_zero(header)) break;          // end of archive
+        if (!tar_checksum_ok(header)) {
+            ok = false;
+            break;
+        }
+
+        char type = (char)header[156];
+        bool metadata = type == 'L' || type == 'x' || type == 'g' || type == 'K';
+        uint64_t size = tar_number(header + 124, 12);
+        if (!metadata && override.has_size) {
+            // pax writers leave the header's size 0 for members of 8 GiB
+            // and more; the data to skip is the pax size's.
+            size = override.size;
+        }
+        if (size > reader->file_size) {
+            ok = false;
+            break;
+        }
+        uint64_t data_offset = offset + TAR_BLOCK;
+        uint64_t next = data_offset + ((size + TAR_BLOCK - 1) & ~(uint64_t)(TAR_BLOCK - 1));
+
+        if (type == 'L' || type == 'x') {
+            // Metadata for the next member.
+            if (size <= TAR_META_MAX) {
+                const unsigned char *meta = archive_read(reader, data_offset, (size_t)size);
+                if (!meta) {
+                    ok = false;
+                    break;
+                }
+                if (type == 'L') {
+                    free(override.path);
+                    override.path = archive_strndup(meta, (size_t)size);
+                } else {
+                    tar_parse_pax(meta, (size_t)size, &override);
+                }
+            }
+        } else if (type != 'g' && type != 'K') {
+            char *name = override.path
+                ? archive_name_reserve(reader, strlen(override.path) + 1)
+                : tar_entry_name(reader, header);
+            if (!name) {
+                ok = false;
+                break;
+            }
+            if (override.path) {
+                strcpy(name, override.path);
+            }
+
+            bool listed = true;
+            if (type != '3' && type != '4' && type != '6' && type != 'V') {
+                // Devices, FIFOs and volume labels are not files.
+                int64_t mtime = override.has_mtime ? override.mtime : (int64_t)tar_number(header + 136, 12);
+                listed = archive_emit(callback, user_data, name, size,
+                                      archive_unix_time(mtime), type == '5');
+            }
+            tar_override_clear(&override);
+            if (!listed) break;
+        }
+
+        offset = next;
+    }
+
+    tar_override_clear(&override);
+    return ok;
+}
+
+bool archive_list(const char *path, archive_format_t format, uint64_t size, cancel_token_t *cancel,
+                  archive_entry_callback_t callback, void *user_data) {
+    if (!path || !callback || format == ARCHIVE_NONE) return false;
+
+    archive_reader_t reader;
+    memset(&reader, 0, sizeof(reader));
+    reader.file_size = size;
+    reader.read_size = format == ARCHIVE_ZIP ? ARCHIVE_ZIP_READ_SIZE : ARCHIVE_TAR_READ_SIZE;
+    reader.file = platform_open_file(path, format == ARCHIVE_ZIP);
+    if (reader.file == INVALID_HANDLE_VALUE) return false;
+
+    bool ok = format == ARCHIVE_ZIP
+        ? zip_list(&reader, cancel, callback, user_data)
+        : tar_list(&reader, cancel, callback, user_data);
+
+    CloseHandle(reader.file);
+    free(reader.data);
+    free(reader.name);
+    return ok;
+}
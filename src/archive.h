@@ -0,0 +1,39 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "cancel.h"
+#include <windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Lists the members of zip and tar archives without extracting anything:
+// a zip's central directory is found from the end record and read in one
+// pass, and a tar's headers are read one after another, seeking over the
+// member data in between.
+
+typedef enum {
+    ARCHIVE_NONE,
+    ARCHIVE_ZIP,
+    ARCHIVE_TAR
+} archive_format_t;
+
+typedef struct {
+    const char *name;                 // '/'-separated UTF-8, valid during the callback
+    uint64_t size;                    // uncompressed
+    FILETIME mtime;
+    bool is_directory;
+} archive_entry_t;
+
+// Returns false to stop listing.
+typedef bool (*archive_entry_callback_t)(const archive_entry_t *entry, void *user_data);
+
+// By extension: .zip and .jar, and .tar.
+archive_format_t archive_format_for_path(const char *path);
+
+// Calls back once per member, in archive order. Returns false if the file
+// could not be read or is not a well-formed archive; members listed before
+// the problem was found have been reported all the same.
+bool archive_list(const char *path, archive_format_t format, uint64_t size, cancel_token_t *cancel,
+                  archive_entry_callback_t callback, void *user_data);
+
+#endif
@@ -0,0 +1,58 @@
+#include "cancel.h"
+#include "sync.h"
+#include <stddef.h>
+
+void cancel_token_init(cancel_token_t *token, cancel_token_t *parent, uint64_t deadline_ns) {
+    atomic_init(&token->cancelled, false);
+    atomic_init(&token->reason, CANCEL_REASON_NONE);
+    token->deadline_ns = deadline_ns;
+    token->parent = parent;
+}
+
+uint64_t cancel_deadline_after_ms(uint32_t timeout_ms) {
+    uint64_t now = sync_now_ns();
+    uint64_t span = (uint64_t)timeout_ms * 1000000u;
+    return span < CANCEL_NO_DEADLINE - now ? now + span : CANCEL_NO_DEADLINE;
+}
+
+void cancel_token_cancel(cancel_token_t *token, cancel_reason_t reason) {
+    if (!token) return;
+
+    int expected = CANCEL_REASON_NONE;
+    atomic_compare_exchange_strong(&token->reason, &expected, (int)reason);
+    atomic_store_explicit(&token->cancelled, true, memory_order_release);
+}
+
+bool cancel_token_cancelled(const cancel_token_t *token) {
+    return token && atomic_load_explicit(&token->cancelled, memory_order_acquire);
+}
+
+bool cancel_token_check(cancel_token_t *token) {
+    if (!token) return false;
+    if (cancel_token_cancelled(token)) return true;
+
+    if (token->deadline_ns != CANCEL_NO_DEADLINE && sync_now_ns() >= token->deadline_ns) {
+        cancel_token_cancel(token, CANCEL_REASON_DEADLINE);
+        return true;
+    }
+
+    if (token->parent && cancel_token_check(token->parent)) {
+        cancel_token_cancel(token, cancel_token_reason(token->parent));
+        return true;
+    }
+    return false;
+}
+
+cancel_reason_t cancel_token_reason(const cancel_token_t *token) {
+    return token ? (cancel_reason_t)atomic_load(&token->reason) : CANCEL_REASON_NONE;
+}
+
+uint64_t cancel_token_deadline(const cancel_token_t *token) {
+    uint64_t deadline = CANCEL_NO_DEADLINE;
+    for (; token; token = token->parent) {
+        if (token->deadline_ns < deadline) {
+            deadline = token->deadline_ns;
+        }
+    }
+    return deadline;
+}
@@ -0,0 +1,49 @@
+#ifndef CANCEL_H
+#define CANCEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Cancellation token with an optional deadline. Tokens form a chain: a child
+// is cancelled when it is cancelled itself, when its deadline passes, or when
+// any ancestor is cancelled. cancel_token_cancel() only touches atomics, so
+// it is safe from a console control handler or signal handler.
+typedef enum {
+    CANCEL_REASON_NONE = 0,
+    CANCEL_REASON_REQUESTED,          // Ctrl+C, a callback, or an API caller
+    CANCEL_REASON_DEADLINE,
+    CANCEL_REASON_SATISFIED           // the consumer has all it asked for
+} cancel_reason_t;
+
+#define CANCEL_NO_DEADLINE UINT64_MAX
+
+typedef struct cancel_token {
+    atomic_bool cancelled;
+    atomic_int reason;
+    uint64_t deadline_ns;             // sync_now_ns() time, or CANCEL_NO_DEADLINE
+    struct cancel_token *parent;
+} cancel_token_t;
+
+void cancel_token_init(cancel_token_t *token, cancel_token_t *parent, uint64_t deadline_ns);
+
+// sync_now_ns() + timeout_ms, saturating.
+uint64_t cancel_deadline_after_ms(uint32_t timeout_ms);
+
+// The first reason recorded wins.
+void cancel_token_cancel(cancel_token_t *token, cancel_reason_t reason);
+
+// Only reads this token's flag: cheap enough to call for every entry.
+bool cancel_token_cancelled(const cancel_token_t *token);
+
+// Also looks at the clock and the ancestors, and latches what it finds into
+// this token so later cancel_token_cancelled() calls see it. Call it every
+// batch of work rather than every item.
+bool cancel_token_check(cancel_token_t *token);
+
+cancel_reason_t cancel_token_reason(const cancel_token_t *token);
+
+// Earliest deadline along the chain, or CANCEL_NO_DEADLINE.
+uint64_t cancel_token_deadline(const cancel_token_t *token);
+
+#endif
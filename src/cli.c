@@ -1,8 +1,10 @@
 #include "cli.h"
 #include "criteria.h"
+#include "decompress.h"
 #include "utils.h"
 #include "output.h"
 #include "version.h"
+#include "regex/dfa.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,12 +17,38 @@ static int parse_date_arg(const char *arg, FILETIME *file_time) {
     return parse_date_string(arg, file_time);
 }
 
+static int parse_top_key_arg(const char *arg, rq_top_key_t *key) {
+    if (_stricmp(arg, "size") == 0) {
+        *key = RQ_TOP_BY_SIZE;
+        return 0;
+    }
+    if (_stricmp(arg, "mtime") == 0) {
+        *key = RQ_TOP_BY_MTIME;
+        return 0;
+    }
+    fprintf(stderr, "Error: Invalid --by key '%s'. Valid keys: size, mtime\n", arg);
+    return -1;
+}
+
+static int parse_sort_arg(const char *arg, rq_sort_mode_t *mode) {
+    if (_stricmp(arg, "path") == 0) {
+        *mode = RQ_SORT_PATH;
+        return 0;
+    }
+    if (_stricmp(arg, "none") == 0) {
+        *mode = RQ_SORT_NONE;
+        return 0;
+    }
+    fprintf(stderr, "Error: Invalid sort key '%s'. Valid keys: path, none\n", arg);
+    return -1;
+}
+
 void print_usage(const char *program_name) {
     printf("rq - fast file search tool for Windows\n\n");
-    printf("Usage: %s <directory> <pattern> [OPTIONS]\n\n", program_name);
+    printf("Usage: %s <directory>... <pattern> [OPTIONS]\n\n", program_name);
 
     printf("Arguments:\n");
-    printf("  <directory>         The directory to search in\n");
+    printf("  <directory>...      One or more directories to search in (overlaps are skipped)\n");
     printf("  <pattern>           Search pattern (use --glob for wildcards)\n\n");
 
     printf("Search Options:\n");
@@ -29,7 +57,13 @@ void print_usage(const char *program_name) {
     printf("  -r, --regex             Enable regex patterns (filename matching)\n");
     printf("  -H, --include-hidden    Include hidden files and directories\n");
     printf("  -L, --follow-symlinks   Follow symbolic links\n");
-    printf("      --no-skip           Don't skip common directories (node_modules, .git, etc.)\n\n");
+    printf("      --no-skip           Don't skip common directories (node_modules, .git, etc.)\n");
+    printf("      --no-ignore         Don't honour .gitignore, .ignore and .rqignore files\n");
+    printf("      --skip-dir <list>   Also skip directories with these names (comma-separated)\n");
+    printf("      --skip-path <path>  Also skip this path, relative to the volume root\n");
+    printf("      --skip-file <file>  Read skip rules from a file (\"dir <names>\", \"path <path>\")\n");
+    printf("      --shallow-first     Search shallow directories before deep ones\n");
+    printf("      --boost <path>      Search this directory first (absolute or relative to the root)\n\n");
 
     printf("Filters:\n");
     printf("  -e, --ext <list>    Filter by file extensions (comma-separated)\n");
@@ -39,16 +73,45 @@ void print_usage(const char *program_name) {
     printf("      --size <size>   Exact file size, or +size (larger), -size (smaller)\n");
     printf("      --after <date>  Files modified after date (YYYY-MM-DD)\n");
     printf("      --before <date> Files modified before date (YYYY-MM-DD)\n");
+    printf("      --contains <text>   Only files containing this text, with the matching\n");
+    printf("                      lines (--case applies; UTF-16 text is searched too,\n");
+    printf("                      binary files never match)\n");
+    printf("      --grep <text>   Same as --contains\n");
+    printf("      --contains-regex <regex>\n");
+    printf("                      Only files with a line matching this regex; ( ) | * + ?\n");
+    printf("                      {n,m} [ ] . ^ $ \\d \\w \\s are supported, per line\n");
+    printf("      --decompress    Search .gz and .xz files decompressed (builds with\n");
+    printf("                      ZLIB=1 / LZMA=1)\n");
+    printf("      --archives      Also match members of .zip, .jar and .tar files, reported\n");
+    printf("                      as archive.zip!/path/in/archive (not with --contains)\n");
     printf("  -d, --max-depth <n> Maximum recursion depth (0 = no recursion, default = unlimited)\n");
-    printf("      --max-results <n>   Maximum number of results (0 = unlimited)\n\n");
+    printf("      --max-results <n>   Maximum number of results (0 = unlimited)\n");
+    printf("      --top <n>       Only report the n largest/newest files (see --by, --asc)\n");
+    printf("      --by <key>      Ranking key for --top: size (default) or mtime\n");
+    printf("      --asc           Rank --top ascending (smallest/oldest first)\n\n");
 
     printf("Performance:\n");
-    printf("  -j, --threads <n>   Number of worker threads (0 = auto)\n");
+    printf("  -j, --threads <n>   Fixed number of worker threads (0 = tune at runtime)\n");
+    printf("      --threads-min <n>\n");
+    printf("                      Fewest workers runtime tuning may use (default: 1)\n");
+    printf("      --threads-max <n>\n");
+    printf("                      Most workers runtime tuning may use (default: 4 per CPU, up to 64)\n");
     printf("      --timeout <ms>  Search timeout in milliseconds\n");
-    printf("      --stats         Show real-time thread pool statistics\n\n");
+    printf("      --progress-interval <ms>\n");
+    printf("                      How often progress is reported (default: 100)\n");
+    printf("      --stats         Print thread pool statistics, including the chosen\n");
+    printf("                      worker count, the time to the first and 90%% of\n");
+    printf("                      results, and content read/match queue depths when\n");
+    printf("                      the search ends\n\n");
+
+    printf("Disk Usage:\n");
+    printf("      --du [<n>]      Summarize file count, size and allocated size per directory\n");
+    printf("                      down to depth n (default: 1); filters still apply\n");
+    printf("      --duplicates    Report groups of files with identical content\n\n");
 
     printf("Output:\n");
     printf("      --preview [<n>]     Show preview of text files (default: 10 lines)\n");
+    printf("      --sort <key>        Sort results while streaming (path, none)\n");
     printf("      --out <file>        Write output to file\n");
     printf("      --json              Output results as JSON\n\n");
 
@@ -63,10 +126,21 @@ void print_usage(const char *program_name) {
     printf("    %s . document --min 1M --ext pdf,docx\n\n", program_name);
     printf("  Find files smaller than 100KB:\n");
     printf("    %s . \"\" --size -100K --ext txt\n\n", program_name);
+    printf("  Per-directory disk usage two levels deep:\n");
+    printf("    %s D:\\Shares \"\" --du 2\n\n", program_name);
+    printf("  Search several trees in one pass:\n");
+    printf("    %s C:\\Src D:\\Src \"*.vcxproj\" --glob\n\n", program_name);
+    printf("  List the 100 largest log files:\n");
+    printf("    %s D:\\Logs \"\" --ext log --top 100 --by size\n\n", program_name);
+    printf("  Config files that mention a host:\n");
+    printf("    %s C:\\Deploy \"\" --ext ini,json,xml --contains db01.corp\n\n", program_name);
+    printf("  Which build archives ship a library:\n");
+    printf("    %s D:\\Artifacts libfoo.so.3 --archives\n\n", program_name);
     printf("  Case-sensitive search with thread monitoring:\n");
     printf("    %s C:\\ \"Config\" --case --stats --threads 8\n\n", program_name);
 
     printf("For glob patterns: * (any chars), ? (single char), [abc] (char set), {jpg,png} (alternatives)\n");
+    printf("Ctrl+C stops the search and still writes what was found; a second Ctrl+C stops the output.\n");
 }
 
 void print_version(void) {
@@ -96,15 +170,27 @@ int parse_command_line(int argc, char *argv[], search_criteria_t *criteria, cli_
         return -1;
     }
 
-    criteria->root_path = _strdup(argv[1]);
-    criteria->search_term = _strdup(argv[2]);
+    // Every positional argument before the first option is a root, except
+    // the last one, which is the pattern.
+    int pattern_index = 2;
+    while (pattern_index + 1 < argc && argv[pattern_index + 1][0] != '-') {
+        pattern_index++;
+    }
+
+    for (int i = 1; i < pattern_index; i++) {
+        if (!criteria_add_root(criteria, argv[i])) {
+            criteria_cleanup(criteria);
+            return -1;
+        }
+    }
+    criteria->search_term = _strdup(argv[pattern_index]);
 
     if (!criteria->root_path || !criteria->search_term) {
         criteria_cleanup(criteria);
         return -1;
     }
 
-    for (int i = 3; i < argc; i++) {
+    for (int i = pattern_index + 1; i < argc; i++) {
         if (strcmp(argv[i], "--case") == 0 || strcmp(argv[i], "-c") == 0) {
             criteria->case_sensitive = true;
         } else if (strcmp(argv[i], "--glob") == 0 || strcmp(argv[i], "-g") == 0) {
@@ -113,6 +199,89 @@ int parse_command_line(int argc, char *argv[], search_criteria_t *criteria, cli_
             criteria->use_regex = true;
         } else if (strcmp(argv[i], "--no-skip") == 0) {
             criteria->skip_common_dirs = false;
+        } else if (strcmp(argv[i], "--no-ignore") == 0) {
+            criteria->use_ignore_files = false;
+        } else if (strcmp(argv[i], "--skip-dir") == 0) {
+            if (++i >= argc) {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+            if (!criteria_add_skip_dirs(criteria, argv[i])) {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--skip-path") == 0) {
+            if (++i >= argc) {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+            if (!criteria_add_skip_path(criteria, argv[i])) {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--contains") == 0 || strcmp(argv[i], "--grep") == 0) {
+            if (++i >= argc || argv[i][0] == '\0') {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+            free(criteria->content_pattern);
+            criteria->content_pattern = _strdup(argv[i]);
+            criteria->content_regex = false;
+            if (!criteria->content_pattern) {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--contains-regex") == 0) {
+            if (++i >= argc || argv[i][0] == '\0') {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+            // Compiled here only to report a bad pattern before searching.
+            dfa_program_t *program = dfa_compile(argv[i], true);
+            if (!program) {
+                fprintf(stderr, "Error: Invalid or unsupported regex '%s'\n", argv[i]);
+                criteria_cleanup(criteria);
+                return -1;
+            }
+            dfa_program_free(program);
+
+            free(criteria->content_pattern);
+            criteria->content_pattern = _strdup(argv[i]);
+            criteria->content_regex = true;
+            if (!criteria->content_pattern) {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--decompress") == 0) {
+            if (!decompress_supported()) {
+                fprintf(stderr, "Error: --decompress needs a build with ZLIB=1 or LZMA=1\n");
+                criteria_cleanup(criteria);
+                return -1;
+            }
+            criteria->content_decompress = true;
+        } else if (strcmp(argv[i], "--archives") == 0) {
+            criteria->search_archives = true;
+        } else if (strcmp(argv[i], "--shallow-first") == 0) {
+            criteria->shallow_first = true;
+        } else if (strcmp(argv[i], "--boost") == 0) {
+            if (++i >= argc) {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+            if (!criteria_add_boost_path(criteria, argv[i])) {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--skip-file") == 0) {
+            if (++i >= argc) {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+            if (!criteria_load_skip_file(criteria, argv[i])) {
+                fprintf(stderr, "Error: Cannot read skip file '%s'\n", argv[i]);
+                criteria_cleanup(criteria);
+                return -1;
+            }
         } else if (strcmp(argv[i], "--follow-symlinks") == 0 || strcmp(argv[i], "-L") == 0) {
             criteria->follow_symlinks = true;
         } else if (strcmp(argv[i], "--include-hidden") == 0 || strcmp(argv[i], "-H") == 0) {
@@ -210,6 +379,23 @@ int parse_command_line(int argc, char *argv[], search_criteria_t *criteria, cli_
                 return -1;
             }
             criteria->max_results = (size_t)strtoull(argv[i], NULL, 10);
+        } else if (strcmp(argv[i], "--top") == 0) {
+            if (++i >= argc) {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+            criteria->top_count = (size_t)strtoull(argv[i], NULL, 10);
+        } else if (strcmp(argv[i], "--by") == 0) {
+            if (++i >= argc) {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+            if (parse_top_key_arg(argv[i], &criteria->top_by) != 0) {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--asc") == 0) {
+            criteria->top_ascending = true;
         } else if (strcmp(argv[i], "--max-depth") == 0 || strcmp(argv[i], "-d") == 0) {
             if (++i >= argc) {
                 criteria_cleanup(criteria);
@@ -222,12 +408,30 @@ int parse_command_line(int argc, char *argv[], search_criteria_t *criteria, cli_
                 return -1;
             }
             criteria->max_threads = (size_t)strtoull(argv[i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads-min") == 0) {
+            if (++i >= argc) {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+            criteria->threads_min = (size_t)strtoull(argv[i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads-max") == 0) {
+            if (++i >= argc) {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+            criteria->threads_max = (size_t)strtoull(argv[i], NULL, 10);
         } else if (strcmp(argv[i], "--timeout") == 0) {
             if (++i >= argc) {
                 criteria_cleanup(criteria);
                 return -1;
             }
             criteria->timeout_ms = (DWORD)strtoul(argv[i], NULL, 10);
+        } else if (strcmp(argv[i], "--progress-interval") == 0) {
+            if (++i >= argc) {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+            criteria->progress_interval_ms = (uint32_t)strtoul(argv[i], NULL, 10);
         } else if (strcmp(argv[i], "--out") == 0) {
             if (++i >= argc) {
                 criteria_cleanup(criteria);
@@ -245,6 +449,28 @@ int parse_command_line(int argc, char *argv[], search_criteria_t *criteria, cli_
                     criteria->preview_lines = (size_t)lines;
                 }
             }
+        } else if (strcmp(argv[i], "--sort") == 0 || strncmp(argv[i], "--sort=", 7) == 0) {
+            const char *key = argv[i] + 6;
+            if (*key == '=') {
+                key++;
+            } else if (++i >= argc) {
+                criteria_cleanup(criteria);
+                return -1;
+            } else {
+                key = argv[i];
+            }
+            if (parse_sort_arg(key, &criteria->sort_mode) != 0) {
+                criteria_cleanup(criteria);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--du") == 0) {
+            criteria->du_mode = true;
+            if (i + 1 < argc && isdigit(argv[i + 1][0])) {
+                i++;
+                criteria->du_depth = (size_t)strtoull(argv[i], NULL, 10);
+            }
+        } else if (strcmp(argv[i], "--duplicates") == 0) {
+            criteria->find_duplicates = true;
         } else if (strcmp(argv[i], "--stats") == 0) {
             options->show_stats = true;
         } else {
@@ -272,11 +498,54 @@ int output_results(const search_result_t *results, size_t count, const cli_optio
     int result;
 
     if (criteria && criteria->preview_mode) {
-        result = output_search_results_with_preview(fp, results, count, criteria, format);
+        result = output_search_results_with_preview(fp, results, count, criteria, format, options->cancel);
     } else {
-        result = output_search_results(fp, results, count, format);
+        result = output_search_results(fp, results, count, format, options->cancel);
+    }
+
+    if (options->output_file) {
+        fclose(fp);
     }
 
+    return result;
+}
+
+
+int output_du_results(const du_row_t *rows, size_t count, const cli_options_t *options) {
+    FILE *fp = stdout;
+
+    if (options->output_file) {
+        fp = fopen(options->output_file, "w");
+        if (!fp) {
+            fprintf(stderr, "Error: Cannot open output file '%s'\n", options->output_file);
+            return -1;
+        }
+    }
+
+    output_format_t format = options->json_output ? OUTPUT_FORMAT_JSON : OUTPUT_FORMAT_TEXT;
+    int result = output_disk_usage(fp, rows, count, format, options->cancel);
+
+    if (options->output_file) {
+        fclose(fp);
+    }
+
+    return result;
+}
+
+int output_dupes_results(const dupe_group_t *groups, size_t count, const cli_options_t *options) {
+    FILE *fp = stdout;
+
+    if (options->output_file) {
+        fp = fopen(options->output_file, "w");
+        if (!fp) {
+            fprintf(stderr, "Error: Cannot open output file '%s'\n", options->output_file);
+            return -1;
+        }
+    }
+
+    output_format_t format = options->json_output ? OUTPUT_FORMAT_JSON : OUTPUT_FORMAT_TEXT;
+    int result = output_duplicates(fp, groups, count, format, options->cancel);
+
     if (options->output_file) {
         fclose(fp);
     }
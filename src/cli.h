@@ -11,11 +11,14 @@ typedef struct cli_options {
     bool show_help;
     bool show_version;
     bool show_stats;
+    const cancel_token_t *cancel;     // stops the output writers
 } cli_options_t;
 
 int parse_command_line(int argc, char *argv[], search_criteria_t *criteria, cli_options_t *options);
 void print_usage(const char *program_name);
 void print_version(void);
 int output_results(const search_result_t *results, size_t count, const cli_options_t *options, const search_criteria_t *criteria);
+int output_du_results(const du_row_t *rows, size_t count, const cli_options_t *options);
+int output_dupes_results(const dupe_group_t *groups, size_t count, const cli_options_t *options);
 
 #endif
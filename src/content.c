@@ -0,0 +1,1032 @@
+#include "content.h"
+#include "decompress.h"
+#include "platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Mapped files are scanned this much at a time, checking for cancellation
+// in between.
+#define CONTENT_SCAN_CHUNK (4u * 1024u * 1024u)
+
+struct content_matcher {
+    unsigned char *needle;            // lower-cased unless case-sensitive; NULL
+    size_t length;                    // for a regex without a required literal
+    bool case_sensitive;
+    size_t first_at;                  // offsets of the two needle bytes the
+    size_t last_at;                   // prefilter checks
+    unsigned char first[2];           // needle[first_at], both cases
+    unsigned char last[2];            // needle[last_at], both cases
+    size_t unit;                      // 2 for a UTF-16 needle: hits are aligned
+    bool big_endian;
+    struct content_matcher *wide[2];  // the literal in UTF-16LE and UTF-16BE, or
+                                      // NULL if it is not valid UTF-8
+    dfa_program_t *regex;
+    dfa_program_t *line_regex;        // decides lines in streamed scans: the regex,
+                                      // or the literal compiled as one
+    bool decompress;
+};
+
+static unsigned char ascii_lower(unsigned char c) {
+    return c >= 'A' && c <= 'Z' ? (unsigned char)(c - 'A' + 'a') : c;
+}
+
+static unsigned char ascii_upper(unsigned char c) {
+    return c >= 'a' && c <= 'z' ? (unsigned char)(c - 'a' + 'A') : c;
+}
+
+static void content_matcher_set_filter(content_matcher_t *matcher) {
+    unsigned char first = matcher->needle[matcher->first_at];
+    unsigned char last = matcher->needle[matcher->last_at];
+    matcher->first[0] = first;
+    matcher->first[1] = matcher->case_sensitive ? first : ascii_upper(first);
+    matcher->last[0] = last;
+    matcher->last[1] = matcher->case_sensitive ? last : ascii_upper(last);
+}
+
+static bool content_matcher_set_literal(content_matcher_t *matcher, const char *needle, bool case_sensitive) {
+    if (!*needle) return true;
+
+    matcher->length = strlen(needle);
+    matcher->needle = malloc(matcher->length);
+    if (!matcher->needle) return false;
+
+    for (size_t i = 0; i < matcher->length; i++) {
+        unsigned char c = (unsigned char)needle[i];
+        matcher->needle[i] = case_sensitive ? c : ascii_lower(c);
+    }
+
+    matcher->unit = 1;
+    matcher->first_at = 0;
+    matcher->last_at = matcher->length - 1;
+    content_matcher_set_filter(matcher);
+    return true;
+}
+
+// Decodes one UTF-8 character, rejecting overlong forms and surrogates.
+// Returns its length, or 0 if the bytes are not valid UTF-8.
+static size_t content_utf8_decode(const unsigned char *s, uint32_t *code_point) {
+    if (s[0] < 0x80) {
+        *code_point = s[0];
+        return 1;
+    }
+
+    size_t length;
+    uint32_t c, min;
+    if ((s[0] & 0xE0) == 0xC0) { length = 2; c = s[0] & 0x1Fu; min = 0x80; }
+    else if ((s[0] & 0xF0) == 0xE0) { length = 3; c = s[0] & 0x0Fu; min = 0x800; }
+    else if ((s[0] & 0xF8) == 0xF0) { length = 4; c = s[0] & 0x07u; min = 0x10000; }
+    else return 0;
+
+    for (size_t i = 1; i < length; i++) {
+        if ((s[i] & 0xC0) != 0x80) return 0;
+        c = (c << 6) | (s[i] & 0x3Fu);
+    }
+    if (c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) return 0;
+    *code_point = c;
+    return length;
+}
+
+static void content_wide_put(unsigned char *out, uint32_t unit, bool big_endian) {
+    out[big_endian ? 1 : 0] = (unsigned char)(unit & 0xFF);
+    out[big_endian ? 0 : 1] = (unsigned char)(unit >> 8);
+}
+
+static uint32_t content_wide_unit(const unsigned char *at, bool big_endian) {
+    return big_endian ? ((uint32_t)at[0] << 8) | at[1] : ((uint32_t)at[1] << 8) | at[0];
+}
+
+// The literal as UTF-16 in one byte order. ASCII characters are folded as
+// in UTF-8; the prefilter checks the low bytes of the first and last
+// characters, since high bytes are mostly zero.
+static content_matcher_t* content_wide_matcher_create(const char *literal, bool case_sensitive,
+                                                      bool big_endian) {
+    const unsigned char *s = (const unsigned char*)literal;
+    size_t length = strlen(literal);
+
+    content_matcher_t *wide = calloc(1, sizeof(content_matcher_t));
+    if (!wide) return NULL;
+    // At most one UTF-16 unit per UTF-8 byte, two per four-byte character.
+    wide->needle = malloc(length * 2);
+    if (!wide->needle) {
+        free(wide);
+        return NULL;
+    }
+
+    size_t out = 0;
+    for (size_t i = 0; i < length;) {
+        uint32_t c;
+        size_t used = content_utf8_decode(s + i, &c);
+        if (used == 0) {
+            content_matcher_destroy(wide);
+            return NULL;
+        }
+        i += used;
+
+        if (c >= 0x10000) {
+            c -= 0x10000;
+            content_wide_put(wide->needle + out, 0xD800 + (c >> 10), big_endian);
+            content_wide_put(wide->needle + out + 2, 0xDC00 + (c & 0x3FF), big_endian);
+            out += 4;
+        } else {
+            if (!case_sensitive && c < 0x80) c = ascii_lower((unsigned char)c);
+            content_wide_put(wide->needle + out, c, big_endian);
+            out += 2;
+        }
+    }
+
+    wide->length = out;
+    wide->case_sensitive = case_sensitive;
+    wide->unit = 2;
+    wide->big_endian = big_endian;
+    wide->first_at = big_endian ? 1 : 0;
+    wide->last_at = out - (big_endian ? 1 : 2);
+    content_matcher_set_filter(wide);
+    return wide;
+}
+
+// Every byte but ASCII letters and digits is escaped, so any literal
+// compiles to a program that matches exactly it.
+static dfa_program_t* content_literal_program(const char *literal, bool case_sensitive) {
+    size_t length = strlen(literal);
+    char *pattern = malloc(length * 4 + 1);
+    if (!pattern) return NULL;
+
+    char *out = pattern;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)literal[i];
+        if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+            *out++ = (char)c;
+        } else {
+            out += sprintf(out, "\\x%02X", c);
+        }
+    }
+    *out = '\0';
+
+    dfa_program_t *program = dfa_compile(pattern, case_sensitive);
+    free(pattern);
+    return program;
+}
+
+content_matcher_t* content_matcher_create(const char *pattern, bool case_sensitive, bool use_regex,
+                                          bool decompress) {
+    if (!pattern || !*pattern) return NULL;
+
+    content_matcher_t *matcher = calloc(1, sizeof(content_matcher_t));
+    if (!matcher) return NULL;
+    matcher->case_sensitive = case_sensitive;
+
+    // A regex's required literal doubles as a prefilter: lines without it
+    // are never handed to the DFA.
+    const char *literal = pattern;
+    if (use_regex) {
+        matcher->regex = dfa_compile(pattern, case_sensitive);
+        if (!matcher->regex) {
+            free(matcher);
+            return NULL;
+        }
+        literal = dfa_required_literal(matcher->regex);
+    }
+
+    if (literal && !content_matcher_set_literal(matcher, literal, case_sensitive)) {
+        content_matcher_destroy(matcher);
+        return NULL;
+    }
+    if (literal && *literal) {
+        matcher->wide[0] = content_wide_matcher_create(literal, case_sensitive, false);
+        matcher->wide[1] = content_wide_matcher_create(literal, case_sensitive, true);
+    }
+
+    // Decompressed text can only be streamed, which takes a program even
+    // for a literal. A literal too long to compile leaves compressed files
+    // searched as they are.
+    matcher->line_regex = matcher->regex;
+    if (decompress && decompress_supported()) {
+        if (!matcher->line_regex) {
+            matcher->line_regex = content_literal_program(pattern, case_sensitive);
+        }
+        matcher->decompress = matcher->line_regex != NULL;
+    }
+    return matcher;
+}
+
+void content_matcher_destroy(content_matcher_t *matcher) {
+    if (!matcher) return;
+    if (matcher->line_regex != matcher->regex) {
+        dfa_program_free(matcher->line_regex);
+    }
+    dfa_program_free(matcher->regex);
+    content_matcher_destroy(matcher->wide[0]);
+    content_matcher_destroy(matcher->wide[1]);
+    free(matcher->needle);
+    free(matcher);
+}
+
+static bool content_verify(const content_matcher_t *matcher, const unsigned char *at) {
+    if (matcher->case_sensitive) {
+        return memcmp(at, matcher->needle, matcher->length) == 0;
+    }
+    if (matcher->unit == 2) {
+        // Only units below 0x80 fold: the low byte of U+0141 stays 'A'.
+        for (size_t i = 0; i < matcher->length; i += 2) {
+            uint32_t c = content_wide_unit(at + i, matcher->big_endian);
+            if (c < 0x80) c = ascii_lower((unsigned char)c);
+            if (c != content_wide_unit(matcher->needle + i, matcher->big_endian)) return false;
+        }
+        return true;
+    }
+    for (size_t i = 0; i < matcher->length; i++) {
+        if (ascii_lower(at[i]) != matcher->needle[i]) return false;
+    }
+    return true;
+}
+
+// A UTF-16 needle only matches whole units, counted from offset 0.
+static bool content_verify_at(const content_matcher_t *matcher, const unsigned char *data, size_t at) {
+    return (at & (matcher->unit - 1)) == 0 && content_verify(matcher, data + at);
+}
+
+size_t content_find(const content_matcher_t *matcher, const unsigned char *data, size_t length,
+                    size_t from, size_t to) {
+    if (!matcher || !data || matcher->length == 0 || length < matcher->length) return SIZE_MAX;
+
+    size_t limit = length - matcher->length + 1;  // one past the last possible start
+    if (to < limit) limit = to;
+    size_t head_at = matcher->first_at;
+    size_t tail = matcher->last_at;
+    size_t i = from;
+
+#ifdef __SSE2__
+    // Two-byte filter: only positions where both the first and the last
+    // needle byte line up are verified, which rules out nearly all others.
+    // (For a UTF-16 needle, the low bytes of its first and last units.)
+    const __m128i first_a = _mm_set1_epi8((char)matcher->first[0]);
+    const __m128i first_b = _mm_set1_epi8((char)matcher->first[1]);
+    const __m128i last_a = _mm_set1_epi8((char)matcher->last[0]);
+    const __m128i last_b = _mm_set1_epi8((char)matcher->last[1]);
+
+    for (; i + 16 <= limit; i += 16) {
+        __m128i head = _mm_loadu_si128((const __m128i*)(data + i + head_at));
+        __m128i end = _mm_loadu_si128((const __m128i*)(data + i + tail));
+        __m128i hit = _mm_and_si128(_mm_or_si128(_mm_cmpeq_epi8(head, first_a), _mm_cmpeq_epi8(head, first_b)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(end, last_a), _mm_cmpeq_epi8(end, last_b)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+        while (mask) {
+            size_t at = i + (size_t)__builtin_ctz(mask);
+            if (content_verify_at(matcher, data, at)) return at;
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    if (matcher->case_sensitive) {
+        // memchr is vectorised by the C library as well.
+        while (i < limit) {
+            const unsigned char *candidate = memchr(data + i + head_at, matcher->first[0], limit - i);
+            if (!candidate) break;
+            i = (size_t)(candidate - data) - head_at;
+            if (data[i + tail] == matcher->last[0] && content_verify_at(matcher, data, i)) return i;
+            i++;
+        }
+        return SIZE_MAX;
+    }
+
+    for (; i < limit; i++) {
+        unsigned char c = data[i + head_at];
+        if ((c == matcher->first[0] || c == matcher->first[1]) && content_verify_at(matcher, data, i)) {
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+static bool content_buffer_reserve(content_buffer_t *buffer) {
+    if (!buffer->data) {
+        buffer->data = malloc(CONTENT_READ_WHOLE_MAX);
+        if (!buffer->data) return false;
+        buffer->capacity = CONTENT_READ_WHOLE_MAX;
+    }
+    return true;
+}
+
+static dfa_cache_t* content_buffer_dfa(const content_matcher_t *matcher, content_buffer_t *buffer) {
+    if (!buffer->regex_cache) {
+        buffer->regex_cache = dfa_cache_create(matcher->line_regex);
+    }
+    return buffer->regex_cache;
+}
+
+void content_buffer_free(content_buffer_t *buffer) {
+    if (!buffer) return;
+    free(buffer->data);
+    dfa_cache_free(buffer->regex_cache);
+    buffer->data = NULL;
+    buffer->capacity = 0;
+    buffer->regex_cache = NULL;
+}
+
+void content_free_matches(content_match_t *matches) {
+    while (matches) {
+        content_match_t *next = matches->next;
+        free(matches->text);
+        free(matches);
+        matches = next;
+    }
+}
+
+// Keeps the line as given, cut to CONTENT_LINE_MAX.
+static content_match_t* content_match_copy(uint64_t line, const unsigned char *start, size_t length) {
+    if (length > CONTENT_LINE_MAX) {
+        // Back up to the lead byte so no character is split.
+        length = CONTENT_LINE_MAX;
+        while (length > 0 && (start[length] & 0xC0) == 0x80) {
+            length--;
+        }
+    }
+
+    content_match_t *match = malloc(sizeof(content_match_t));
+    if (!match) return NULL;
+
+    match->text = malloc(length + 1);
+    if (!match->text) {
+        free(match);
+        return NULL;
+    }
+    memcpy(match->text, start, length);
+    match->text[length] = '\0';
+    match->line = line;
+    match->next = NULL;
+    return match;
+}
+
+// Drops the '\r' of a CRLF line break first.
+static content_match_t* content_match_create(uint64_t line, const unsigned char *start, size_t length) {
+    if (length > 0 && start[length - 1] == '\r') {
+        length--;
+    }
+    return content_match_copy(line, start, length);
+}
+
+// Counts line breaks, sixteen bytes at a time where SSE2 is available.
+static uint64_t content_count_newlines(const unsigned char *data, size_t length) {
+    uint64_t count = 0;
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(data + i));
+        count += (uint64_t)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+    }
+#endif
+    for (; i < length; i++) {
+        count += data[i] == '\n';
+    }
+    return count;
+}
+
+// Counts the line breaks in [from, to), moving line_start past the last one.
+static void content_count_lines(const unsigned char *data, size_t from, size_t to,
+                                uint64_t *line, size_t *line_start) {
+    uint64_t count = content_count_newlines(data + from, to - from);
+    if (count == 0) return;
+
+    *line += count;
+    size_t last = to;
+    while (data[last - 1] != '\n') {
+        last--;
+    }
+    *line_start = last;
+}
+
+// Offset of the first line that starts at or after `at` (a line starts at 0
+// and after every line break), or length if there is none.
+static size_t content_line_start(const unsigned char *data, size_t length, size_t at) {
+    if (at == 0) return 0;
+    if (at >= length) return length;
+    const unsigned char *newline = memchr(data + at - 1, '\n', length - at + 1);
+    return newline ? (size_t)(newline - data) + 1 : length;
+}
+
+// Scans the lines that start in [begin, end).
+static int content_scan(const content_matcher_t *matcher, const unsigned char *data, size_t length,
+                        size_t begin, size_t end, cancel_token_t *cancel,
+                        content_match_t **matches, uint64_t *lines) {
+    size_t first = content_line_start(data, length, begin);
+    if (first >= end) return 0;
+    size_t stop = content_line_start(data, length, end);
+    data += first;
+    length = stop - first;
+
+    content_match_t **tail = matches;
+    bool found = false;
+    uint64_t line = 1;
+    size_t line_start = 0;
+    size_t counted = 0;               // line breaks before this offset are in `line`
+    size_t pos = 0;
+    size_t next_check = 0;
+
+    while (pos < length) {
+        if (pos >= next_check) {
+            if (cancel_token_check(cancel)) break;
+            next_check = pos + CONTENT_SCAN_CHUNK;
+        }
+
+        size_t to = length - pos > CONTENT_SCAN_CHUNK ? pos + CONTENT_SCAN_CHUNK : length;
+        size_t at = content_find(matcher, data, length, pos, to);
+        if (at == SIZE_MAX) {
+            pos = to;
+            continue;
+        }
+
+        found = true;
+        if (!matches) break;
+
+        content_count_lines(data, counted, at, &line, &line_start);
+        counted = at;
+        const unsigned char *newline = memchr(data + at, '\n', length - at);
+        size_t line_end = newline ? (size_t)(newline - data) : length;
+
+        // One entry per line, however many times the needle occurs in it.
+        content_match_t *match = content_match_create(line, data + line_start, line_end - line_start);
+        if (!match) break;
+        *tail = match;
+        tail = &match->next;
+
+        if (!newline) {
+            pos = length;
+            break;
+        }
+        line++;
+        line_start = counted = pos = line_end + 1;
+    }
+
+    if (lines && pos >= length) {
+        content_count_lines(data, counted, length, &line, &line_start);
+        *lines = line - (length > 0 && data[length - 1] == '\n' ? 1 : 0);
+    }
+    return found ? 1 : 0;
+}
+
+content_encoding_t content_detect_encoding(const unsigned char *data, size_t length) {
+    if (length > CONTENT_BINARY_PROBE) length = CONTENT_BINARY_PROBE;
+    if (length >= 2 && data[0] == 0xFF && data[1] == 0xFE) return CONTENT_ENCODING_UTF16LE;
+    if (length >= 2 && data[0] == 0xFE && data[1] == 0xFF) return CONTENT_ENCODING_UTF16BE;
+    if (!memchr(data, 0, length)) return CONTENT_ENCODING_UTF8;
+
+    // Without a byte order mark: at least half the pairs have a zero high
+    // byte, and hardly any a zero low byte. Binary data has them on both.
+    size_t pairs = length / 2;
+    size_t zeros[2] = { 0, 0 };
+    for (size_t i = 0; i < pairs * 2; i += 2) {
+        zeros[0] += data[i] == 0;
+        zeros[1] += data[i + 1] == 0;
+    }
+    if (pairs == 0) return CONTENT_ENCODING_BINARY;
+    if (zeros[1] * 2 >= pairs && zeros[0] * 32 <= zeros[1]) return CONTENT_ENCODING_UTF16LE;
+    if (zeros[0] * 2 >= pairs && zeros[1] * 32 <= zeros[0]) return CONTENT_ENCODING_UTF16BE;
+    return CONTENT_ENCODING_BINARY;
+}
+
+// UTF-16 text is scanned as it is, two bytes a unit from offset 0; a line
+// break is the unit U+000A.
+static uint64_t content_wide_count_newlines(const unsigned char *data, size_t length, bool big_endian) {
+    uint64_t count = 0;
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi16(big_endian ? 0x0A00 : 0x000A);
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(data + i));
+        count += (uint64_t)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi16(chunk, newline))) / 2;
+    }
+#endif
+    for (; i + 2 <= length; i += 2) {
+        count += content_wide_unit(data + i, big_endian) == '\n';
+    }
+    return count;
+}
+
+static void content_wide_count_lines(const unsigned char *data, size_t from, size_t to, bool big_endian,
+                                     uint64_t *line, size_t *line_start) {
+    uint64_t count = content_wide_count_newlines(data + from, to - from, big_endian);
+    if (count == 0) return;
+
+    *line += count;
+    size_t last = to;
+    while (content_wide_unit(data + last - 2, big_endian) != '\n') {
+        last -= 2;
+    }
+    *line_start = last;
+}
+
+// Offset of the first line break unit at or after `at`, or length.
+static size_t content_wide_newline(const unsigned char *data, size_t length, size_t at, bool big_endian) {
+    size_t low = big_endian ? 1 : 0;
+    while (at < length) {
+        const unsigned char *hit = memchr(data + at + low, '\n', length - at - low);
+        if (!hit) break;
+        size_t unit = (size_t)(hit - data) - low;
+        if ((unit & 1) == 0 && data[unit + 1 - low] == 0) return unit;
+        at = (unit | 1) + 1;
+    }
+    return length;
+}
+
+// Converts whole characters while they fit; an unpaired surrogate becomes
+// U+FFFD. Returns the bytes written, and in *used the input consumed.
+static size_t content_wide_to_utf8(const unsigned char *data, size_t length, bool big_endian,
+                                   unsigned char *out, size_t capacity, size_t *used) {
+    size_t in = 0;
+    size_t written = 0;
+    while (in + 2 <= length) {
+        uint32_t c = content_wide_unit(data + in, big_endian);
+        size_t units = 1;
+        if (c >= 0xD800 && c <= 0xDBFF && in + 4 <= length) {
+            uint32_t low = content_wide_unit(data + in + 2, big_endian);
+            if (low >= 0xDC00 && low <= 0xDFFF) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                units = 2;
+            }
+        }
+        if (c >= 0xD800 && c <= 0xDFFF) c = 0xFFFD;
+
+        size_t bytes = c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+        if (written + bytes > capacity) break;
+        if (bytes == 1) {
+            out[written] = (unsigned char)c;
+        } else {
+            for (size_t i = bytes - 1; i > 0; i--) {
+                out[written + i] = (unsigned char)(0x80 | (c & 0x3F));
+                c >>= 6;
+            }
+            out[written] = (unsigned char)((0xF00u >> bytes) | c);
+        }
+        written += bytes;
+        in += units * 2;
+    }
+    *used = in;
+    return written;
+}
+
+// A regex sees the line as UTF-8, converted a piece at a time.
+static bool content_wide_match_line(dfa_cache_t *dfa, const unsigned char *data, size_t length,
+                                    bool big_endian) {
+    unsigned char piece[1024];
+    dfa_line_t state;
+    dfa_line_begin(dfa, &state);
+    while (length > 0) {
+        size_t used = 0;
+        size_t written = content_wide_to_utf8(data, length, big_endian, piece, sizeof(piece), &used);
+        dfa_line_feed(dfa, &state, piece, written);
+        data += used;
+        length -= used;
+    }
+    return dfa_line_end(dfa, &state);
+}
+
+// Only the part of the line that is kept is converted. The caller has
+// already left out the line's '\r'.
+static content_match_t* content_wide_match_create(uint64_t line, const unsigned char *start, size_t length,
+                                                  bool big_endian) {
+    unsigned char text[CONTENT_LINE_MAX + 4];
+    size_t used = 0;
+    size_t written = content_wide_to_utf8(start, length, big_endian, text, sizeof(text), &used);
+    return content_match_copy(line, text, written);
+}
+
+static int content_scan_wide(const content_matcher_t *matcher, content_buffer_t *buffer,
+                             const unsigned char *data, size_t length, bool big_endian,
+                             cancel_token_t *cancel, content_match_t **matches, uint64_t *lines) {
+    const content_matcher_t *wide = matcher->wide[big_endian ? 1 : 0];
+    if (!wide && !matcher->regex) return 0;     // the literal cannot occur in UTF-16
+
+    dfa_cache_t *dfa = NULL;
+    if (matcher->regex) {
+        dfa = content_buffer_dfa(matcher, buffer);
+        if (!dfa) return -1;
+    }
+
+    length &= ~(size_t)1;             // a stray last byte is not a character
+    size_t start = length >= 2 && content_wide_unit(data, big_endian) == 0xFEFF ? 2 : 0;
+
+    content_match_t **tail = matches;
+    bool found = false;
+    uint64_t line = 1;
+    size_t line_start = start;
+    size_t counted = start;
+    size_t pos = start;
+    size_t next_check = start;
+
+    while (pos < length) {
+        if (pos >= next_check) {
+            if (cancel_token_check(cancel)) break;
+            next_check = pos + CONTENT_SCAN_CHUNK;
+        }
+
+        size_t at = pos;
+        if (wide) {
+            size_t to = length - pos > CONTENT_SCAN_CHUNK ? pos + CONTENT_SCAN_CHUNK : length;
+            at = content_find(wide, data, length, pos, to);
+            if (at == SIZE_MAX) {
+                pos = to;
+                continue;
+            }
+        }
+
+        content_wide_count_lines(data, counted, at, big_endian, &line, &line_start);
+        counted = at;
+        size_t line_end = content_wide_newline(data, length, at, big_endian);
+        size_t match_end = line_end;
+        if (match_end > line_start && content_wide_unit(data + match_end - 2, big_endian) == '\r') {
+            match_end -= 2;
+        }
+
+        if (!dfa || content_wide_match_line(dfa, data + line_start, match_end - line_start, big_endian)) {
+            found = true;
+            if (!matches) break;
+
+            content_match_t *match = content_wide_match_create(line, data + line_start, match_end - line_start,
+                                                               big_endian);
+            if (!match) break;
+            *tail = match;
+            tail = &match->next;
+        }
+
+        if (line_end == length) {
+            pos = length;
+            break;
+        }
+        line++;
+        line_start = counted = pos = line_end + 2;
+    }
+
+    if (lines && pos >= length) {
+        content_wide_count_lines(data, counted, length, big_endian, &line, &line_start);
+        bool terminated = length > start && content_wide_unit(data + length - 2, big_endian) == '\n';
+        *lines = line - (terminated ? 1 : 0);
+    }
+    return found ? 1 : 0;
+}
+
+// Scans a file held in memory, detecting its encoding when the range
+// starts it. Literal matchers only for UTF-8; UTF-16 takes either.
+static int content_scan_text(const content_matcher_t *matcher, content_buffer_t *buffer,
+                             const unsigned char *data, size_t length, size_t begin, size_t end,
+                             cancel_token_t *cancel, content_match_t **matches, uint64_t *lines) {
+    if (begin == 0) {
+        switch (content_detect_encoding(data, length)) {
+            case CONTENT_ENCODING_BINARY:
+                return 0;
+            case CONTENT_ENCODING_UTF16LE:
+                return content_scan_wide(matcher, buffer, data, length, false, cancel, matches, lines);
+            case CONTENT_ENCODING_UTF16BE:
+                return content_scan_wide(matcher, buffer, data, length, true, cancel, matches, lines);
+            default:
+                break;
+        }
+    }
+    return content_scan(matcher, data, length, begin, end, cancel, matches, lines);
+}
+
+// Regex scanning keeps one file's progress between reads. Lines are handed
+// to the DFA whole whenever they fit in the buffer; a longer one is fed in
+// pieces as it streams past, keeping only its start for the report.
+typedef struct {
+    const content_matcher_t *matcher;
+    dfa_cache_t *dfa;
+    content_match_t **tail;           // NULL when only the first hit matters
+    uint64_t line;                    // number of the line the pending data starts
+    bool unterminated;                // the last line had no line break
+    bool found;
+
+    bool long_line;
+    bool long_pending_cr;             // held back in case it ends the line
+    dfa_line_t long_state;
+    unsigned char long_prefix[CONTENT_LINE_MAX + 1];
+    size_t long_prefix_length;
+} content_regex_scan_t;
+
+// Records a matching line. Returns false once scanning can stop.
+static bool content_regex_report(content_regex_scan_t *scan, const unsigned char *start, size_t length) {
+    scan->found = true;
+    if (!scan->tail) return false;
+
+    content_match_t *match = content_match_create(scan->line, start, length);
+    if (!match) return false;
+    *scan->tail = match;
+    scan->tail = &match->next;
+    return true;
+}
+
+// Matches every line in data, which ends with a line break unless it is
+// the end of the file. Returns false once scanning can stop.
+static bool content_regex_lines(content_regex_scan_t *scan, const unsigned char *data, size_t length) {
+    const content_matcher_t *matcher = scan->matcher;
+    size_t pos = 0;
+    if (length > 0 && data[length - 1] != '\n') {
+        scan->unterminated = true;
+    }
+
+    while (pos < length) {
+        size_t line_start = pos;
+        size_t at = pos;
+        if (matcher->length > 0) {
+            at = content_find(matcher, data, length, pos, length);
+            if (at == SIZE_MAX) {
+                content_count_lines(data, pos, length, &scan->line, &line_start);
+                return true;
+            }
+            content_count_lines(data, pos, at, &scan->line, &line_start);
+        }
+
+        const unsigned char *newline = memchr(data + at, '\n', length - at);
+        size_t line_end = newline ? (size_t)(newline - data) : length;
+        size_t match_end = line_end > line_start && data[line_end - 1] == '\r' ? line_end - 1 : line_end;
+
+        if (dfa_match_line(scan->dfa, data + line_start, match_end - line_start) &&
+            !content_regex_report(scan, data + line_start, line_end - line_start)) {
+            return false;
+        }
+
+        if (!newline) break;
+        scan->line++;
+        pos = line_end + 1;
+    }
+    return true;
+}
+
+static void content_regex_long_feed(content_regex_scan_t *scan, const unsigned char *data, size_t length) {
+    size_t keep = sizeof(scan->long_prefix) - scan->long_prefix_length;
+    if (keep > length) keep = length;
+    memcpy(scan->long_prefix + scan->long_prefix_length, data, keep);
+    scan->long_prefix_length += keep;
+
+    if (length == 0) return;
+    if (scan->long_pending_cr) {
+        dfa_line_feed(scan->dfa, &scan->long_state, (const unsigned char*)"\r", 1);
+    }
+    scan->long_pending_cr = data[length - 1] == '\r';
+    dfa_line_feed(scan->dfa, &scan->long_state, data, length - (scan->long_pending_cr ? 1 : 0));
+}
+
+// Returns false once scanning can stop.
+static bool content_regex_long_end(content_regex_scan_t *scan) {
+    scan->long_line = false;
+    if (!dfa_line_end(scan->dfa, &scan->long_state)) return true;
+    return content_regex_report(scan, scan->long_prefix, scan->long_prefix_length);
+}
+
+
+// Streamed text comes from a file read at any offset, or from a
+// decompressor that can only be read in order from the start.
+typedef struct {
+    HANDLE file;
+    decompress_stream_t *decoder;
+} content_source_t;
+
+static bool content_source_read(content_source_t *source, uint64_t offset, unsigned char *data,
+                                size_t wanted, size_t *bytes_read) {
+    if (source->decoder) {
+        return decompress_read(source->decoder, data, wanted, bytes_read);
+    }
+    return platform_read_at(source->file, offset, data, wanted, bytes_read);
+}
+
+// Memory stays at one buffer and one DFA cache however large the file is.
+// Text that is not UTF-8 is left alone, its encoding stored in *encoding.
+static int content_scan_stream(const content_matcher_t *matcher, content_buffer_t *buffer,
+                               content_source_t *source, uint64_t begin, uint64_t end,
+                               cancel_token_t *cancel, content_match_t **matches, uint64_t *lines,
+                               content_encoding_t *encoding) {
+    if (!content_buffer_dfa(matcher, buffer)) return -1;
+
+    content_regex_scan_t scan;
+    memset(&scan, 0, sizeof(scan));
+    scan.matcher = matcher;
+    scan.dfa = buffer->regex_cache;
+    scan.tail = matches;
+    scan.line = 1;
+
+    // A range that starts mid-file reads from the byte before it: the line
+    // that byte is part of belongs to the previous range and is skipped.
+    unsigned char *data = buffer->data;
+    size_t capacity = buffer->capacity;
+    uint64_t base = begin > 0 ? begin - 1 : 0;  // file offset of data[0]
+    uint64_t offset = base;
+    bool aligning = begin > 0;
+    size_t filled = 0;
+    bool eof = false;
+    bool scanning = true;
+
+    while (scanning && !(eof && filled == 0)) {
+        if (cancel_token_check(cancel)) break;
+
+        if (!eof) {
+            size_t wanted = capacity - filled;
+            size_t bytes_read = 0;
+            if (!content_source_read(source, offset, data + filled, wanted, &bytes_read)) {
+                if (matches) {
+                    content_free_matches(*matches);
+                    *matches = NULL;
+                }
+                return -1;
+            }
+            if (offset == 0 && begin == 0) {
+                *encoding = content_detect_encoding(data, bytes_read);
+                if (*encoding != CONTENT_ENCODING_UTF8) return 0;
+            }
+            offset += bytes_read;
+            filled += bytes_read;
+            eof = bytes_read < wanted;
+        }
+
+        size_t start = 0;
+        if (aligning) {
+            const unsigned char *newline = memchr(data, '\n', filled);
+            if (!newline) {
+                base += filled;
+                filled = 0;
+                continue;
+            }
+            start = (size_t)(newline - data) + 1;
+            aligning = false;
+        } else if (scan.long_line) {
+            const unsigned char *newline = memchr(data, '\n', filled);
+            if (!newline) {
+                content_regex_long_feed(&scan, data, filled);
+                base += filled;
+                filled = 0;
+                if (eof) {
+                    scanning = content_regex_long_end(&scan);
+                    scan.unterminated = true;
+                }
+                continue;
+            }
+            start = (size_t)(newline - data);
+            content_regex_long_feed(&scan, data, start);
+            scanning = content_regex_long_end(&scan);
+            scan.line++;
+            start++;
+        }
+
+        // Lines from here on start in the next range.
+        if (base + start >= end) break;
+
+        // Complete lines end at the last line break; at the end of the file
+        // the last line needs none.
+        size_t complete = filled;
+        if (!eof) {
+            while (complete > start && data[complete - 1] != '\n') {
+                complete--;
+            }
+        }
+
+        // Stop after the line holding the range's last byte.
+        bool last = false;
+        if (base + complete > end) {
+            size_t cut = (size_t)(end - base);
+            const unsigned char *newline = memchr(data + cut - 1, '\n', complete - cut + 1);
+            if (newline) complete = (size_t)(newline - data) + 1;
+            last = true;
+        }
+
+        if (complete == start && start == 0 && filled == capacity) {
+            // Not a single line break in a full buffer.
+            scan.long_line = true;
+            scan.long_pending_cr = false;
+            scan.long_prefix_length = 0;
+            dfa_line_begin(scan.dfa, &scan.long_state);
+            content_regex_long_feed(&scan, data, filled);
+            base += filled;
+            filled = 0;
+            continue;
+        }
+
+        if (scanning && complete > start) {
+            scanning = content_regex_lines(&scan, data + start, complete - start);
+        }
+        memmove(data, data + complete, filled - complete);
+        base += complete;
+        filled -= complete;
+        if (last) break;
+    }
+
+    if (lines && scanning) {
+        *lines = scan.line - (scan.unterminated ? 0 : 1);
+    }
+    return scan.found ? 1 : 0;
+}
+
+int content_search_range(const content_matcher_t *matcher, content_buffer_t *buffer,
+                         const char *path, uint64_t size, uint64_t begin, uint64_t end,
+                         cancel_token_t *cancel, content_match_t **matches, uint64_t *lines) {
+    if (matches) *matches = NULL;
+    if (lines) *lines = 0;
+    if (!matcher || !buffer || !path) return -1;
+
+    if (begin == 0 && end >= size && content_is_compressed(matcher, path)) {
+        decompress_stream_t *decoder = decompress_open(path, decompress_format_for_path(path));
+        if (decoder) {
+            // The decompressed length is unknown until the stream ends.
+            // Decompressed UTF-16 is not searched.
+            int status = -1;
+            if (content_buffer_reserve(buffer)) {
+                content_source_t source = { INVALID_HANDLE_VALUE, decoder };
+                content_encoding_t encoding = CONTENT_ENCODING_UTF8;
+                status = content_scan_stream(matcher, buffer, &source, 0, UINT64_MAX, cancel, matches, lines,
+                                             &encoding);
+            }
+            decompress_close(decoder);
+            return status;
+        }
+        // Not actually compressed: searched as it is.
+    }
+
+    if (end > size) end = size;
+    if (begin >= end) return 0;
+    if (!lines && size < matcher->length) return 0;
+
+    if (matcher->regex) {
+        if (!content_buffer_reserve(buffer)) return -1;
+
+        HANDLE file = platform_open_file(path, true);
+        if (file == INVALID_HANDLE_VALUE) return -1;
+
+        content_source_t source = { file, NULL };
+        content_encoding_t encoding = CONTENT_ENCODING_UTF8;
+        int status = content_scan_stream(matcher, buffer, &source, begin, end, cancel, matches, lines,
+                                         &encoding);
+        CloseHandle(file);
+        // UTF-16 text is searched whole from memory below.
+        if (encoding != CONTENT_ENCODING_UTF16LE && encoding != CONTENT_ENCODING_UTF16BE) return status;
+    }
+
+    if (size <= CONTENT_READ_WHOLE_MAX) {
+        if (!content_buffer_reserve(buffer)) return -1;
+
+        HANDLE file = platform_open_file(path, true);
+        if (file == INVALID_HANDLE_VALUE) return -1;
+
+        size_t bytes_read = 0;
+        bool ok = platform_read_at(file, 0, buffer->data, (size_t)size, &bytes_read);
+        CloseHandle(file);
+        if (!ok) return -1;
+
+        return content_scan_text(matcher, buffer, buffer->data, bytes_read, (size_t)begin, (size_t)end,
+                                 cancel, matches, lines);
+    }
+
+    platform_mapped_file_t mapped;
+    if (!platform_map_file(path, &mapped)) return -1;
+
+    int status = content_scan_text(matcher, buffer, mapped.data, (size_t)mapped.size, (size_t)begin,
+                                   (size_t)end, cancel, matches, lines);
+    platform_unmap_file(&mapped);
+    return status;
+}
+
+int content_search_file(const content_matcher_t *matcher, content_buffer_t *buffer,
+                        const char *path, uint64_t size, cancel_token_t *cancel,
+                        content_match_t **matches) {
+    return content_search_range(matcher, buffer, path, size, 0, size, cancel, matches, NULL);
+}
+
+int content_search_buffer(const content_matcher_t *matcher, content_buffer_t *buffer,
+                          const unsigned char *data, size_t length, cancel_token_t *cancel,
+                          content_match_t **matches) {
+    if (matches) *matches = NULL;
+    if (!matcher || !buffer || !data) return -1;
+
+    if (!matcher->regex || content_detect_encoding(data, length) != CONTENT_ENCODING_UTF8) {
+        return content_scan_text(matcher, buffer, data, length, 0, length, cancel, matches, NULL);
+    }
+
+    if (!content_buffer_dfa(matcher, buffer)) return -1;
+
+    content_regex_scan_t scan;
+    memset(&scan, 0, sizeof(scan));
+    scan.matcher = matcher;
+    scan.dfa = buffer->regex_cache;
+    scan.tail = matches;
+    scan.line = 1;
+    content_regex_lines(&scan, data, length);
+    return scan.found ? 1 : 0;
+}
+
+bool content_is_compressed(const content_matcher_t *matcher, const char *path) {
+    return matcher && matcher->decompress && decompress_format_for_path(path) != DECOMPRESS_NONE;
+}
+
+content_encoding_t content_file_encoding(const char *path) {
+    HANDLE file = platform_open_file(path, true);
+    if (file == INVALID_HANDLE_VALUE) return CONTENT_ENCODING_UTF8;
+
+    unsigned char probe[CONTENT_BINARY_PROBE];
+    size_t bytes_read = 0;
+    bool ok = platform_read_at(file, 0, probe, sizeof(probe), &bytes_read);
+    CloseHandle(file);
+    return ok ? content_detect_encoding(probe, bytes_read) : CONTENT_ENCODING_UTF8;
+}
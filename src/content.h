@@ -0,0 +1,103 @@
+#ifndef CONTENT_H
+#define CONTENT_H
+
+#include "cancel.h"
+#include "regex/dfa.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Files up to this size are read with a single call into the caller's
+// buffer; larger ones are mapped. Regex searches stream every file through
+// a buffer of this size instead, as do searches of decompressed text.
+#define CONTENT_READ_WHOLE_MAX (256u * 1024u)
+
+// Matching lines are kept up to this many bytes (cut at a UTF-8 boundary).
+#define CONTENT_LINE_MAX 256
+
+// Files with a NUL byte in this many leading bytes are treated as binary
+// and never match, unless the bytes show UTF-16 text.
+#define CONTENT_BINARY_PROBE 4096
+
+typedef enum {
+    CONTENT_ENCODING_UTF8,            // or any other ASCII-compatible text
+    CONTENT_ENCODING_UTF16LE,
+    CONTENT_ENCODING_UTF16BE,
+    CONTENT_ENCODING_BINARY
+} content_encoding_t;
+
+typedef struct content_match {
+    uint64_t line;                    // 1-based
+    char *text;                       // without the line break
+    struct content_match *next;
+} content_match_t;
+
+typedef struct content_matcher content_matcher_t;
+
+// A literal, or with use_regex a pattern as described in regex/dfa.h.
+// Case-insensitive matching folds ASCII letters only. UTF-16 files are
+// searched for the literal (a regex's required literal) converted to
+// UTF-16 once, here; only their matching lines are converted back, and a
+// regex sees every line of them as UTF-8. With decompress,
+// files that decompress.h can read are searched decompressed. Returns NULL
+// for an empty or invalid pattern.
+content_matcher_t* content_matcher_create(const char *pattern, bool case_sensitive, bool use_regex,
+                                          bool decompress);
+void content_matcher_destroy(content_matcher_t *matcher);
+
+// Offset of the first occurrence of the literal (for a regex, the literal
+// every match contains) starting in [from, to), or SIZE_MAX. It may extend
+// past `to`, up to `length`.
+size_t content_find(const content_matcher_t *matcher, const unsigned char *data, size_t length,
+                    size_t from, size_t to);
+
+// Read buffer and regex state reused across files by one thread.
+typedef struct {
+    unsigned char *data;
+    size_t capacity;
+    dfa_cache_t *regex_cache;
+} content_buffer_t;
+
+void content_buffer_free(content_buffer_t *buffer);
+
+// Returns 1 if the file contains a match, 0 if not (or it is binary),
+// -1 if it could not be read. With matches == NULL the scan stops at the
+// first hit; otherwise every matching line is collected, in file order.
+// A cancelled scan returns what it found so far.
+int content_search_file(const content_matcher_t *matcher, content_buffer_t *buffer,
+                        const char *path, uint64_t size, cancel_token_t *cancel,
+                        content_match_t **matches);
+
+// Searches only the lines that start in [begin, end) of the file, so that
+// ranges tiling the file visit every line exactly once. Line numbers are
+// relative to the range: its first line is line 1. *lines, if given,
+// receives the number of lines that start in the range (exact only when the
+// whole range was scanned). The encoding is detected only for the range
+// starting at 0, and UTF-16 text is searched whole from there.
+int content_search_range(const content_matcher_t *matcher, content_buffer_t *buffer,
+                         const char *path, uint64_t size, uint64_t begin, uint64_t end,
+                         cancel_token_t *cancel, content_match_t **matches, uint64_t *lines);
+
+// Searches a file already read into memory, as content_search_file would.
+// The buffer only provides the regex state; data is not copied.
+int content_search_buffer(const content_matcher_t *matcher, content_buffer_t *buffer,
+                          const unsigned char *data, size_t length, cancel_token_t *cancel,
+                          content_match_t **matches);
+
+// True if the matcher searches this file decompressed. Such files are read
+// in order from the start, so they can be neither split into ranges nor
+// searched from a buffer of their raw bytes.
+bool content_is_compressed(const content_matcher_t *matcher, const char *path);
+
+// Decides from the first CONTENT_BINARY_PROBE bytes: a byte order mark
+// names UTF-16, and so do NULs falling almost only in the high byte of each
+// pair, as in mostly-ASCII text; any other NUL means binary.
+content_encoding_t content_detect_encoding(const unsigned char *data, size_t length);
+
+// The same test on a file's leading bytes, as content_search_file applies
+// it. A file that cannot be read counts as UTF-8.
+content_encoding_t content_file_encoding(const char *path);
+
+void content_free_matches(content_match_t *matches);
+
+#endif
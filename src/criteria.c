@@ -14,15 +14,121 @@ void criteria_init(search_criteria_t *criteria) {
     criteria->use_glob = false;
     criteria->use_regex = false;
     criteria->skip_common_dirs = true;
+    criteria->use_ignore_files = true;
     criteria->preview_mode = false;
     criteria->preview_lines = 10;
     criteria->file_type_filter = NULL;
     criteria->max_threads = 0;
+    criteria->threads_min = 0;
+    criteria->threads_max = 0;
     criteria->timeout_ms = 300000;    // 5 minutes
+    criteria->progress_interval_ms = 100;
     criteria->follow_symlinks = false;
     criteria->include_hidden = false;
     criteria->max_results = 0;        // Unlimited
     criteria->max_depth = SIZE_MAX;
+    criteria->sort_mode = RQ_SORT_NONE;
+    criteria->top_count = 0;          // Disabled
+    criteria->top_by = RQ_TOP_BY_SIZE;
+    criteria->top_ascending = false;
+    criteria->du_mode = false;
+    criteria->du_depth = 1;
+    criteria->find_duplicates = false;
+}
+
+bool criteria_add_root(search_criteria_t *criteria, const char *path) {
+    if (!criteria || !path) return false;
+
+    char **grown = realloc(criteria->root_paths, (criteria->root_count + 1) * sizeof(char*));
+    if (!grown) return false;
+    criteria->root_paths = grown;
+
+    criteria->root_paths[criteria->root_count] = _strdup(path);
+    if (!criteria->root_paths[criteria->root_count]) return false;
+
+    if (!criteria->root_path) {
+        criteria->root_path = _strdup(path);
+        if (!criteria->root_path) {
+            free(criteria->root_paths[criteria->root_count]);
+            return false;
+        }
+    }
+
+    criteria->root_count++;
+    return true;
+}
+
+static bool root_is_within(const char *inner, const char *outer) {
+    size_t outer_len = strlen(outer);
+    if (_strnicmp(inner, outer, outer_len) != 0) return false;
+    return inner[outer_len] == '\0' || inner[outer_len] == '\\' || outer[outer_len - 1] == '\\';
+}
+
+size_t criteria_normalize_roots(search_criteria_t *criteria) {
+    if (!criteria || criteria->root_count < 2) return 0;
+
+    size_t count = criteria->root_count;
+    char **canonical = calloc(count, sizeof(char*));
+    if (!canonical) return 0;
+
+    for (size_t i = 0; i < count; i++) {
+        canonical[i] = platform_full_path(criteria->root_paths[i]);
+        if (!canonical[i]) {
+            canonical[i] = _strdup(criteria->root_paths[i]);
+        }
+        if (!canonical[i]) {
+            goto done;
+        }
+
+        // "C:\dir\" and "C:\dir" are the same root; "C:\" keeps its slash.
+        size_t len = strlen(canonical[i]);
+        while (len > 1 && canonical[i][len - 1] == '\\' && canonical[i][len - 2] != ':') {
+            canonical[i][--len] = '\0';
+        }
+    }
+
+    // Original spellings are kept so result paths look the way they were asked for.
+    bool *redundant = calloc(count, sizeof(bool));
+    if (!redundant) {
+        goto done;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < count && !redundant[i]; j++) {
+            if (i == j) continue;
+            if (_stricmp(canonical[i], canonical[j]) == 0) {
+                redundant[i] = j < i;
+            } else {
+                redundant[i] = root_is_within(canonical[i], canonical[j]);
+            }
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (redundant[i]) {
+            free(criteria->root_paths[i]);
+        } else {
+            criteria->root_paths[kept++] = criteria->root_paths[i];
+        }
+    }
+    free(redundant);
+    criteria->root_count = kept;
+
+    if (kept > 0 && strcmp(criteria->root_path, criteria->root_paths[0]) != 0) {
+        char *first = _strdup(criteria->root_paths[0]);
+        if (first) {
+            free(criteria->root_path);
+            criteria->root_path = first;
+        }
+    }
+
+done:
+    for (size_t i = 0; i < count; i++) {
+        free(canonical[i]);
+    }
+    free(canonical);
+    return count - criteria->root_count;
 }
 
 bool criteria_parse_extensions(search_criteria_t *criteria, const char *extensions_str) {
@@ -92,11 +198,109 @@ bool criteria_parse_extensions(search_criteria_t *criteria, const char *extensio
     return true;
 }
 
+static bool criteria_append_string(char ***list, size_t *count, const char *value, size_t len) {
+    while (len > 0 && isspace((unsigned char)*value)) {
+        value++;
+        len--;
+    }
+    while (len > 0 && isspace((unsigned char)value[len - 1])) {
+        len--;
+    }
+    if (len == 0) return true;
+
+    char **grown = realloc(*list, (*count + 1) * sizeof(char*));
+    if (!grown) return false;
+    *list = grown;
+
+    char *copy = malloc(len + 1);
+    if (!copy) return false;
+    memcpy(copy, value, len);
+    copy[len] = '\0';
+
+    (*list)[(*count)++] = copy;
+    return true;
+}
+
+bool criteria_add_skip_dirs(search_criteria_t *criteria, const char *names) {
+    if (!criteria || !names) return false;
+
+    while (*names) {
+        size_t len = strcspn(names, ",");
+        if (!criteria_append_string(&criteria->skip_dirs, &criteria->skip_dirs_count, names, len)) {
+            return false;
+        }
+        names += len;
+        if (*names == ',') names++;
+    }
+    return true;
+}
+
+bool criteria_add_skip_path(search_criteria_t *criteria, const char *path) {
+    if (!criteria || !path) return false;
+    return criteria_append_string(&criteria->skip_paths, &criteria->skip_paths_count, path, strlen(path));
+}
+
+bool criteria_add_boost_path(search_criteria_t *criteria, const char *path) {
+    if (!criteria || !path) return false;
+    return criteria_append_string(&criteria->boost_paths, &criteria->boost_paths_count, path, strlen(path));
+}
+
+bool criteria_load_skip_file(search_criteria_t *criteria, const char *file_path) {
+    if (!criteria || !file_path) return false;
+
+    char *text = platform_read_text_file(file_path, 1024 * 1024);
+    if (!text) return false;
+
+    bool ok = true;
+    char *line = text;
+    while (ok && *line) {
+        char *end = line + strcspn(line, "\r\n");
+        char next = *end;
+        *end = '\0';
+
+        while (isspace((unsigned char)*line)) line++;
+        if (*line && *line != '#') {
+            if (_strnicmp(line, "dir", 3) == 0 && isspace((unsigned char)line[3])) {
+                ok = criteria_add_skip_dirs(criteria, line + 4);
+            } else if (_strnicmp(line, "path", 4) == 0 && isspace((unsigned char)line[4])) {
+                ok = criteria_add_skip_path(criteria, line + 5);
+            } else {
+                ok = false;
+            }
+        }
+
+        if (!next) break;
+        line = end + 1;
+    }
+
+    free(text);
+    return ok;
+}
+
 void criteria_cleanup(search_criteria_t *criteria) {
     if (!criteria) return;
 
     free(criteria->root_path);
     free(criteria->search_term);
+    free(criteria->content_pattern);
+
+    for (size_t i = 0; i < criteria->root_count; i++) {
+        free(criteria->root_paths[i]);
+    }
+    free(criteria->root_paths);
+
+    for (size_t i = 0; i < criteria->skip_dirs_count; i++) {
+        free(criteria->skip_dirs[i]);
+    }
+    free(criteria->skip_dirs);
+    for (size_t i = 0; i < criteria->skip_paths_count; i++) {
+        free(criteria->skip_paths[i]);
+    }
+    free(criteria->skip_paths);
+    for (size_t i = 0; i < criteria->boost_paths_count; i++) {
+        free(criteria->boost_paths[i]);
+    }
+    free(criteria->boost_paths);
     free(criteria->file_type_filter);
 
     if (criteria->extensions) {
@@ -118,6 +322,7 @@ bool criteria_validate(const search_criteria_t *criteria) {
 
     if (!criteria->search_term) {
         if (!criteria->extensions_count &&
+            !criteria->content_pattern &&
             !criteria->has_min_size &&
             !criteria->has_max_size &&
             !criteria->has_exact_size &&
@@ -136,6 +341,14 @@ bool criteria_validate(const search_criteria_t *criteria) {
         return false;
     }
 
+    if (criteria->top_count > 0 && criteria->sort_mode != RQ_SORT_NONE) {
+        return false;
+    }
+
+    if (criteria->du_mode && criteria->find_duplicates) {
+        return false;
+    }
+
     if (criteria->has_after_time && criteria->has_before_time &&
         CompareFileTime(&criteria->after_time, &criteria->before_time) > 0) {
         return false;
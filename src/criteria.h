@@ -1,13 +1,30 @@
 #ifndef CRITERIA_H
 #define CRITERIA_H
 
+#include "cancel.h"
 #include <windows.h>
 #include <stdbool.h>
 #include <stdint.h>
 
+typedef enum {
+    RQ_SORT_NONE,
+    RQ_SORT_PATH
+} rq_sort_mode_t;
+
+typedef enum {
+    RQ_TOP_BY_SIZE,
+    RQ_TOP_BY_MTIME
+} rq_top_key_t;
+
 typedef struct search_criteria {
-    char *root_path;
+    char *root_path;                  // first root, kept for single-root callers
+    char **root_paths;
+    size_t root_count;
     char *search_term;
+    char *content_pattern;            // searched for inside files
+    bool content_regex;               // content_pattern is a regex (regex/dfa.h)
+    bool content_decompress;          // also search inside .gz/.xz (decompress.h)
+    bool search_archives;             // also match zip/tar members by name (archive.h)
     char **extensions;
     size_t extensions_count;
     uint64_t min_size;
@@ -19,6 +36,14 @@ typedef struct search_criteria {
     bool use_glob;
     bool use_regex;
     bool skip_common_dirs;
+    bool use_ignore_files;            // honour .gitignore/.ignore/.rqignore
+    char **skip_dirs;                 // extra names skipped at any depth
+    size_t skip_dirs_count;
+    char **skip_paths;                // extra paths relative to the volume root
+    size_t skip_paths_count;
+    bool shallow_first;               // queue directories by depth
+    char **boost_paths;               // searched before anything else
+    size_t boost_paths_count;
     bool preview_mode;
     size_t preview_lines;
     char *file_type_filter;
@@ -28,18 +53,46 @@ typedef struct search_criteria {
     bool has_after_time;
     bool has_before_time;
 
-    size_t max_threads;
+    size_t max_threads;               // fixed worker count; 0 = tune at runtime
+    size_t threads_min;               // bounds for runtime tuning; 0 = pool default
+    size_t threads_max;
     DWORD timeout_ms;
+    cancel_token_t *cancel;           // optional; cancelling it stops the search
+    uint32_t progress_interval_ms;    // how often progress callbacks run
     bool follow_symlinks;
     bool include_hidden;
     size_t max_results;
     size_t max_depth;
+    rq_sort_mode_t sort_mode;
+    size_t top_count;
+    rq_top_key_t top_by;
+    bool top_ascending;
+    bool du_mode;
+    size_t du_depth;
+    bool find_duplicates;
 } search_criteria_t;
 
 void criteria_init(search_criteria_t *criteria);
 
+bool criteria_add_root(search_criteria_t *criteria, const char *path);
+
+// Drops roots that duplicate or sit inside another root. Returns the number
+// of roots removed.
+size_t criteria_normalize_roots(search_criteria_t *criteria);
+
 bool criteria_parse_extensions(search_criteria_t *criteria, const char *extensions_str);
 
+// Adds to the skip lists; names are comma-separated.
+bool criteria_add_skip_dirs(search_criteria_t *criteria, const char *names);
+bool criteria_add_skip_path(search_criteria_t *criteria, const char *path);
+
+// Boost paths are absolute or relative to each root; adding one implies
+// shallow-first scheduling.
+bool criteria_add_boost_path(search_criteria_t *criteria, const char *path);
+
+// Reads "dir <names>" and "path <path>" lines; '#' starts a comment.
+bool criteria_load_skip_file(search_criteria_t *criteria, const char *file_path);
+
 void criteria_cleanup(search_criteria_t *criteria);
 
 bool criteria_validate(const search_criteria_t *criteria);
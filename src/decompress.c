@@ -0,0 +1,217 @@
+#include "decompress.h"
+#include "platform.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef RQ_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef RQ_WITH_LZMA
+#include <lzma.h>
+#endif
+
+// Compressed input is read this much at a time.
+#define DECOMPRESS_INPUT_SIZE (64u * 1024u)
+
+struct decompress_stream {
+    decompress_format_t format;
+    HANDLE file;
+    uint64_t offset;                  // of the next input read
+    unsigned char *input;
+    size_t input_length;              // bytes of the last input read
+    bool input_eof;
+    bool finished;
+#ifdef RQ_WITH_ZLIB
+    z_stream gzip;
+    size_t gzip_members;              // members completed
+#endif
+#ifdef RQ_WITH_LZMA
+    lzma_stream xz;
+#endif
+    bool decoder_ready;
+};
+
+bool decompress_supported(void) {
+#if defined(RQ_WITH_ZLIB) || defined(RQ_WITH_LZMA)
+    return true;
+#else
+    return false;
+#endif
+}
+
+decompress_format_t decompress_format_for_path(const char *path) {
+    const char *ext = path ? strrchr(path, '.') : NULL;
+    if (!ext) return DECOMPRESS_NONE;
+    ext++;
+
+#ifdef RQ_WITH_ZLIB
+    if (_stricmp(ext, "gz") == 0) return DECOMPRESS_GZIP;
+#endif
+#ifdef RQ_WITH_LZMA
+    if (_stricmp(ext, "xz") == 0) return DECOMPRESS_XZ;
+#endif
+    return DECOMPRESS_NONE;
+}
+
+static bool decompress_fill(decompress_stream_t *stream) {
+    size_t bytes_read = 0;
+    if (!platform_read_at(stream->file, stream->offset, stream->input, DECOMPRESS_INPUT_SIZE, &bytes_read)) {
+        return false;
+    }
+    stream->offset += bytes_read;
+    stream->input_length = bytes_read;
+    stream->input_eof = bytes_read < DECOMPRESS_INPUT_SIZE;
+    return true;
+}
+
+void decompress_close(decompress_stream_t *stream) {
+    if (!stream) return;
+
+    if (stream->decoder_ready) {
+#ifdef RQ_WITH_ZLIB
+        if (stream->format == DECOMPRESS_GZIP) inflateEnd(&stream->gzip);
+#endif
+#ifdef RQ_WITH_LZMA
+        if (stream->format == DECOMPRESS_XZ) lzma_end(&stream->xz);
+#endif
+    }
+    if (stream->file != INVALID_HANDLE_VALUE) {
+        CloseHandle(stream->file);
+    }
+    free(stream->input);
+    free(stream);
+}
+
+decompress_stream_t* decompress_open(const char *path, decompress_format_t format) {
+    if (!path || format == DECOMPRESS_NONE) return NULL;
+
+    decompress_stream_t *stream = calloc(1, sizeof(decompress_stream_t));
+    if (!stream) return NULL;
+    stream->format = format;
+    stream->file = platform_open_file(path, true);
+    stream->input = malloc(DECOMPRESS_INPUT_SIZE);
+    if (stream->file == INVALID_HANDLE_VALUE || !stream->input || !decompress_fill(stream)) {
+        decompress_close(stream);
+        return NULL;
+    }
+
+    // The first input read is handed to the decoder as it is.
+    static const unsigned char gzip_magic[] = { 0x1F, 0x8B };
+    static const unsigned char xz_magic[] = { 0xFD, '7', 'z', 'X', 'Z', 0x00 };
+    bool signed_ok = false;
+
+#ifdef RQ_WITH_ZLIB
+    if (format == DECOMPRESS_GZIP) {
+        signed_ok = stream->input_length >= sizeof(gzip_magic) &&
+                    memcmp(stream->input, gzip_magic, sizeof(gzip_magic)) == 0;
+        // 16 + MAX_WBITS: gzip framing only, with the largest window.
+        if (signed_ok && inflateInit2(&stream->gzip, 16 + MAX_WBITS) == Z_OK) {
+            stream->decoder_ready = true;
+            stream->gzip.next_in = stream->input;
+            stream->gzip.avail_in = (uInt)stream->input_length;
+        }
+    }
+#endif
+#ifdef RQ_WITH_LZMA
+    if (format == DECOMPRESS_XZ) {
+        signed_ok = stream->input_length >= sizeof(xz_magic) &&
+                    memcmp(stream->input, xz_magic, sizeof(xz_magic)) == 0;
+        lzma_stream init = LZMA_STREAM_INIT;
+        stream->xz = init;
+        if (signed_ok && lzma_stream_decoder(&stream->xz, UINT64_MAX, LZMA_CONCATENATED) == LZMA_OK) {
+            stream->decoder_ready = true;
+            stream->xz.next_in = stream->input;
+            stream->xz.avail_in = stream->input_length;
+        }
+    }
+#endif
+    (void)gzip_magic;
+    (void)xz_magic;
+
+    if (!signed_ok || !stream->decoder_ready) {
+        decompress_close(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+#ifdef RQ_WITH_ZLIB
+static bool decompress_gzip(decompress_stream_t *stream, unsigned char *data, size_t capacity, size_t *produced) {
+    z_stream *z = &stream->gzip;
+    z->next_out = data;
+    z->avail_out = (uInt)capacity;
+
+    while (z->avail_out > 0 && !stream->finished) {
+        if (z->avail_in == 0 && !stream->input_eof) {
+            if (!decompress_fill(stream)) return false;
+            z->next_in = stream->input;
+            z->avail_in = (uInt)stream->input_length;
+        }
+
+        int status = inflate(z, Z_NO_FLUSH);
+        if (status == Z_STREAM_END) {
+            // Rotated logs are often several members appended together.
+            stream->gzip_members++;
+            if (z->avail_in == 0 && !stream->input_eof) {
+                if (!decompress_fill(stream)) return false;
+                z->next_in = stream->input;
+                z->avail_in = (uInt)stream->input_length;
+            }
+            if (z->avail_in == 0 || inflateReset(z) != Z_OK) {
+                stream->finished = true;
+            }
+        } else if (status == Z_DATA_ERROR && stream->gzip_members > 0 && z->total_out == 0) {
+            stream->finished = true;      // padding after the last member
+        } else if (status == Z_BUF_ERROR && z->avail_in == 0 && stream->input_eof) {
+            stream->finished = true;      // truncated, e.g. still being written
+        } else if (status != Z_OK && status != Z_BUF_ERROR) {
+            return false;
+        }
+    }
+
+    *produced = capacity - z->avail_out;
+    return true;
+}
+#endif
+
+#ifdef RQ_WITH_LZMA
+static bool decompress_xz(decompress_stream_t *stream, unsigned char *data, size_t capacity, size_t *produced) {
+    lzma_stream *x = &stream->xz;
+    x->next_out = data;
+    x->avail_out = capacity;
+
+    while (x->avail_out > 0 && !stream->finished) {
+        if (x->avail_in == 0 && !stream->input_eof) {
+            if (!decompress_fill(stream)) return false;
+            x->next_in = stream->input;
+            x->avail_in = stream->input_length;
+        }
+
+        // LZMA_FINISH once all input is in, so concatenated streams end.
+        lzma_ret status = lzma_code(x, stream->input_eof ? LZMA_FINISH : LZMA_RUN);
+        if (status == LZMA_STREAM_END || (status == LZMA_BUF_ERROR && stream->input_eof)) {
+            stream->finished = true;
+        } else if (status != LZMA_OK && status != LZMA_BUF_ERROR) {
+            return false;
+        }
+    }
+
+    *produced = capacity - x->avail_out;
+    return true;
+}
+#endif
+
+bool decompress_read(decompress_stream_t *stream, unsigned char *data, size_t capacity, size_t *produced) {
+    *produced = 0;
+    if (!stream || !data) return false;
+    if (stream->finished || capacity == 0) return true;
+
+#ifdef RQ_WITH_ZLIB
+    if (stream->format == DECOMPRESS_GZIP) return decompress_gzip(stream, data, capacity, produced);
+#endif
+#ifdef RQ_WITH_LZMA
+    if (stream->format == DECOMPRESS_XZ) return decompress_xz(stream, data, capacity, produced);
+#endif
+    return false;
+}
@@ -0,0 +1,38 @@
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Streaming decompression of .gz files (zlib, built with RQ_WITH_ZLIB) and
+// .xz files (liblzma, built with RQ_WITH_LZMA). Output is produced in
+// order into the caller's buffer; nothing is written to disk, and memory
+// stays at one input buffer plus the decoder state per open stream.
+
+typedef enum {
+    DECOMPRESS_NONE,
+    DECOMPRESS_GZIP,
+    DECOMPRESS_XZ
+} decompress_format_t;
+
+// True if this build can read at least one format.
+bool decompress_supported(void);
+
+// The format a file's extension names, or DECOMPRESS_NONE if it names
+// none or this build cannot read it.
+decompress_format_t decompress_format_for_path(const char *path);
+
+typedef struct decompress_stream decompress_stream_t;
+
+// Returns NULL if the file cannot be read or does not start with the
+// format's signature.
+decompress_stream_t* decompress_open(const char *path, decompress_format_t format);
+
+// Fills data completely unless the decompressed stream ends first, so a
+// short read means the end. Concatenated members count as one stream, and
+// a truncated file ends where its data does. Returns false on corrupt data.
+bool decompress_read(decompress_stream_t *stream, unsigned char *data, size_t capacity, size_t *produced);
+
+void decompress_close(decompress_stream_t *stream);
+
+#endif
@@ -0,0 +1,305 @@
+#include "du.h"
+#include "platform.h"
+#include "pattern.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DU_LINK_SHARDS 64
+
+struct du_node {
+    du_node_t *parent;
+    char *path;                  // only kept for nodes that become rows
+    size_t depth;
+    atomic_size_t pending;       // own listing + unfinished children
+
+    uint64_t own_files;
+    uint64_t own_logical;
+    uint64_t own_allocated;
+    atomic_uint_fast64_t child_files;
+    atomic_uint_fast64_t child_logical;
+    atomic_uint_fast64_t child_allocated;
+
+    du_node_t *live_prev;
+    du_node_t *live_next;
+};
+
+typedef struct {
+    uint64_t file_index;
+    uint32_t volume_serial;
+    bool used;
+} du_link_slot_t;
+
+typedef struct {
+    CRITICAL_SECTION lock;
+    du_link_slot_t *slots;
+    size_t capacity;
+    size_t count;
+} du_link_shard_t;
+
+struct du_tree {
+    size_t display_depth;
+
+    CRITICAL_SECTION lock;       // guards rows and the live node list
+    du_row_t *rows;
+    size_t row_count;
+    size_t row_capacity;
+    du_node_t *live;
+
+    du_link_shard_t links[DU_LINK_SHARDS];
+};
+
+du_tree_t* du_tree_create(size_t display_depth) {
+    du_tree_t *tree = calloc(1, sizeof(du_tree_t));
+    if (!tree) return NULL;
+
+    tree->display_depth = display_depth;
+
+    if (!InitializeCriticalSectionAndSpinCount(&tree->lock, 4000)) {
+        free(tree);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < DU_LINK_SHARDS; i++) {
+        InitializeCriticalSectionAndSpinCount(&tree->links[i].lock, 4000);
+    }
+
+    return tree;
+}
+
+static du_node_t* du_node_create(du_tree_t *tree, du_node_t *parent, const char *path) {
+    du_node_t *node = calloc(1, sizeof(du_node_t));
+    if (!node) return NULL;
+
+    node->parent = parent;
+    node->depth = parent ? parent->depth + 1 : 0;
+    atomic_init(&node->pending, 1);
+    atomic_init(&node->child_files, 0);
+    atomic_init(&node->child_logical, 0);
+    atomic_init(&node->child_allocated, 0);
+
+    if (node->depth <= tree->display_depth) {
+        node->path = _strdup(path);
+        if (!node->path) {
+            free(node);
+            return NULL;
+        }
+    }
+
+    EnterCriticalSection(&tree->lock);
+    node->live_next = tree->live;
+    if (tree->live) tree->live->live_prev = node;
+    tree->live = node;
+    LeaveCriticalSection(&tree->lock);
+
+    return node;
+}
+
+du_node_t* du_tree_add_root(du_tree_t *tree, const char *root_path) {
+    if (!tree || !root_path) return NULL;
+    return du_node_create(tree, NULL, root_path);
+}
+
+du_node_t* du_node_add_child(du_tree_t *tree, du_node_t *parent, const char *path) {
+    if (!tree || !parent || !path) return NULL;
+
+    du_node_t *child = du_node_create(tree, parent, path);
+    if (child) {
+        atomic_fetch_add(&parent->pending, 1);
+    }
+    return child;
+}
+
+static uint64_t du_link_hash(uint32_t volume_serial, uint64_t file_index) {
+    uint64_t h = file_index ^ ((uint64_t)volume_serial << 32 | volume_serial);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static bool du_link_shard_grow(du_link_shard_t *shard) {
+    size_t new_capacity = shard->capacity ? shard->capacity * 2 : 256;
+    du_link_slot_t *slots = calloc(new_capacity, sizeof(du_link_slot_t));
+    if (!slots) return false;
+
+    for (size_t i = 0; i < shard->capacity; i++) {
+        if (!shard->slots[i].used) continue;
+        size_t j = (size_t)(du_link_hash(shard->slots[i].volume_serial, shard->slots[i].file_index) >> 6)
+                   & (new_capacity - 1);
+        while (slots[j].used) j = (j + 1) & (new_capacity - 1);
+        slots[j] = shard->slots[i];
+    }
+
+    free(shard->slots);
+    shard->slots = slots;
+    shard->capacity = new_capacity;
+    return true;
+}
+
+// Returns true the first time a (volume, file index) pair is seen.
+static bool du_link_insert(du_tree_t *tree, uint32_t volume_serial, uint64_t file_index) {
+    uint64_t h = du_link_hash(volume_serial, file_index);
+    du_link_shard_t *shard = &tree->links[h % DU_LINK_SHARDS];
+    bool inserted = false;
+
+    EnterCriticalSection(&shard->lock);
+    if ((shard->count + 1) * 10 > shard->capacity * 7 && !du_link_shard_grow(shard)) {
+        LeaveCriticalSection(&shard->lock);
+        return true;
+    }
+
+    size_t i = (size_t)(h >> 6) & (shard->capacity - 1);
+    while (shard->slots[i].used) {
+        if (shard->slots[i].file_index == file_index && shard->slots[i].volume_serial == volume_serial) {
+            break;
+        }
+        i = (i + 1) & (shard->capacity - 1);
+    }
+
+    if (!shard->slots[i].used) {
+        shard->slots[i].used = true;
+        shard->slots[i].file_index = file_index;
+        shard->slots[i].volume_serial = volume_serial;
+        shard->count++;
+        inserted = true;
+    }
+    LeaveCriticalSection(&shard->lock);
+
+    return inserted;
+}
+
+void du_node_add_file(du_tree_t *tree, du_node_t *node, const char *path, uint64_t logical_size) {
+    if (!tree || !node) return;
+
+    uint64_t allocated = logical_size;
+    platform_file_usage_t usage;
+    if (path && platform_get_file_usage(path, &usage)) {
+        allocated = usage.allocated_size;
+        // Only multiply-linked files go into the set, so it stays small.
+        if (usage.link_count > 1 && !du_link_insert(tree, usage.volume_serial, usage.file_index)) {
+            return;
+        }
+    }
+
+    node->own_files++;
+    node->own_logical += logical_size;
+    node->own_allocated += allocated;
+}
+
+static void du_tree_record(du_tree_t *tree, du_node_t *node, uint64_t files, uint64_t logical, uint64_t allocated) {
+    EnterCriticalSection(&tree->lock);
+
+    if (node->live_prev) node->live_prev->live_next = node->live_next;
+    else tree->live = node->live_next;
+    if (node->live_next) node->live_next->live_prev = node->live_prev;
+
+    if (node->path) {
+        if (tree->row_count == tree->row_capacity) {
+            size_t new_capacity = tree->row_capacity ? tree->row_capacity * 2 : 64;
+            du_row_t *grown = realloc(tree->rows, new_capacity * sizeof(du_row_t));
+            if (grown) {
+                tree->rows = grown;
+                tree->row_capacity = new_capacity;
+            }
+        }
+        if (tree->row_count < tree->row_capacity) {
+            du_row_t *row = &tree->rows[tree->row_count++];
+            row->path = node->path;
+            row->depth = node->depth;
+            row->files = files;
+            row->logical_size = logical;
+            row->allocated_size = allocated;
+            node->path = NULL;
+        }
+    }
+
+    LeaveCriticalSection(&tree->lock);
+
+    free(node->path);
+    free(node);
+}
+
+void du_node_complete(du_tree_t *tree, du_node_t *node) {
+    if (!tree) return;
+
+    // The last finisher of a subtree rolls it into its parent and continues
+    // upwards, so totals propagate without any thread waiting on another.
+    while (node && atomic_fetch_sub(&node->pending, 1) == 1) {
+        uint64_t files = node->own_files + atomic_load(&node->child_files);
+        uint64_t logical = node->own_logical + atomic_load(&node->child_logical);
+        uint64_t allocated = node->own_allocated + atomic_load(&node->child_allocated);
+        du_node_t *parent = node->parent;
+
+        if (parent) {
+            atomic_fetch_add(&parent->child_files, files);
+            atomic_fetch_add(&parent->child_logical, logical);
+            atomic_fetch_add(&parent->child_allocated, allocated);
+        }
+
+        du_tree_record(tree, node, files, logical, allocated);
+        node = parent;
+    }
+}
+
+// Orders paths component by component, so "a\b" sorts right after "a".
+static int du_row_compare(const void *a, const void *b) {
+    const unsigned char *pa = (const unsigned char*)((const du_row_t*)a)->path;
+    const unsigned char *pb = (const unsigned char*)((const du_row_t*)b)->path;
+
+    for (;; pa++, pb++) {
+        int ca = *pa == '\\' || *pa == '/' ? 1 : (unsigned char)g_ascii_tolower[*pa];
+        int cb = *pb == '\\' || *pb == '/' ? 1 : (unsigned char)g_ascii_tolower[*pb];
+        if (ca != cb) return ca - cb;
+        if (ca == 0) return 0;
+    }
+}
+
+du_row_t* du_tree_take_rows(du_tree_t *tree, size_t *count) {
+    if (!tree || !count) return NULL;
+
+    EnterCriticalSection(&tree->lock);
+    du_row_t *rows = tree->rows;
+    *count = tree->row_count;
+    tree->rows = NULL;
+    tree->row_count = 0;
+    tree->row_capacity = 0;
+    LeaveCriticalSection(&tree->lock);
+
+    if (rows && *count > 1) {
+        qsort(rows, *count, sizeof(du_row_t), du_row_compare);
+    }
+    return rows;
+}
+
+void du_free_rows(du_row_t *rows, size_t count) {
+    if (!rows) return;
+    for (size_t i = 0; i < count; i++) {
+        free(rows[i].path);
+    }
+    free(rows);
+}
+
+void du_tree_destroy(du_tree_t *tree) {
+    if (!tree) return;
+
+    // Nodes whose subtrees never finished (timeout or cancellation).
+    du_node_t *node = tree->live;
+    while (node) {
+        du_node_t *next = node->live_next;
+        free(node->path);
+        free(node);
+        node = next;
+    }
+
+    du_free_rows(tree->rows, tree->row_count);
+
+    for (size_t i = 0; i < DU_LINK_SHARDS; i++) {
+        free(tree->links[i].slots);
+        DeleteCriticalSection(&tree->links[i].lock);
+    }
+
+    DeleteCriticalSection(&tree->lock);
+    free(tree);
+}
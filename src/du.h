@@ -0,0 +1,43 @@
+#ifndef DU_H
+#define DU_H
+
+#include <windows.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+typedef struct du_tree du_tree_t;
+typedef struct du_node du_node_t;
+
+typedef struct {
+    char *path;
+    size_t depth;
+    uint64_t files;
+    uint64_t logical_size;
+    uint64_t allocated_size;
+} du_row_t;
+
+du_tree_t* du_tree_create(size_t display_depth);
+
+du_node_t* du_tree_add_root(du_tree_t *tree, const char *root_path);
+
+// Registers a subdirectory below a node that is still being listed. The
+// parent cannot complete before the child does.
+du_node_t* du_node_add_child(du_tree_t *tree, du_node_t *parent, const char *path);
+
+// Accounts one file to a node. Only valid from the thread listing the node.
+void du_node_add_file(du_tree_t *tree, du_node_t *node, const char *path, uint64_t logical_size);
+
+// Marks the node's own listing finished; totals roll up into the parents
+// as soon as whole subtrees are done.
+void du_node_complete(du_tree_t *tree, du_node_t *node);
+
+// Hands the collected rows (depth <= display_depth) to the caller, sorted
+// by path. Free them with du_free_rows().
+du_row_t* du_tree_take_rows(du_tree_t *tree, size_t *count);
+void du_free_rows(du_row_t *rows, size_t count);
+
+void du_tree_destroy(du_tree_t *tree);
+
+#endif
@@ -0,0 +1,488 @@
+#include "dupes.h"
+#include "hash128.h"
+#include "platform.h"
+#include "sync.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DUPES_PARTIAL_BYTES (64 * 1024)
+#define DUPES_BUFFER_SIZE (256 * 1024)
+
+typedef struct {
+    char *path;
+    uint64_t size;
+    uint64_t partial[2];
+    uint64_t full[2];
+    bool readable;
+} dupes_file_t;
+
+typedef struct dupes_list {
+    dupes_file_t *files;
+    size_t count;
+    size_t capacity;
+    struct dupes_list *next;
+} dupes_list_t;
+
+typedef struct dupes_io_queue dupes_io_queue_t;
+
+typedef struct {
+    dupes_io_queue_t *queue;
+    dupes_file_t *file;
+    size_t slot;
+    bool full;
+} dupes_task_t;
+
+// Fixed set of read buffers; a hash task owns one slot while it runs, so
+// both memory and the number of reads in flight are bounded by depth.
+struct dupes_io_queue {
+    sync_mutex_t lock;
+    sync_cond_t slot_freed;
+    unsigned char **buffers;
+    dupes_task_t *tasks;
+    size_t *free_slots;
+    size_t free_count;
+    size_t depth;
+    cancel_token_t *cancel;
+};
+
+struct dupes_set {
+    uint64_t id;
+    size_t io_depth;
+    CRITICAL_SECTION lock;
+    dupes_list_t *lists;
+    dupes_io_queue_t *queue;
+    dupes_file_t **files;
+    size_t file_count;
+    dupe_group_t *groups;
+    size_t group_count;
+};
+
+static _Thread_local struct {
+    uint64_t set_id;
+    dupes_list_t *list;
+} dupes_tls;
+
+static atomic_uint_fast64_t dupes_next_id = 1;
+
+dupes_set_t* dupes_create(size_t io_depth) {
+    dupes_set_t *set = calloc(1, sizeof(dupes_set_t));
+    if (!set) return NULL;
+
+    if (!InitializeCriticalSectionAndSpinCount(&set->lock, 4000)) {
+        free(set);
+        return NULL;
+    }
+
+    set->id = atomic_fetch_add(&dupes_next_id, 1);
+    set->io_depth = io_depth > 0 ? io_depth : 1;
+    return set;
+}
+
+bool dupes_add(dupes_set_t *set, const char *path, uint64_t size) {
+    if (!set || !path) return false;
+
+    dupes_list_t *list = dupes_tls.set_id == set->id ? dupes_tls.list : NULL;
+    if (!list) {
+        list = calloc(1, sizeof(dupes_list_t));
+        if (!list) return false;
+
+        EnterCriticalSection(&set->lock);
+        list->next = set->lists;
+        set->lists = list;
+        LeaveCriticalSection(&set->lock);
+
+        dupes_tls.set_id = set->id;
+        dupes_tls.list = list;
+    }
+
+    if (list->count == list->capacity) {
+        size_t new_capacity = list->capacity ? list->capacity * 2 : 256;
+        dupes_file_t *grown = realloc(list->files, new_capacity * sizeof(dupes_file_t));
+        if (!grown) return false;
+        list->files = grown;
+        list->capacity = new_capacity;
+    }
+
+    dupes_file_t *file = &list->files[list->count];
+    memset(file, 0, sizeof(*file));
+    file->path = _strdup(path);
+    if (!file->path) return false;
+    file->size = size;
+    file->readable = true;
+    list->count++;
+    return true;
+}
+
+static dupes_io_queue_t* dupes_io_queue_create(size_t depth, cancel_token_t *cancel) {
+    dupes_io_queue_t *queue = calloc(1, sizeof(dupes_io_queue_t));
+    if (!queue) return NULL;
+
+    queue->depth = depth;
+    queue->cancel = cancel;
+    queue->buffers = calloc(depth, sizeof(unsigned char*));
+    queue->tasks = calloc(depth, sizeof(dupes_task_t));
+    queue->free_slots = calloc(depth, sizeof(size_t));
+
+    if (!queue->buffers || !queue->tasks || !queue->free_slots) {
+        free(queue->buffers);
+        free(queue->tasks);
+        free(queue->free_slots);
+        free(queue);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < depth; i++) {
+        queue->buffers[i] = malloc(DUPES_BUFFER_SIZE);
+        if (queue->buffers[i]) {
+            queue->free_slots[queue->free_count++] = i;
+        }
+    }
+
+    bool ready = queue->free_count > 0 && sync_mutex_init(&queue->lock);
+    if (ready && !sync_cond_init(&queue->slot_freed)) {
+        sync_mutex_destroy(&queue->lock);
+        ready = false;
+    }
+    if (!ready) {
+        for (size_t i = 0; i < depth; i++) {
+            free(queue->buffers[i]);
+        }
+        free(queue->buffers);
+        free(queue->tasks);
+        free(queue->free_slots);
+        free(queue);
+        return NULL;
+    }
+    return queue;
+}
+
+static void dupes_io_queue_destroy(dupes_io_queue_t *queue) {
+    if (!queue) return;
+
+    for (size_t i = 0; i < queue->depth; i++) {
+        free(queue->buffers[i]);
+    }
+    sync_cond_destroy(&queue->slot_freed);
+    sync_mutex_destroy(&queue->lock);
+    free(queue->buffers);
+    free(queue->tasks);
+    free(queue->free_slots);
+    free(queue);
+}
+
+// Checks the deadline too, once per buffer, so a stopped search frees the
+// slot of a large file without waiting for it to be hashed.
+static bool dupes_hash_range(HANDLE file, uint64_t offset, uint64_t length,
+                             unsigned char *buffer, hash128_t *state, cancel_token_t *cancel) {
+    while (length > 0) {
+        if (cancel_token_check(cancel)) return false;
+
+        size_t want = length < DUPES_BUFFER_SIZE ? (size_t)length : DUPES_BUFFER_SIZE;
+        size_t got = 0;
+        if (!platform_read_at(file, offset, buffer, want, &got) || got == 0) {
+            return false;   // unreadable or shrank since it was listed
+        }
+
+        hash128_update(state, buffer, got);
+        offset += got;
+        length -= got;
+    }
+    return true;
+}
+
+static void dupes_hash_task(void *context, void *user_data) {
+    (void)context;
+
+    dupes_task_t *task = (dupes_task_t*)user_data;
+    dupes_io_queue_t *queue = task->queue;
+    dupes_file_t *file = task->file;
+    unsigned char *buffer = queue->buffers[task->slot];
+
+    HANDLE handle = platform_open_file(file->path, task->full);
+    if (handle == INVALID_HANDLE_VALUE) {
+        file->readable = false;
+    } else {
+        hash128_t state;
+        hash128_init(&state, file->size);
+        bool ok;
+
+        if (task->full || file->size <= 2 * DUPES_PARTIAL_BYTES) {
+            ok = dupes_hash_range(handle, 0, file->size, buffer, &state, queue->cancel);
+        } else {
+            ok = dupes_hash_range(handle, 0, DUPES_PARTIAL_BYTES, buffer, &state, queue->cancel) &&
+                 dupes_hash_range(handle, file->size - DUPES_PARTIAL_BYTES, DUPES_PARTIAL_BYTES,
+                                  buffer, &state, queue->cancel);
+        }
+        CloseHandle(handle);
+
+        file->readable = ok;
+        if (ok) {
+            hash128_final(&state, task->full ? file->full : file->partial);
+        }
+    }
+
+    sync_mutex_lock(&queue->lock);
+    queue->free_slots[queue->free_count++] = task->slot;
+    // Only the submitting thread waits; once stopped it waits for every
+    // slot rather than one.
+    if (cancel_token_cancelled(queue->cancel)) {
+        sync_cond_broadcast(&queue->slot_freed);
+    } else {
+        sync_cond_signal(&queue->slot_freed);
+    }
+    sync_mutex_unlock(&queue->lock);
+}
+
+// Also latches the deadline, which the hash tasks check as they read.
+static bool dupes_stopped(const dupes_io_queue_t *queue) {
+    return cancel_token_check(queue->cancel);
+}
+
+// Feeds every file through the pool, blocking while all buffers are in use.
+static bool dupes_run_stage(dupes_io_queue_t *queue, thread_pool_t *pool,
+                            dupes_file_t **files, size_t count, bool full) {
+    for (size_t i = 0; i < count && !dupes_stopped(queue); i++) {
+        // Every slot in use belongs to a running task, which frees it
+        // and signals, stopped or not.
+        sync_mutex_lock(&queue->lock);
+        while (queue->free_count == 0 && !dupes_stopped(queue)) {
+            sync_cond_wait(&queue->slot_freed, &queue->lock, SYNC_WAIT_INFINITE);
+        }
+        if (queue->free_count == 0) {
+            sync_mutex_unlock(&queue->lock);
+            break;
+        }
+        size_t slot = queue->free_slots[--queue->free_count];
+        sync_mutex_unlock(&queue->lock);
+
+        dupes_task_t *task = &queue->tasks[slot];
+        task->queue = queue;
+        task->file = files[i];
+        task->slot = slot;
+        task->full = full;
+
+        if (!pool || !thread_pool_submit(pool, dupes_hash_task, task)) {
+            dupes_hash_task(NULL, task);
+        }
+    }
+
+    size_t usable = 0;
+    for (size_t i = 0; i < queue->depth; i++) {
+        if (queue->buffers[i]) usable++;
+    }
+
+    // Stopped or not, every task is waited for: they give up at their next
+    // read once stopped, and none may outlive the set they write into.
+    sync_mutex_lock(&queue->lock);
+    while (queue->free_count < usable) {
+        sync_cond_wait(&queue->slot_freed, &queue->lock, SYNC_WAIT_INFINITE);
+    }
+    sync_mutex_unlock(&queue->lock);
+
+    return !dupes_stopped(queue);
+}
+
+static int dupes_compare_size(const void *a, const void *b) {
+    const dupes_file_t *fa = *(const dupes_file_t* const*)a;
+    const dupes_file_t *fb = *(const dupes_file_t* const*)b;
+    if (fa->size != fb->size) return fa->size > fb->size ? -1 : 1;
+    return 0;
+}
+
+static int dupes_compare_hash(const uint64_t *ha, const uint64_t *hb) {
+    if (ha[0] != hb[0]) return ha[0] < hb[0] ? -1 : 1;
+    if (ha[1] != hb[1]) return ha[1] < hb[1] ? -1 : 1;
+    return 0;
+}
+
+static int dupes_compare_partial(const void *a, const void *b) {
+    const dupes_file_t *fa = *(const dupes_file_t* const*)a;
+    const dupes_file_t *fb = *(const dupes_file_t* const*)b;
+    int cmp = dupes_compare_size(a, b);
+    if (cmp == 0) cmp = dupes_compare_hash(fa->partial, fb->partial);
+    return cmp != 0 ? cmp : strcmp(fa->path, fb->path);
+}
+
+static int dupes_compare_full(const void *a, const void *b) {
+    const dupes_file_t *fa = *(const dupes_file_t* const*)a;
+    const dupes_file_t *fb = *(const dupes_file_t* const*)b;
+    int cmp = dupes_compare_size(a, b);
+    if (cmp == 0) cmp = dupes_compare_hash(fa->full, fb->full);
+    return cmp != 0 ? cmp : strcmp(fa->path, fb->path);
+}
+
+static bool dupes_same_partial(const dupes_file_t *a, const dupes_file_t *b) {
+    return a->size == b->size && dupes_compare_hash(a->partial, b->partial) == 0;
+}
+
+static bool dupes_same_full(const dupes_file_t *a, const dupes_file_t *b) {
+    return a->size == b->size && dupes_compare_hash(a->full, b->full) == 0;
+}
+
+// Compacts files[] in place to the members of runs (of length >= 2) that
+// agree under `same`, dropping unreadable files. Returns the new count.
+static size_t dupes_keep_runs(dupes_file_t **files, size_t count,
+                              bool (*same)(const dupes_file_t*, const dupes_file_t*)) {
+    size_t kept = 0;
+    size_t i = 0;
+
+    while (i < count) {
+        if (!files[i]->readable) {
+            i++;
+            continue;
+        }
+        size_t j = i + 1;
+        while (j < count && files[j]->readable && same(files[i], files[j])) j++;
+        if (j - i >= 2) {
+            for (size_t k = i; k < j; k++) files[kept++] = files[k];
+        }
+        i = j;
+    }
+
+    return kept;
+}
+
+static bool dupes_emit_groups(dupes_set_t *set, dupes_file_t **files, size_t count) {
+    size_t i = 0;
+    while (i < count) {
+        size_t j = i + 1;
+        while (j < count && dupes_same_full(files[i], files[j])) j++;
+
+        if (set->group_count % 64 == 0) {
+            dupe_group_t *grown = realloc(set->groups, (set->group_count + 64) * sizeof(dupe_group_t));
+            if (!grown) return false;
+            set->groups = grown;
+        }
+
+        dupe_group_t *group = &set->groups[set->group_count];
+        group->paths = malloc((j - i) * sizeof(char*));
+        if (!group->paths) return false;
+
+        group->size = files[i]->size;
+        group->hash[0] = files[i]->full[0];
+        group->hash[1] = files[i]->full[1];
+        group->count = j - i;
+        for (size_t k = i; k < j; k++) {
+            group->paths[k - i] = files[k]->path;
+            files[k]->path = NULL;
+        }
+        set->group_count++;
+        i = j;
+    }
+    return true;
+}
+
+bool dupes_resolve(dupes_set_t *set, thread_pool_t *pool, cancel_token_t *cancel) {
+    if (!set) return false;
+
+    size_t total = 0;
+    for (dupes_list_t *list = set->lists; list; list = list->next) {
+        total += list->count;
+    }
+    if (total < 2) return true;
+
+    set->files = malloc(total * sizeof(dupes_file_t*));
+    if (!set->files) return false;
+
+    for (dupes_list_t *list = set->lists; list; list = list->next) {
+        for (size_t i = 0; i < list->count; i++) {
+            set->files[set->file_count++] = &list->files[i];
+        }
+    }
+
+    // Stage 1: only sizes shared by two or more files can hold duplicates.
+    qsort(set->files, total, sizeof(dupes_file_t*), dupes_compare_size);
+    size_t candidates = 0;
+    for (size_t i = 0; i < total;) {
+        size_t j = i + 1;
+        while (j < total && set->files[j]->size == set->files[i]->size) j++;
+        if (j - i >= 2) {
+            for (size_t k = i; k < j; k++) set->files[candidates++] = set->files[k];
+        }
+        i = j;
+    }
+    if (candidates == 0) return true;
+
+    set->queue = dupes_io_queue_create(set->io_depth, cancel);
+    if (!set->queue) return false;
+
+    // Stage 2: first and last 64KB. Small files are read whole here, so
+    // their partial hash already is the full hash.
+    if (!dupes_run_stage(set->queue, pool, set->files, candidates, false)) return false;
+
+    qsort(set->files, candidates, sizeof(dupes_file_t*), dupes_compare_partial);
+    candidates = dupes_keep_runs(set->files, candidates, dupes_same_partial);
+
+    size_t need_full = 0;
+    for (size_t i = 0; i < candidates; i++) {
+        dupes_file_t *file = set->files[i];
+        if (file->size <= 2 * DUPES_PARTIAL_BYTES) {
+            file->full[0] = file->partial[0];
+            file->full[1] = file->partial[1];
+        } else {
+            need_full++;
+        }
+    }
+
+    // Stage 3: stream whole files, but only for ties that remain.
+    if (need_full > 0) {
+        dupes_file_t **large = malloc(need_full * sizeof(dupes_file_t*));
+        if (!large) return false;
+
+        size_t n = 0;
+        for (size_t i = 0; i < candidates; i++) {
+            if (set->files[i]->size > 2 * DUPES_PARTIAL_BYTES) large[n++] = set->files[i];
+        }
+
+        bool ok = dupes_run_stage(set->queue, pool, large, need_full, true);
+        free(large);
+        if (!ok) return false;
+    }
+
+    qsort(set->files, candidates, sizeof(dupes_file_t*), dupes_compare_full);
+    candidates = dupes_keep_runs(set->files, candidates, dupes_same_full);
+
+    return dupes_emit_groups(set, set->files, candidates);
+}
+
+dupe_group_t* dupes_take_groups(dupes_set_t *set, size_t *count) {
+    if (!set || !count) return NULL;
+
+    dupe_group_t *groups = set->groups;
+    *count = set->group_count;
+    set->groups = NULL;
+    set->group_count = 0;
+    return groups;
+}
+
+void dupes_free_groups(dupe_group_t *groups, size_t count) {
+    if (!groups) return;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < groups[i].count; j++) {
+            free(groups[i].paths[j]);
+        }
+        free(groups[i].paths);
+    }
+    free(groups);
+}
+
+void dupes_destroy(dupes_set_t *set) {
+    if (!set) return;
+
+    dupes_list_t *list = set->lists;
+    while (list) {
+        dupes_list_t *next = list->next;
+        for (size_t i = 0; i < list->count; i++) {
+            free(list->files[i].path);
+        }
+        free(list->files);
+        free(list);
+        list = next;
+    }
+
+    dupes_free_groups(set->groups, set->group_count);
+    dupes_io_queue_destroy(set->queue);
+    free(set->files);
+    DeleteCriticalSection(&set->lock);
+    free(set);
+}
@@ -0,0 +1,35 @@
+#ifndef DUPES_H
+#define DUPES_H
+
+#include "thread_pool.h"
+#include "cancel.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+typedef struct dupes_set dupes_set_t;
+
+typedef struct {
+    uint64_t size;
+    uint64_t hash[2];
+    char **paths;
+    size_t count;
+} dupe_group_t;
+
+dupes_set_t* dupes_create(size_t io_depth);
+
+// Records a candidate file. Lock-free: every thread appends to its own list.
+bool dupes_add(dupes_set_t *set, const char *path, uint64_t size);
+
+// Runs size -> partial hash -> full hash over the candidates, hashing on the
+// pool with at most io_depth reads in flight. Returns false if cancelled.
+bool dupes_resolve(dupes_set_t *set, thread_pool_t *pool, cancel_token_t *cancel);
+
+// Hands the duplicate groups to the caller, largest files first.
+dupe_group_t* dupes_take_groups(dupes_set_t *set, size_t *count);
+void dupes_free_groups(dupe_group_t *groups, size_t count);
+
+void dupes_destroy(dupes_set_t *set);
+
+#endif
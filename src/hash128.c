@@ -0,0 +1,114 @@
+#include "hash128.h"
+#include <string.h>
+
+#define HASH128_C1 0x87c37b91114253d5ULL
+#define HASH128_C2 0x4cf5ad432745937fULL
+
+static inline uint64_t hash128_rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t hash128_fmix(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+static inline uint64_t hash128_load(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));   // little-endian on every target we build for
+    return v;
+}
+
+static inline void hash128_block(hash128_t *state, const unsigned char *block) {
+    uint64_t k1 = hash128_load(block);
+    uint64_t k2 = hash128_load(block + 8);
+
+    k1 *= HASH128_C1; k1 = hash128_rotl(k1, 31); k1 *= HASH128_C2; state->h1 ^= k1;
+    state->h1 = hash128_rotl(state->h1, 27); state->h1 += state->h2; state->h1 = state->h1 * 5 + 0x52dce729;
+
+    k2 *= HASH128_C2; k2 = hash128_rotl(k2, 33); k2 *= HASH128_C1; state->h2 ^= k2;
+    state->h2 = hash128_rotl(state->h2, 31); state->h2 += state->h1; state->h2 = state->h2 * 5 + 0x38495ab5;
+}
+
+void hash128_init(hash128_t *state, uint64_t seed) {
+    state->h1 = seed;
+    state->h2 = seed;
+    state->length = 0;
+    state->tail_len = 0;
+}
+
+void hash128_update(hash128_t *state, const void *data, size_t length) {
+    const unsigned char *p = (const unsigned char*)data;
+    state->length += length;
+
+    if (state->tail_len > 0) {
+        size_t take = 16 - state->tail_len;
+        if (take > length) take = length;
+        memcpy(state->tail + state->tail_len, p, take);
+        state->tail_len += take;
+        p += take;
+        length -= take;
+
+        if (state->tail_len < 16) return;
+        hash128_block(state, state->tail);
+        state->tail_len = 0;
+    }
+
+    while (length >= 16) {
+        hash128_block(state, p);
+        p += 16;
+        length -= 16;
+    }
+
+    memcpy(state->tail, p, length);
+    state->tail_len = length;
+}
+
+void hash128_final(hash128_t *state, uint64_t out[2]) {
+    const unsigned char *tail = state->tail;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+
+    switch (state->tail_len) {
+        case 15: k2 ^= (uint64_t)tail[14] << 48; /* fall through */
+        case 14: k2 ^= (uint64_t)tail[13] << 40; /* fall through */
+        case 13: k2 ^= (uint64_t)tail[12] << 32; /* fall through */
+        case 12: k2 ^= (uint64_t)tail[11] << 24; /* fall through */
+        case 11: k2 ^= (uint64_t)tail[10] << 16; /* fall through */
+        case 10: k2 ^= (uint64_t)tail[9] << 8;   /* fall through */
+        case 9:
+            k2 ^= (uint64_t)tail[8];
+            k2 *= HASH128_C2; k2 = hash128_rotl(k2, 33); k2 *= HASH128_C1; state->h2 ^= k2;
+            /* fall through */
+        case 8: k1 ^= (uint64_t)tail[7] << 56;   /* fall through */
+        case 7: k1 ^= (uint64_t)tail[6] << 48;   /* fall through */
+        case 6: k1 ^= (uint64_t)tail[5] << 40;   /* fall through */
+        case 5: k1 ^= (uint64_t)tail[4] << 32;   /* fall through */
+        case 4: k1 ^= (uint64_t)tail[3] << 24;   /* fall through */
+        case 3: k1 ^= (uint64_t)tail[2] << 16;   /* fall through */
+        case 2: k1 ^= (uint64_t)tail[1] << 8;    /* fall through */
+        case 1:
+            k1 ^= (uint64_t)tail[0];
+            k1 *= HASH128_C1; k1 = hash128_rotl(k1, 31); k1 *= HASH128_C2; state->h1 ^= k1;
+            break;
+        default:
+            break;
+    }
+
+    uint64_t h1 = state->h1 ^ state->length;
+    uint64_t h2 = state->h2 ^ state->length;
+
+    h1 += h2;
+    h2 += h1;
+    h1 = hash128_fmix(h1);
+    h2 = hash128_fmix(h2);
+    h1 += h2;
+    h2 += h1;
+
+    out[0] = h1;
+    out[1] = h2;
+}
@@ -0,0 +1,21 @@
+#ifndef HASH128_H
+#define HASH128_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming MurmurHash3 x64-128: fast, non-cryptographic, and identical to
+// the one-shot digest no matter how the input is split across updates.
+typedef struct {
+    uint64_t h1;
+    uint64_t h2;
+    uint64_t length;
+    unsigned char tail[16];
+    size_t tail_len;
+} hash128_t;
+
+void hash128_init(hash128_t *state, uint64_t seed);
+void hash128_update(hash128_t *state, const void *data, size_t length);
+void hash128_final(hash128_t *state, uint64_t out[2]);
+
+#endif
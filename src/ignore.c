@@ -0,0 +1,341 @@
+#include "ignore.h"
+#include "platform.h"
+#include "pattern.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IGNORE_FILE_MAX_BYTES (1024 * 1024)
+#define IGNORE_IS_SEP(c) ((c) == '\\' || (c) == '/')
+
+// Later files take precedence over earlier ones in the same directory.
+static const char* ignore_file_names[] = { ".gitignore", ".ignore", ".rqignore" };
+
+typedef enum {
+    IGNORE_RULE_NAME_LITERAL,   // "build"      compared against the entry name
+    IGNORE_RULE_NAME_SUFFIX,    // "*.obj"      tail of the entry name
+    IGNORE_RULE_NAME_GLOB,      // "foo?.t[xy]" glob on the entry name
+    IGNORE_RULE_PATH_GLOB       // "/out", "docs/**/*.pdf" glob on the relative path
+} ignore_rule_kind_t;
+
+typedef struct {
+    ignore_rule_kind_t kind;
+    const char *pattern;
+    size_t pattern_len;
+    bool negated;
+    bool directory_only;
+} ignore_rule_t;
+
+struct ignore_stack {
+    ignore_stack_t *parent;
+    atomic_size_t refs;
+    char *base_dir;
+    size_t base_len;
+    ignore_rule_t *rules;
+    size_t rule_count;
+    size_t rule_capacity;
+    char **texts;
+    size_t text_count;
+};
+
+static bool ignore_class_matches(const char **pattern, char c) {
+    const char *p = *pattern + 1;
+    bool negate = false;
+    if (*p == '!' || *p == '^') {
+        negate = true;
+        p++;
+    }
+
+    bool matched = false;
+    char lc = g_ascii_tolower[(unsigned char)c];
+    bool first = true;
+    while (*p && (first || *p != ']')) {
+        char lo = g_ascii_tolower[(unsigned char)*p];
+        char hi = lo;
+        if (p[1] == '-' && p[2] && p[2] != ']') {
+            hi = g_ascii_tolower[(unsigned char)p[2]];
+            p += 2;
+        }
+        if (lc >= lo && lc <= hi) {
+            matched = true;
+        }
+        p++;
+        first = false;
+    }
+
+    if (*p != ']') {
+        // Unterminated class: the '[' is a literal.
+        if (c != '[') return false;
+        *pattern += 1;
+        return true;
+    }
+    *pattern = p + 1;
+    return matched != negate;
+}
+
+// Gitignore glob: '*' and '?' stay within one path component, "**" spans
+// components. Both separators are accepted in the text; the pattern uses '/'.
+static bool ignore_glob(const char *p, const char *t) {
+    while (*p) {
+        if (p[0] == '*' && p[1] == '*') {
+            p += 2;
+            while (*p == '*') p++;
+            if (*p == '/') {
+                p++;
+                for (;;) {
+                    if (ignore_glob(p, t)) return true;
+                    while (*t && !IGNORE_IS_SEP(*t)) t++;
+                    if (!*t) return false;
+                    t++;
+                }
+            }
+            for (;; t++) {
+                if (ignore_glob(p, t)) return true;
+                if (!*t) return false;
+            }
+        }
+
+        switch (*p) {
+        case '*':
+            p++;
+            for (;; t++) {
+                if (ignore_glob(p, t)) return true;
+                if (!*t || IGNORE_IS_SEP(*t)) return false;
+            }
+        case '?':
+            if (!*t || IGNORE_IS_SEP(*t)) return false;
+            p++;
+            t++;
+            break;
+        case '[':
+            if (!*t || IGNORE_IS_SEP(*t) || !ignore_class_matches(&p, *t)) return false;
+            t++;
+            break;
+        case '/':
+            if (!IGNORE_IS_SEP(*t)) return false;
+            p++;
+            t++;
+            break;
+        default:
+            if (*p == '\\' && p[1]) p++;
+            if (g_ascii_tolower[(unsigned char)*p] != g_ascii_tolower[(unsigned char)*t]) return false;
+            p++;
+            t++;
+            break;
+        }
+    }
+    return *t == '\0';
+}
+
+static bool ignore_has_meta(const char *s, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == '*' || s[i] == '?' || s[i] == '[' || s[i] == '\\') return true;
+    }
+    return false;
+}
+
+static bool ignore_add_rule(ignore_stack_t *level, char *line) {
+    size_t len = strlen(line);
+
+    // Trailing blanks are dropped unless escaped.
+    while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t') &&
+           !(len > 1 && line[len - 2] == '\\')) {
+        line[--len] = '\0';
+    }
+    if (len == 0 || line[0] == '#') return true;
+
+    ignore_rule_t rule = {0};
+    if (line[0] == '!') {
+        rule.negated = true;
+        line++;
+        len--;
+    } else if (line[0] == '\\' && (line[1] == '!' || line[1] == '#')) {
+        line++;
+        len--;
+    }
+
+    if (len > 0 && line[len - 1] == '/') {
+        rule.directory_only = true;
+        line[--len] = '\0';
+    }
+
+    bool anchored = false;
+    if (len > 0 && line[0] == '/') {
+        anchored = true;
+        line++;
+        len--;
+    } else if (len > 3 && strncmp(line, "**/", 3) == 0 && !memchr(line + 3, '/', len - 3)) {
+        // "**/name" matches at any depth, same as a bare name.
+        line += 3;
+        len -= 3;
+    }
+    if (len == 0) return true;
+
+    if (anchored || memchr(line, '/', len)) {
+        rule.kind = IGNORE_RULE_PATH_GLOB;
+    } else if (!ignore_has_meta(line, len)) {
+        rule.kind = IGNORE_RULE_NAME_LITERAL;
+    } else if (line[0] == '*' && len > 1 && !ignore_has_meta(line + 1, len - 1)) {
+        rule.kind = IGNORE_RULE_NAME_SUFFIX;
+        line++;
+        len--;
+    } else {
+        rule.kind = IGNORE_RULE_NAME_GLOB;
+    }
+    rule.pattern = line;
+    rule.pattern_len = len;
+
+    if (level->rule_count == level->rule_capacity) {
+        size_t new_capacity = level->rule_capacity ? level->rule_capacity * 2 : 16;
+        ignore_rule_t *grown = realloc(level->rules, new_capacity * sizeof(ignore_rule_t));
+        if (!grown) return false;
+        level->rules = grown;
+        level->rule_capacity = new_capacity;
+    }
+    level->rules[level->rule_count++] = rule;
+    return true;
+}
+
+// Parses one ignore file in place; the rules point into its text.
+static bool ignore_load_file(ignore_stack_t *level, char *text) {
+    char *line = text;
+    // A UTF-8 byte order mark would otherwise become part of the first rule.
+    if ((unsigned char)line[0] == 0xEF && (unsigned char)line[1] == 0xBB && (unsigned char)line[2] == 0xBF) {
+        line += 3;
+    }
+
+    while (*line) {
+        char *end = line + strcspn(line, "\r\n");
+        char next = *end;
+        *end = '\0';
+        if (!ignore_add_rule(level, line)) return false;
+        if (!next) break;
+        line = end + 1;
+    }
+    return true;
+}
+
+static void ignore_level_free(ignore_stack_t *level) {
+    for (size_t i = 0; i < level->text_count; i++) {
+        free(level->texts[i]);
+    }
+    free(level->texts);
+    free(level->rules);
+    free(level->base_dir);
+    free(level);
+}
+
+unsigned ignore_file_bit(const char *name) {
+    if (!name || name[0] != '.') return 0;
+
+    for (size_t i = 0; i < sizeof(ignore_file_names) / sizeof(ignore_file_names[0]); i++) {
+        if (_stricmp(name, ignore_file_names[i]) == 0) return 1u << i;
+    }
+    return 0;
+}
+
+ignore_stack_t* ignore_stack_push(ignore_stack_t *parent, const char *dir_path, unsigned present) {
+    if (!dir_path || !(present & IGNORE_FILES_ALL)) return ignore_stack_retain(parent);
+
+    ignore_stack_t *level = NULL;
+    size_t file_count = sizeof(ignore_file_names) / sizeof(ignore_file_names[0]);
+
+    for (size_t i = 0; i < file_count; i++) {
+        if (!(present & (1u << i))) continue;
+
+        char file_path[MAX_PATH * 2];
+        if (FAILED(StringCchCopyA(file_path, sizeof(file_path), dir_path)) ||
+            FAILED(StringCchCatA(file_path, sizeof(file_path), "\\")) ||
+            FAILED(StringCchCatA(file_path, sizeof(file_path), ignore_file_names[i]))) {
+            continue;
+        }
+
+        char *text = platform_read_text_file(file_path, IGNORE_FILE_MAX_BYTES);
+        if (!text) continue;
+
+        if (!level) {
+            level = calloc(1, sizeof(ignore_stack_t));
+            if (level) {
+                level->base_dir = _strdup(dir_path);
+                level->texts = calloc(file_count, sizeof(char*));
+            }
+            if (!level || !level->base_dir || !level->texts) {
+                free(text);
+                if (level) ignore_level_free(level);
+                return ignore_stack_retain(parent);
+            }
+            level->base_len = strlen(dir_path);
+        }
+
+        level->texts[level->text_count++] = text;
+        if (!ignore_load_file(level, text)) {
+            ignore_level_free(level);
+            return ignore_stack_retain(parent);
+        }
+    }
+
+    if (!level || level->rule_count == 0) {
+        if (level) ignore_level_free(level);
+        return ignore_stack_retain(parent);
+    }
+
+    level->parent = ignore_stack_retain(parent);
+    atomic_init(&level->refs, 1);
+    return level;
+}
+
+ignore_stack_t* ignore_stack_retain(ignore_stack_t *stack) {
+    if (stack) {
+        atomic_fetch_add_explicit(&stack->refs, 1, memory_order_relaxed);
+    }
+    return stack;
+}
+
+void ignore_stack_release(ignore_stack_t *stack) {
+    while (stack) {
+        if (atomic_fetch_sub_explicit(&stack->refs, 1, memory_order_acq_rel) != 1) {
+            return;
+        }
+        ignore_stack_t *parent = stack->parent;
+        ignore_level_free(stack);
+        stack = parent;
+    }
+}
+
+static bool ignore_rule_matches(const ignore_rule_t *rule, const char *relative,
+                                const char *name, size_t name_len) {
+    switch (rule->kind) {
+    case IGNORE_RULE_NAME_LITERAL:
+        return name_len == rule->pattern_len && _stricmp(name, rule->pattern) == 0;
+    case IGNORE_RULE_NAME_SUFFIX:
+        return name_len >= rule->pattern_len &&
+               _stricmp(name + name_len - rule->pattern_len, rule->pattern) == 0;
+    case IGNORE_RULE_NAME_GLOB:
+        return ignore_glob(rule->pattern, name);
+    case IGNORE_RULE_PATH_GLOB:
+        return ignore_glob(rule->pattern, relative);
+    }
+    return false;
+}
+
+bool ignore_stack_matches(const ignore_stack_t *stack, const char *full_path,
+                          const char *name, bool is_directory) {
+    if (!stack || !full_path || !name) return false;
+
+    size_t name_len = strlen(name);
+    size_t path_len = strlen(full_path);
+
+    for (const ignore_stack_t *level = stack; level; level = level->parent) {
+        if (path_len <= level->base_len + 1) continue;
+        const char *relative = full_path + level->base_len + 1;
+
+        for (size_t i = level->rule_count; i-- > 0;) {
+            const ignore_rule_t *rule = &level->rules[i];
+            if (rule->directory_only && !is_directory) continue;
+            if (ignore_rule_matches(rule, relative, name, name_len)) {
+                return !rule->negated;
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,33 @@
+#ifndef IGNORE_H
+#define IGNORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// One level per directory that declares .gitignore, .ignore or .rqignore
+// rules. Levels are reference counted and shared by every subdirectory
+// below them, so descending never copies rules.
+typedef struct ignore_stack ignore_stack_t;
+
+// Every ignore file, for callers that have not listed the directory.
+#define IGNORE_FILES_ALL 0x7u
+
+// The bit for name if it is one of the ignore files, else 0. Collecting
+// these while listing a directory spares opening files that are not there.
+unsigned ignore_file_bit(const char *name);
+
+// Loads the ignore files of dir_path whose bits are set in present on top
+// of parent. Returns a new reference the caller must release: either a
+// fresh level, or parent itself when the directory declares nothing. May
+// return NULL only if parent is NULL.
+ignore_stack_t* ignore_stack_push(ignore_stack_t *parent, const char *dir_path, unsigned present);
+
+ignore_stack_t* ignore_stack_retain(ignore_stack_t *stack);
+void ignore_stack_release(ignore_stack_t *stack);
+
+// full_path must lie below the directory the stack was pushed for. The
+// deepest level, and within a file the last rule, that matches decides.
+bool ignore_stack_matches(const ignore_stack_t *stack, const char *full_path,
+                          const char *name, bool is_directory);
+
+#endif
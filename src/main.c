@@ -2,21 +2,39 @@
 #include "cli.h"
 #include "utils.h"
 #include "criteria.h"
+#include "output.h"
+#include "preview_pool.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
 #include <stdatomic.h>
 
+#include "archive.c"
+#include "cancel.c"
 #include "cli.c"
+#include "content.c"
 #include "criteria.c"
+#include "decompress.c"
+#include "du.c"
+#include "dupes.c"
+#include "hash128.c"
+#include "ignore.c"
+#include "order.c"
 #include "output.c"
 #include "pattern.c"
+#include "pipeline.c"
 #include "platform.c"
 #include "preview.c"
+#include "preview_pool.c"
+#include "regex/dfa.c"
 #include "regex/re.c"
 #include "regex/regex.c"
 #include "search.c"
+#include "skiplist.c"
+#include "slab.c"
+#include "sync.c"
 #include "thread_pool.c"
+#include "topk.c"
 #include "utils.c"
 #include "version.c"
 
@@ -30,6 +48,7 @@ typedef struct {
     int progress_shown;
     size_t last_processed;
     size_t last_results;
+    preview_pool_t *preview_pool;
 } streamed_state_t;
 
 static bool streamed_result_callback(const search_result_t *result, void *user_data) {
@@ -37,22 +56,26 @@ static bool streamed_result_callback(const search_result_t *result, void *user_d
     if (state->options->json_output) {
         return true;
     }
-    if (state->criteria->preview_mode) {
-        rq_file_type_t type = detect_file_type(result->path);
-        printf("%s\n", result->path);
-        if (type == RQ_FILE_TYPE_TEXT) {
-            preview_text_file(result->path, state->criteria->preview_lines, stdout);
-        } else {
-            preview_file_summary(result->path, stdout);
-        }
-        printf("\n");
-    } else {
-        printf("%s\n", result->path);
+    // Results stay in the list until cleanup, after the pool has emitted
+    // every one it was handed.
+    if (state->preview_pool &&
+        preview_pool_submit(state->preview_pool, result->path, result->size, result)) {
+        return true;
     }
+    output_result_lines(stdout, result);
     fflush(stdout);
     return true;
 }
 
+// Runs on a preview thread, one result at a time, in the order found.
+static void streamed_preview_emit(const void *item, const char *text, size_t length, void *user_data) {
+    (void)user_data;
+    output_result_lines(stdout, (const search_result_t*)item);
+    fwrite(text, 1, length, stdout);
+    printf("\n");
+    fflush(stdout);
+}
+
 static bool streamed_progress_callback(size_t processed_files, size_t queued_dirs, size_t total_results, void *user_data) {
     (void)queued_dirs;
     streamed_state_t *state = (streamed_state_t*)user_data;
@@ -68,6 +91,64 @@ static bool streamed_progress_callback(size_t processed_files, size_t queued_dir
     return true;
 }
 
+static void print_search_stats(void) {
+    search_timing_t timing;
+    if (get_last_search_timing(&timing) && timing.result_count > 0) {
+        fprintf(stderr, "First result after %.1f ms, 90%% of %zu results after %.1f ms (%.1f ms total)\n",
+                timing.first_result_ns / 1e6, timing.result_count,
+                timing.ninety_percent_ns / 1e6, timing.elapsed_ns / 1e6);
+    }
+
+    pipeline_stats_t pipeline;
+    if (get_last_search_pipeline_stats(&pipeline)) {
+        fprintf(stderr, "Read queue: peak %zu of %zu, mean %.1f, %llu full waits\n",
+                pipeline.read_queue_peak, pipeline.read_queue_capacity, pipeline.read_queue_mean,
+                (unsigned long long)pipeline.submit_waits);
+        fprintf(stderr, "Match queue: peak %zu of %zu, mean %.1f, %llu buffer waits (%llu files, %.1f MB read ahead)\n",
+                pipeline.match_queue_peak, pipeline.match_queue_capacity, pipeline.match_queue_mean,
+                (unsigned long long)pipeline.buffer_waits, (unsigned long long)pipeline.files_read,
+                pipeline.bytes_read / (1024.0 * 1024.0));
+    }
+
+    thread_pool_stats_t stats;
+    if (!get_last_search_thread_stats(&stats)) return;
+
+    fprintf(stderr, "Work items: %zu completed, %zu stolen\n",
+            stats.completed_work_items, stats.stolen_work_items);
+    if (stats.min_concurrency == stats.max_concurrency) {
+        fprintf(stderr, "Workers: %zu (fixed)\n", stats.concurrency);
+    } else {
+        fprintf(stderr, "Workers: %zu chosen (peak %zu, range %zu-%zu, %zu adjustments)\n",
+                stats.concurrency, stats.peak_concurrency,
+                stats.min_concurrency, stats.max_concurrency, stats.concurrency_changes);
+    }
+}
+
+// The first Ctrl+C stops the search and lets what was found be written out;
+// a second one stops the writing too; a third gets the default handling.
+static cancel_token_t output_cancel;
+static cancel_token_t search_cancel;  // child of output_cancel
+static atomic_int interrupt_count;
+
+#define EXIT_INTERRUPTED 130
+
+static BOOL WINAPI console_ctrl_handler(DWORD ctrl_type) {
+    if (ctrl_type != CTRL_C_EVENT && ctrl_type != CTRL_BREAK_EVENT) {
+        return FALSE;
+    }
+
+    switch (atomic_fetch_add(&interrupt_count, 1)) {
+        case 0:
+            cancel_token_cancel(&search_cancel, CANCEL_REASON_REQUESTED);
+            return TRUE;
+        case 1:
+            cancel_token_cancel(&output_cancel, CANCEL_REASON_REQUESTED);
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
 int main(int argc, char *argv[]) {
     search_criteria_t criteria;
     cli_options_t options = {0};
@@ -99,16 +180,34 @@ int main(int argc, char *argv[]) {
         goto cleanup;
     }
 
-    platform_dir_iter_t *test_dir = platform_opendir(criteria.root_path);
-    if (!test_dir) {
-        fprintf(stderr, "Error: Root directory '%s' does not exist or cannot be accessed\n", criteria.root_path);
-        exit_code = 1;
-        goto cleanup;
+    cancel_token_init(&output_cancel, NULL, CANCEL_NO_DEADLINE);
+    cancel_token_init(&search_cancel, &output_cancel, CANCEL_NO_DEADLINE);
+    criteria.cancel = &search_cancel;
+    options.cancel = &output_cancel;
+    SetConsoleCtrlHandler(console_ctrl_handler, TRUE);
+
+    for (size_t i = 0; i < criteria.root_count; i++) {
+        platform_dir_iter_t *test_dir = platform_opendir(criteria.root_paths[i]);
+        if (!test_dir) {
+            fprintf(stderr, "Error: Root directory '%s' does not exist or cannot be accessed\n",
+                    criteria.root_paths[i]);
+            exit_code = 1;
+            goto cleanup;
+        }
+        platform_closedir(test_dir);
     }
-    platform_closedir(test_dir);
 
-    fprintf(stderr, "Searching in '%s' for '%s'...\n", criteria.root_path, criteria.search_term ? criteria.search_term : "*");
+    size_t skipped_roots = criteria_normalize_roots(&criteria);
+    if (skipped_roots > 0) {
+        fprintf(stderr, "Note: skipped %zu root(s) already covered by another root\n", skipped_roots);
+    }
 
+    char roots_label[MAX_PATH + 32];
+    if (criteria.root_count == 1) {
+        snprintf(roots_label, sizeof(roots_label), "'%s'", criteria.root_path);
+    } else {
+        snprintf(roots_label, sizeof(roots_label), "%zu roots", criteria.root_count);
+    }
 
     streamed_state_t stream_state = {0};
     stream_state.options = &options;
@@ -118,16 +217,98 @@ int main(int argc, char *argv[]) {
     stream_state.last_processed = 0;
     stream_state.last_results = 0;
 
+    if (criteria.du_mode) {
+        fprintf(stderr, "Summarizing disk usage of %s...\n", roots_label);
+
+        du_row_t *rows = NULL;
+        size_t row_count = 0;
+        int du_result = search_disk_usage(&criteria, &rows, &row_count,
+                                          streamed_progress_callback, &stream_state);
+
+        if (du_result == -2) {
+            fprintf(stderr,
+                    "Warning: Search timed out after %" PRIu64 " ms, totals are partial\n",
+                    (uint64_t)criteria.timeout_ms);
+        } else if (du_result == -3) {
+            fprintf(stderr, "Warning: Search interrupted, totals are partial\n");
+            exit_code = EXIT_INTERRUPTED;
+        } else if (du_result != 0) {
+            fprintf(stderr, "Error: Search operation failed\n");
+            exit_code = 1;
+        }
+
+        if (du_result != -1 && output_du_results(rows, row_count, &options) != 0) {
+            fprintf(stderr, "Error: Failed to output results\n");
+            exit_code = 1;
+        }
+
+        du_free_rows(rows, row_count);
+        goto cleanup;
+    }
+
+    if (criteria.find_duplicates) {
+        fprintf(stderr, "Looking for duplicate files in %s...\n", roots_label);
+
+        dupe_group_t *groups = NULL;
+        size_t group_count = 0;
+        int dupes_result = search_duplicates(&criteria, &groups, &group_count,
+                                             streamed_progress_callback, &stream_state);
+
+        if (dupes_result == -2) {
+            fprintf(stderr,
+                    "Warning: Search timed out after %" PRIu64 " ms\n",
+                    (uint64_t)criteria.timeout_ms);
+        } else if (dupes_result == -3) {
+            fprintf(stderr, "Warning: Search interrupted\n");
+            exit_code = EXIT_INTERRUPTED;
+        } else if (dupes_result != 0) {
+            fprintf(stderr, "Error: Search operation failed\n");
+            exit_code = 1;
+        } else if (output_dupes_results(groups, group_count, &options) != 0) {
+            fprintf(stderr, "Error: Failed to output results\n");
+            exit_code = 1;
+        } else if (group_count == 0) {
+            fprintf(stderr, "No duplicates found.\n");
+        }
+
+        dupes_free_groups(groups, group_count);
+        goto cleanup;
+    }
+
+    fprintf(stderr, "Searching in %s for '%s'...\n", roots_label, criteria.search_term ? criteria.search_term : "*");
+
+    // Previews are read and printed off the search workers, in the order
+    // the results were found. They stop with the output, not the search,
+    // so what a first Ctrl+C leaves queued is still printed.
+    if (criteria.preview_mode && !options.json_output) {
+        preview_pool_config_t preview_config = {0};
+        preview_config.max_lines = criteria.preview_lines;
+        preview_config.emit = streamed_preview_emit;
+        preview_config.cancel = options.cancel;
+        stream_state.preview_pool = preview_pool_create(&preview_config);
+        if (!stream_state.preview_pool) {
+            fprintf(stderr, "Error: Failed to start preview threads\n");
+            exit_code = 1;
+            goto cleanup;
+        }
+    }
+
     int search_result = search_files_advanced(&criteria, &results, &result_count,
         streamed_result_callback, &stream_state,
         streamed_progress_callback, &stream_state);
 
+    preview_pool_destroy(stream_state.preview_pool);
+    stream_state.preview_pool = NULL;
+
     fprintf(stderr, "\n");
 
     if (search_result == -2) {
         fprintf(stderr,
                 "Warning: Search timed out after %" PRIu64 " ms\n",
                 (uint64_t)criteria.timeout_ms);
+    } else if (search_result == -3) {
+        fprintf(stderr, "Warning: Search interrupted, results are partial\n");
+        exit_code = EXIT_INTERRUPTED;
     } else if (search_result != 0) {
         fprintf(stderr, "Error: Search operation failed\n");
         exit_code = 1;
@@ -149,6 +330,12 @@ int main(int argc, char *argv[]) {
     }
 
 cleanup:
+    if (cancel_token_cancelled(&output_cancel)) {
+        exit_code = EXIT_INTERRUPTED;
+    }
+    if (options.show_stats) {
+        print_search_stats();
+    }
     free_search_results(results);
     criteria_cleanup(&criteria);
     return exit_code;
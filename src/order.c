@@ -0,0 +1,260 @@
+#include "order.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char *path;
+    size_t name_offset;
+    uint64_t size;
+    FILETIME mtime;
+    content_match_t *matches;
+    order_node_t *child;   // NULL for files
+} order_entry_t;
+
+struct order_node {
+    const char *root;
+    order_entry_t *entries;
+    size_t count;
+    size_t capacity;
+    atomic_bool ready;
+};
+
+typedef struct {
+    order_node_t *node;
+    size_t next;
+} order_frame_t;
+
+struct order_tree {
+    order_node_t *top;
+    order_frame_t *stack;
+    size_t stack_depth;
+    size_t stack_capacity;
+    CRITICAL_SECTION lock;
+    atomic_size_t drain_requests;
+    bool stopped;
+
+    order_emit_callback_t emit;
+    void *emit_user_data;
+};
+
+static order_node_t* order_node_create(void) {
+    order_node_t *node = calloc(1, sizeof(order_node_t));
+    if (node) {
+        atomic_init(&node->ready, false);
+    }
+    return node;
+}
+
+static void order_node_free(order_node_t *node, size_t from) {
+    if (!node) return;
+
+    for (size_t i = from; i < node->count; i++) {
+        free(node->entries[i].path);
+        content_free_matches(node->entries[i].matches);
+        order_node_free(node->entries[i].child, 0);
+    }
+    free(node->entries);
+    free(node);
+}
+
+static order_entry_t* order_node_append(order_node_t *node, const char *path, size_t name_offset) {
+    if (node->count == node->capacity) {
+        size_t new_capacity = node->capacity ? node->capacity * 2 : 16;
+        order_entry_t *grown = realloc(node->entries, new_capacity * sizeof(order_entry_t));
+        if (!grown) return NULL;
+        node->entries = grown;
+        node->capacity = new_capacity;
+    }
+
+    order_entry_t *entry = &node->entries[node->count];
+    memset(entry, 0, sizeof(*entry));
+    entry->path = _strdup(path);
+    if (!entry->path) return NULL;
+    entry->name_offset = name_offset;
+    node->count++;
+    return entry;
+}
+
+static int order_entry_compare(const void *a, const void *b) {
+    const order_entry_t *ea = (const order_entry_t*)a;
+    const order_entry_t *eb = (const order_entry_t*)b;
+    const char *na = ea->path + ea->name_offset;
+    const char *nb = eb->path + eb->name_offset;
+
+    int cmp = _stricmp(na, nb);
+    return cmp != 0 ? cmp : strcmp(na, nb);
+}
+
+static bool order_stack_push(order_tree_t *tree, order_node_t *node) {
+    if (tree->stack_depth == tree->stack_capacity) {
+        size_t new_capacity = tree->stack_capacity ? tree->stack_capacity * 2 : 64;
+        order_frame_t *grown = realloc(tree->stack, new_capacity * sizeof(order_frame_t));
+        if (!grown) return false;
+        tree->stack = grown;
+        tree->stack_capacity = new_capacity;
+    }
+
+    tree->stack[tree->stack_depth].node = node;
+    tree->stack[tree->stack_depth].next = 0;
+    tree->stack_depth++;
+    return true;
+}
+
+order_tree_t* order_tree_create(order_emit_callback_t emit, void *user_data) {
+    if (!emit) return NULL;
+
+    order_tree_t *tree = calloc(1, sizeof(order_tree_t));
+    if (!tree) return NULL;
+
+    tree->emit = emit;
+    tree->emit_user_data = user_data;
+    atomic_init(&tree->drain_requests, 0);
+
+    tree->top = order_node_create();
+    if (!tree->top || !order_stack_push(tree, tree->top)) {
+        free(tree->top);
+        free(tree);
+        return NULL;
+    }
+
+    if (!InitializeCriticalSectionAndSpinCount(&tree->lock, 4000)) {
+        free(tree->stack);
+        free(tree->top);
+        free(tree);
+        return NULL;
+    }
+
+    return tree;
+}
+
+order_node_t* order_tree_add_root(order_tree_t *tree, const char *root_path) {
+    if (!tree || !root_path) return NULL;
+
+    order_node_t *node = order_node_add_dir(tree->top, root_path, 0);
+    if (node) {
+        node->root = root_path;
+    }
+    return node;
+}
+
+void order_tree_seal_roots(order_tree_t *tree) {
+    if (!tree) return;
+    // Roots keep the order they were given in, so the top node is not sorted.
+    atomic_store_explicit(&tree->top->ready, true, memory_order_release);
+}
+
+bool order_node_add_file(order_node_t *node, const char *path, size_t name_offset,
+                         uint64_t size, FILETIME mtime, content_match_t *matches) {
+    if (!node || !path) {
+        content_free_matches(matches);
+        return false;
+    }
+
+    order_entry_t *entry = order_node_append(node, path, name_offset);
+    if (!entry) {
+        content_free_matches(matches);
+        return false;
+    }
+
+    entry->size = size;
+    entry->mtime = mtime;
+    entry->matches = matches;
+    return true;
+}
+
+order_node_t* order_node_add_dir(order_node_t *node, const char *path, size_t name_offset) {
+    if (!node || !path) return NULL;
+
+    order_node_t *child = order_node_create();
+    if (!child) return NULL;
+
+    order_entry_t *entry = order_node_append(node, path, name_offset);
+    if (!entry) {
+        free(child);
+        return NULL;
+    }
+
+    child->root = node->root;
+    entry->child = child;
+    return child;
+}
+
+// Walks the tree in DFS order from the cursor, emitting files and freeing
+// nodes once fully consumed. Stops at the first directory still being listed.
+static void order_tree_advance(order_tree_t *tree) {
+    while (tree->stack_depth > 0 && !tree->stopped) {
+        order_frame_t *frame = &tree->stack[tree->stack_depth - 1];
+        order_node_t *node = frame->node;
+
+        if (!atomic_load_explicit(&node->ready, memory_order_acquire)) {
+            return;
+        }
+
+        if (frame->next == node->count) {
+            tree->stack_depth--;
+            order_node_free(node, node->count);
+            continue;
+        }
+
+        order_entry_t *entry = &node->entries[frame->next++];
+        if (entry->child) {
+            order_node_t *child = entry->child;
+            free(entry->path);
+            entry->path = NULL;
+            entry->child = NULL;
+            if (!order_stack_push(tree, child)) {
+                order_node_free(child, 0);
+            }
+            continue;
+        }
+
+        content_match_t *matches = entry->matches;
+        entry->matches = NULL;
+        if (!tree->emit(node->root, entry->path, entry->size, entry->mtime, matches, tree->emit_user_data)) {
+            tree->stopped = true;
+        }
+        free(entry->path);
+        entry->path = NULL;
+    }
+}
+
+void order_tree_publish(order_tree_t *tree, order_node_t *node) {
+    if (!tree || !node) return;
+
+    if (node->count > 1) {
+        qsort(node->entries, node->count, sizeof(order_entry_t), order_entry_compare);
+    }
+    atomic_store_explicit(&node->ready, true, memory_order_release);
+
+    // Only one thread drains at a time; a busy drainer picks up our request
+    // before it releases the lock, so nothing is left stranded.
+    atomic_fetch_add(&tree->drain_requests, 1);
+    for (;;) {
+        if (!TryEnterCriticalSection(&tree->lock)) {
+            return;
+        }
+        while (atomic_exchange(&tree->drain_requests, 0) > 0) {
+            order_tree_advance(tree);
+        }
+        LeaveCriticalSection(&tree->lock);
+
+        if (atomic_load(&tree->drain_requests) == 0) {
+            return;
+        }
+    }
+}
+
+void order_tree_destroy(order_tree_t *tree) {
+    if (!tree) return;
+
+    // Every frame's node is already detached from its parent entry, so each
+    // one is released exactly once together with its unvisited children.
+    while (tree->stack_depth > 0) {
+        order_frame_t *frame = &tree->stack[--tree->stack_depth];
+        order_node_free(frame->node, frame->next);
+    }
+
+    DeleteCriticalSection(&tree->lock);
+    free(tree->stack);
+    free(tree);
+}
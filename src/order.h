@@ -0,0 +1,39 @@
+#ifndef ORDER_H
+#define ORDER_H
+
+#include "content.h"
+#include <windows.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+typedef struct order_tree order_tree_t;
+typedef struct order_node order_node_t;
+
+// Takes ownership of matches, which may be NULL.
+typedef bool (*order_emit_callback_t)(const char *root, const char *path, uint64_t size, FILETIME mtime,
+                                      content_match_t *matches, void *user_data);
+
+order_tree_t* order_tree_create(order_emit_callback_t emit, void *user_data);
+
+// Adds a search root below the synthetic top node. Roots are emitted in the
+// order they are added; order_tree_seal_roots() must follow the last one.
+// root_path must outlive the tree: it is handed back to the emit callback.
+order_node_t* order_tree_add_root(order_tree_t *tree, const char *root_path);
+void order_tree_seal_roots(order_tree_t *tree);
+
+// Builder calls, only valid from the thread that owns the unpublished node.
+// A file's matching lines, if any, are kept until it is emitted; the node
+// takes ownership of them even when adding fails.
+bool order_node_add_file(order_node_t *node, const char *path, size_t name_offset,
+                         uint64_t size, FILETIME mtime, content_match_t *matches);
+order_node_t* order_node_add_dir(order_node_t *node, const char *path, size_t name_offset);
+
+// Sorts the node's entries, marks it complete and releases whatever prefix
+// of the tree is now contiguous.
+void order_tree_publish(order_tree_t *tree, order_node_t *node);
+
+void order_tree_destroy(order_tree_t *tree);
+
+#endif
@@ -33,7 +33,24 @@ static void json_escape_string(FILE *fp, const char *str) {
     fputc('"', fp);
 }
 
-static void output_json_format(FILE *fp, const search_result_t *results, size_t count) {
+// Each element is preceded by its separator rather than followed by one,
+// so an array cut short by cancellation is still well-formed. The last
+// element written is left without its line break; closing adds it.
+static void json_begin_element(FILE *fp, bool first) {
+    fputs(first ? "    {\n" : ",\n    {\n", fp);
+}
+
+// Closes a document whose array may have been cut short by cancellation.
+static void json_close_document(FILE *fp, bool any, bool interrupted) {
+    if (any) {
+        fputs("\n", fp);
+    }
+    fputs(interrupted ? "  ],\n  \"interrupted\": true\n" : "  ]\n", fp);
+    fputs("}\n", fp);
+}
+
+static void output_json_format(FILE *fp, const search_result_t *results, size_t count,
+                               const cancel_token_t *cancel) {
     fputs("{\n", fp);
     fputs("  \"type\": \"search\",\n", fp);
     fprintf(fp, "  \"version\": \"%s\",\n", RQ_VERSION_STRING);
@@ -41,41 +58,67 @@ static void output_json_format(FILE *fp, const search_result_t *results, size_t
     fputs("  \"results\": [\n", fp);
 
     const search_result_t *current = results;
+    bool interrupted = false;
 
     while (current) {
-        fputs("    {\n", fp);
+        if (cancel_token_cancelled(cancel)) {
+            interrupted = true;
+            break;
+        }
+
+        json_begin_element(fp, current == results);
 
         fputs("      \"path\": ", fp);
         json_escape_string(fp, current->path);
         fputs(",\n", fp);
 
+        fputs("      \"root\": ", fp);
+        json_escape_string(fp, current->root);
+        fputs(",\n", fp);
+
         fprintf(fp, "      \"size\": %" PRIu64 ",\n", current->size);
 
         char time_buffer[64];
         format_filetime_iso(&current->mtime, time_buffer, sizeof(time_buffer));
         fputs("      \"modified\": ", fp);
         json_escape_string(fp, time_buffer);
-        fputs("\n", fp);
 
-        fputs("    }", fp);
-        if (current->next) {
-            fputs(",", fp);
+        if (current->matches) {
+            fputs(",\n      \"matches\": [\n", fp);
+            for (const content_match_t *match = current->matches; match; match = match->next) {
+                fprintf(fp, "        { \"line\": %" PRIu64 ", \"text\": ", match->line);
+                json_escape_string(fp, match->text);
+                fputs(match->next ? " },\n" : " }\n", fp);
+            }
+            fputs("      ]", fp);
         }
         fputs("\n", fp);
 
+        fputs("    }", fp);
+
         current = current->next;
     }
 
-    fputs("  ]\n", fp);
-    fputs("}\n", fp);
+    json_close_document(fp, current != results, interrupted);
 }
 
-static void output_text_format(FILE *fp, const search_result_t *results, size_t count) {
+void output_result_lines(FILE *fp, const search_result_t *result) {
+    if (!result->matches) {
+        fputs(result->path, fp);
+        fputc('\n', fp);
+        return;
+    }
+    for (const content_match_t *match = result->matches; match; match = match->next) {
+        fprintf(fp, "%s:%" PRIu64 ":%s\n", result->path, match->line, match->text);
+    }
+}
+
+static void output_text_format(FILE *fp, const search_result_t *results, size_t count,
+                               const cancel_token_t *cancel) {
     const search_result_t *current = results;
 
-    while (current) {
-        fputs(current->path, fp);
-        fputc('\n', fp);
+    while (current && !cancel_token_cancelled(cancel)) {
+        output_result_lines(fp, current);
         current = current->next;
     }
 
@@ -84,41 +127,43 @@ static void output_text_format(FILE *fp, const search_result_t *results, size_t
     }
 }
 
-int output_search_results(FILE *fp, const search_result_t *results, size_t count, output_format_t format) {
+int output_search_results(FILE *fp, const search_result_t *results, size_t count, output_format_t format,
+                          const cancel_token_t *cancel) {
     if (!fp) return -1;
 
     switch (format) {
         case OUTPUT_FORMAT_JSON:
-            output_json_format(fp, results, count);
+            output_json_format(fp, results, count, cancel);
             break;
         case OUTPUT_FORMAT_TEXT:
         default:
-            output_text_format(fp, results, count);
+            output_text_format(fp, results, count, cancel);
             break;
     }
 
     return 0;
 }
 
-static void output_text_format_with_preview(FILE *fp, const search_result_t *results, size_t count, const search_criteria_t *criteria) {
+static void output_text_format_with_preview(FILE *fp, const search_result_t *results, size_t count,
+                                            const search_criteria_t *criteria, const cancel_token_t *cancel) {
     const search_result_t *current = results;
+    preview_buffer_t buffer = {0};
+    preview_text_t text = {0};
 
-    while (current) {
-        fputs(current->path, fp);
-        fputc('\n', fp);
+    while (current && !cancel_token_cancelled(cancel)) {
+        output_result_lines(fp, current);
 
         if (criteria && criteria->preview_mode) {
-            rq_file_type_t type = detect_file_type(current->path);
-            if (type == RQ_FILE_TYPE_TEXT) {
-                preview_text_file(current->path, criteria->preview_lines, fp);
-            } else {
-                preview_file_summary(current->path, fp);
-            }
+            text.length = 0;
+            preview_file(current->path, current->size, criteria->preview_lines, &buffer, &text, cancel);
+            fwrite(text.data ? text.data : "", 1, text.length, fp);
             fputc('\n', fp);
         }
 
         current = current->next;
     }
+    preview_buffer_free(&buffer);
+    preview_text_free(&text);
 
     if (count > 0) {
         fprintf(stderr, "Found %zu files.\n", count);
@@ -126,16 +171,136 @@ static void output_text_format_with_preview(FILE *fp, const search_result_t *res
 }
 
 int output_search_results_with_preview(FILE *fp, const search_result_t *results, size_t count,
-                                       const search_criteria_t *criteria, output_format_t format) {
+                                       const search_criteria_t *criteria, output_format_t format,
+                                       const cancel_token_t *cancel) {
+    if (!fp) return -1;
+
+    switch (format) {
+        case OUTPUT_FORMAT_JSON:
+            output_json_format(fp, results, count, cancel);
+            break;
+        case OUTPUT_FORMAT_TEXT:
+        default:
+            output_text_format_with_preview(fp, results, count, criteria, cancel);
+            break;
+    }
+
+    return 0;
+}
+
+
+static void output_disk_usage_json(FILE *fp, const du_row_t *rows, size_t count,
+                                   const cancel_token_t *cancel) {
+    fputs("{\n", fp);
+    fputs("  \"type\": \"du\",\n", fp);
+    fprintf(fp, "  \"version\": \"%s\",\n", RQ_VERSION_STRING);
+    fprintf(fp, "  \"count\": %zu,\n", count);
+    fputs("  \"directories\": [\n", fp);
+
+    size_t i = 0;
+    for (; i < count && !cancel_token_cancelled(cancel); i++) {
+        json_begin_element(fp, i == 0);
+        fputs("      \"path\": ", fp);
+        json_escape_string(fp, rows[i].path);
+        fputs(",\n", fp);
+        fprintf(fp, "      \"depth\": %zu,\n", rows[i].depth);
+        fprintf(fp, "      \"files\": %" PRIu64 ",\n", rows[i].files);
+        fprintf(fp, "      \"size\": %" PRIu64 ",\n", rows[i].logical_size);
+        fprintf(fp, "      \"allocated\": %" PRIu64 "\n", rows[i].allocated_size);
+        fputs("    }", fp);
+    }
+
+    json_close_document(fp, i > 0, i < count);
+}
+
+static void output_disk_usage_text(FILE *fp, const du_row_t *rows, size_t count,
+                                   const cancel_token_t *cancel) {
+    fprintf(fp, "%12s  %10s  %10s  %s\n", "Files", "Size", "Allocated", "Path");
+
+    for (size_t i = 0; i < count && !cancel_token_cancelled(cancel); i++) {
+        char logical[32];
+        char allocated[32];
+        format_size_human(rows[i].logical_size, logical, sizeof(logical));
+        format_size_human(rows[i].allocated_size, allocated, sizeof(allocated));
+        fprintf(fp, "%12" PRIu64 "  %10s  %10s  %s\n", rows[i].files, logical, allocated, rows[i].path);
+    }
+}
+
+int output_disk_usage(FILE *fp, const du_row_t *rows, size_t count, output_format_t format,
+                      const cancel_token_t *cancel) {
+    if (!fp) return -1;
+
+    switch (format) {
+        case OUTPUT_FORMAT_JSON:
+            output_disk_usage_json(fp, rows, count, cancel);
+            break;
+        case OUTPUT_FORMAT_TEXT:
+        default:
+            output_disk_usage_text(fp, rows, count, cancel);
+            break;
+    }
+
+    return 0;
+}
+
+static void output_duplicates_json(FILE *fp, const dupe_group_t *groups, size_t count,
+                                   const cancel_token_t *cancel) {
+    fputs("{\n", fp);
+    fputs("  \"type\": \"duplicates\",\n", fp);
+    fprintf(fp, "  \"version\": \"%s\",\n", RQ_VERSION_STRING);
+    fprintf(fp, "  \"count\": %zu,\n", count);
+    fputs("  \"groups\": [\n", fp);
+
+    size_t i = 0;
+    for (; i < count && !cancel_token_cancelled(cancel); i++) {
+        json_begin_element(fp, i == 0);
+        fprintf(fp, "      \"size\": %" PRIu64 ",\n", groups[i].size);
+        fprintf(fp, "      \"hash\": \"%016" PRIx64 "%016" PRIx64 "\",\n", groups[i].hash[0], groups[i].hash[1]);
+        fputs("      \"files\": [", fp);
+        for (size_t j = 0; j < groups[i].count; j++) {
+            fputs(j == 0 ? "\n        " : ",\n        ", fp);
+            json_escape_string(fp, groups[i].paths[j]);
+        }
+        fputs("\n      ]\n", fp);
+        fputs("    }", fp);
+    }
+
+    json_close_document(fp, i > 0, i < count);
+}
+
+static void output_duplicates_text(FILE *fp, const dupe_group_t *groups, size_t count,
+                                   const cancel_token_t *cancel) {
+    uint64_t reclaimable = 0;
+
+    for (size_t i = 0; i < count && !cancel_token_cancelled(cancel); i++) {
+        char size_str[32];
+        format_size_human(groups[i].size, size_str, sizeof(size_str));
+        fprintf(fp, "%zu files, %s each:\n", groups[i].count, size_str);
+        for (size_t j = 0; j < groups[i].count; j++) {
+            fprintf(fp, "  %s\n", groups[i].paths[j]);
+        }
+        fputc('\n', fp);
+        reclaimable += groups[i].size * (groups[i].count - 1);
+    }
+
+    if (count > 0) {
+        char size_str[32];
+        format_size_human(reclaimable, size_str, sizeof(size_str));
+        fprintf(stderr, "Found %zu duplicate groups, %s reclaimable.\n", count, size_str);
+    }
+}
+
+int output_duplicates(FILE *fp, const dupe_group_t *groups, size_t count, output_format_t format,
+                      const cancel_token_t *cancel) {
     if (!fp) return -1;
 
     switch (format) {
         case OUTPUT_FORMAT_JSON:
-            output_json_format(fp, results, count);
+            output_duplicates_json(fp, groups, count, cancel);
             break;
         case OUTPUT_FORMAT_TEXT:
         default:
-            output_text_format_with_preview(fp, results, count, criteria);
+            output_duplicates_text(fp, groups, count, cancel);
             break;
     }
 
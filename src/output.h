@@ -3,6 +3,9 @@
 
 #include "search.h"
 #include "criteria.h"
+#include "du.h"
+#include "dupes.h"
+#include "cancel.h"
 #include <stdio.h>
 
 typedef enum {
@@ -10,9 +13,23 @@ typedef enum {
     OUTPUT_FORMAT_JSON
 } output_format_t;
 
-int output_search_results(FILE *fp, const search_result_t *results, size_t count, output_format_t format);
+// Writes the result's path, or one grep-style path:line:text line per
+// content match.
+void output_result_lines(FILE *fp, const search_result_t *result);
+
+// Every writer stops early once cancel fires; JSON documents are still
+// closed, with "interrupted": true.
+int output_search_results(FILE *fp, const search_result_t *results, size_t count, output_format_t format,
+                          const cancel_token_t *cancel);
 
 int output_search_results_with_preview(FILE *fp, const search_result_t *results, size_t count,
-                                       const search_criteria_t *criteria, output_format_t format);
+                                       const search_criteria_t *criteria, output_format_t format,
+                                       const cancel_token_t *cancel);
+
+int output_disk_usage(FILE *fp, const du_row_t *rows, size_t count, output_format_t format,
+                      const cancel_token_t *cancel);
+
+int output_duplicates(FILE *fp, const dupe_group_t *groups, size_t count, output_format_t format,
+                      const cancel_token_t *cancel);
 
 #endif
@@ -0,0 +1,351 @@
+#include "pipeline.h"
+#include "platform.h"
+#include "sync.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PIPELINE_DEFAULT_IO_THREADS 2
+#define PIPELINE_READS_PER_BUFFER 8
+
+typedef struct {
+    const char *path;
+    uint64_t size;
+    void *job;
+} pipeline_item_t;
+
+typedef struct {
+    pipeline_item_t item;
+    size_t buffer;
+    size_t length;
+    bool ok;
+} pipeline_filled_t;
+
+typedef struct {
+    pipeline_t *pipeline;
+    size_t index;
+    sync_thread_t thread;
+    bool started;
+} pipeline_thread_t;
+
+struct pipeline {
+    pipeline_config_t config;
+
+    sync_mutex_t lock;
+    sync_cond_t read_ready;           // an item was queued, or finishing began
+    sync_cond_t read_space;           // an item left the read queue
+    sync_cond_t buffer_freed;
+    sync_cond_t match_ready;          // a buffer was filled, or the last reader quit
+
+    pipeline_item_t *reads;           // ring of read_queue_depth
+    size_t read_head;
+    size_t read_count;
+
+    pipeline_filled_t *filled;        // ring of buffer_count
+    size_t filled_head;
+    size_t filled_count;
+
+    unsigned char **buffers;
+    size_t *free_buffers;
+    size_t free_count;
+
+    pipeline_thread_t *threads;       // io_threads readers, then the matchers
+    size_t readers_running;
+    bool finishing;
+    bool finished;
+
+    pipeline_stats_t stats;
+    uint64_t read_depth_sum;
+    uint64_t read_samples;
+    uint64_t match_depth_sum;
+    uint64_t match_samples;
+};
+
+// The whole file, or as much of it as fits; a file that grew since it was
+// listed is read up to its listed size.
+static bool pipeline_read(pipeline_t *pipeline, const pipeline_item_t *item,
+                          unsigned char *buffer, size_t *length) {
+    *length = 0;
+    if (cancel_token_cancelled(pipeline->config.cancel)) return false;
+
+    HANDLE file = platform_open_file(item->path, true);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    size_t wanted = item->size < pipeline->config.buffer_size ? (size_t)item->size : pipeline->config.buffer_size;
+    bool ok = platform_read_at(file, 0, buffer, wanted, length);
+    CloseHandle(file);
+    return ok;
+}
+
+static void pipeline_reader(void *arg) {
+    pipeline_thread_t *self = (pipeline_thread_t*)arg;
+    pipeline_t *pipeline = self->pipeline;
+    size_t read_capacity = pipeline->config.read_queue_depth;
+    size_t buffer_count = pipeline->config.buffer_count;
+
+    sync_mutex_lock(&pipeline->lock);
+    for (;;) {
+        while (pipeline->read_count == 0 && !pipeline->finishing) {
+            sync_cond_wait(&pipeline->read_ready, &pipeline->lock, SYNC_WAIT_INFINITE);
+        }
+        if (pipeline->read_count == 0) break;
+
+        pipeline_item_t item = pipeline->reads[pipeline->read_head];
+        pipeline->read_head = (pipeline->read_head + 1) % read_capacity;
+        pipeline->read_count--;
+        sync_cond_signal(&pipeline->read_space);
+
+        if (pipeline->free_count == 0) {
+            pipeline->stats.buffer_waits++;
+            do {
+                sync_cond_wait(&pipeline->buffer_freed, &pipeline->lock, SYNC_WAIT_INFINITE);
+            } while (pipeline->free_count == 0);
+        }
+        size_t buffer = pipeline->free_buffers[--pipeline->free_count];
+        sync_mutex_unlock(&pipeline->lock);
+
+        size_t length = 0;
+        bool ok = pipeline_read(pipeline, &item, pipeline->buffers[buffer], &length);
+
+        sync_mutex_lock(&pipeline->lock);
+        if (ok) {
+            pipeline->stats.files_read++;
+            pipeline->stats.bytes_read += length;
+        }
+
+        // Every buffer is either free, being filled or matched, or in this
+        // ring, so there is always room.
+        pipeline_filled_t *slot = &pipeline->filled[(pipeline->filled_head + pipeline->filled_count) % buffer_count];
+        slot->item = item;
+        slot->buffer = buffer;
+        slot->length = length;
+        slot->ok = ok;
+        pipeline->filled_count++;
+
+        pipeline->match_depth_sum += pipeline->filled_count;
+        pipeline->match_samples++;
+        if (pipeline->filled_count > pipeline->stats.match_queue_peak) {
+            pipeline->stats.match_queue_peak = pipeline->filled_count;
+        }
+        sync_cond_signal(&pipeline->match_ready);
+    }
+
+    if (--pipeline->readers_running == 0) {
+        sync_cond_broadcast(&pipeline->match_ready);
+    }
+    sync_mutex_unlock(&pipeline->lock);
+}
+
+static void pipeline_matcher(void *arg) {
+    pipeline_thread_t *self = (pipeline_thread_t*)arg;
+    pipeline_t *pipeline = self->pipeline;
+    size_t thread = self->index - pipeline->config.io_threads;
+    size_t buffer_count = pipeline->config.buffer_count;
+
+    sync_mutex_lock(&pipeline->lock);
+    for (;;) {
+        while (pipeline->filled_count == 0 && pipeline->readers_running > 0) {
+            sync_cond_wait(&pipeline->match_ready, &pipeline->lock, SYNC_WAIT_INFINITE);
+        }
+        if (pipeline->filled_count == 0) break;
+
+        pipeline_filled_t entry = pipeline->filled[pipeline->filled_head];
+        pipeline->filled_head = (pipeline->filled_head + 1) % buffer_count;
+        pipeline->filled_count--;
+        sync_mutex_unlock(&pipeline->lock);
+
+        pipeline->config.match(entry.item.job, entry.ok ? pipeline->buffers[entry.buffer] : NULL,
+                               entry.length, thread, pipeline->config.user_data);
+
+        sync_mutex_lock(&pipeline->lock);
+        pipeline->free_buffers[pipeline->free_count++] = entry.buffer;
+        sync_cond_signal(&pipeline->buffer_freed);
+    }
+    sync_mutex_unlock(&pipeline->lock);
+}
+
+static void pipeline_release(pipeline_t *pipeline) {
+    if (pipeline->buffers) {
+        for (size_t i = 0; i < pipeline->config.buffer_count; i++) {
+            free(pipeline->buffers[i]);
+        }
+    }
+    free(pipeline->buffers);
+    free(pipeline->free_buffers);
+    free(pipeline->filled);
+    free(pipeline->reads);
+    free(pipeline->threads);
+    free(pipeline);
+}
+
+pipeline_t* pipeline_create(const pipeline_config_t *config) {
+    if (!config || !config->match || config->buffer_size == 0) return NULL;
+
+    pipeline_t *pipeline = calloc(1, sizeof(pipeline_t));
+    if (!pipeline) return NULL;
+
+    pipeline->config = *config;
+    pipeline_config_t *c = &pipeline->config;
+    if (c->io_threads == 0) c->io_threads = PIPELINE_DEFAULT_IO_THREADS;
+    if (c->match_threads == 0) c->match_threads = sync_cpu_count();
+    if (c->match_threads == 0) c->match_threads = 1;
+    if (c->buffer_count == 0) c->buffer_count = 2 * (c->io_threads + c->match_threads);
+    if (c->read_queue_depth == 0) c->read_queue_depth = PIPELINE_READS_PER_BUFFER * c->buffer_count;
+
+    size_t thread_count = c->io_threads + c->match_threads;
+    pipeline->reads = calloc(c->read_queue_depth, sizeof(pipeline_item_t));
+    pipeline->filled = calloc(c->buffer_count, sizeof(pipeline_filled_t));
+    pipeline->buffers = calloc(c->buffer_count, sizeof(unsigned char*));
+    pipeline->free_buffers = calloc(c->buffer_count, sizeof(size_t));
+    pipeline->threads = calloc(thread_count, sizeof(pipeline_thread_t));
+    if (!pipeline->reads || !pipeline->filled || !pipeline->buffers ||
+        !pipeline->free_buffers || !pipeline->threads) {
+        pipeline_release(pipeline);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < c->buffer_count; i++) {
+        pipeline->buffers[i] = malloc(c->buffer_size);
+        if (!pipeline->buffers[i]) {
+            pipeline_release(pipeline);
+            return NULL;
+        }
+        pipeline->free_buffers[pipeline->free_count++] = i;
+    }
+
+    pipeline->stats.read_queue_capacity = c->read_queue_depth;
+    pipeline->stats.match_queue_capacity = c->buffer_count;
+
+    if (!sync_mutex_init(&pipeline->lock)) {
+        pipeline_release(pipeline);
+        return NULL;
+    }
+    sync_cond_t *conds[] = { &pipeline->read_ready, &pipeline->read_space,
+                             &pipeline->buffer_freed, &pipeline->match_ready };
+    size_t cond_count = 0;
+    while (cond_count < sizeof(conds) / sizeof(conds[0]) && sync_cond_init(conds[cond_count])) {
+        cond_count++;
+    }
+    if (cond_count < sizeof(conds) / sizeof(conds[0])) {
+        while (cond_count > 0) {
+            sync_cond_destroy(conds[--cond_count]);
+        }
+        sync_mutex_destroy(&pipeline->lock);
+        pipeline_release(pipeline);
+        return NULL;
+    }
+
+    // Readers are counted before any thread runs so no matcher quits early.
+    pipeline->readers_running = c->io_threads;
+    bool started = true;
+    for (size_t i = 0; i < thread_count; i++) {
+        pipeline_thread_t *thread = &pipeline->threads[i];
+        thread->pipeline = pipeline;
+        thread->index = i;
+        thread->started = sync_thread_start(&thread->thread, i < c->io_threads ? pipeline_reader : pipeline_matcher,
+                                            thread);
+        if (!thread->started) {
+            started = false;
+            if (i < c->io_threads) {
+                sync_mutex_lock(&pipeline->lock);
+                pipeline->readers_running--;
+                sync_mutex_unlock(&pipeline->lock);
+            }
+        }
+    }
+
+    // Both stages need at least one thread; otherwise nothing would drain.
+    bool readers = false;
+    bool matchers = false;
+    for (size_t i = 0; i < thread_count; i++) {
+        if (!pipeline->threads[i].started) continue;
+        if (i < c->io_threads) readers = true;
+        else matchers = true;
+    }
+    if (!started && (!readers || !matchers)) {
+        pipeline_destroy(pipeline);
+        return NULL;
+    }
+
+    return pipeline;
+}
+
+size_t pipeline_match_thread_count(const pipeline_t *pipeline) {
+    return pipeline ? pipeline->config.match_threads : 0;
+}
+
+bool pipeline_submit(pipeline_t *pipeline, const char *path, uint64_t size, void *job) {
+    if (!pipeline || !path) return false;
+
+    size_t capacity = pipeline->config.read_queue_depth;
+
+    sync_mutex_lock(&pipeline->lock);
+    if (pipeline->read_count == capacity && !pipeline->finishing) {
+        pipeline->stats.submit_waits++;
+        do {
+            sync_cond_wait(&pipeline->read_space, &pipeline->lock, SYNC_WAIT_INFINITE);
+        } while (pipeline->read_count == capacity && !pipeline->finishing);
+    }
+    if (pipeline->finishing) {
+        sync_mutex_unlock(&pipeline->lock);
+        return false;
+    }
+
+    pipeline_item_t *item = &pipeline->reads[(pipeline->read_head + pipeline->read_count) % capacity];
+    item->path = path;
+    item->size = size;
+    item->job = job;
+    pipeline->read_count++;
+
+    pipeline->read_depth_sum += pipeline->read_count;
+    pipeline->read_samples++;
+    if (pipeline->read_count > pipeline->stats.read_queue_peak) {
+        pipeline->stats.read_queue_peak = pipeline->read_count;
+    }
+    sync_cond_signal(&pipeline->read_ready);
+    sync_mutex_unlock(&pipeline->lock);
+    return true;
+}
+
+void pipeline_finish(pipeline_t *pipeline) {
+    if (!pipeline || pipeline->finished) return;
+
+    sync_mutex_lock(&pipeline->lock);
+    pipeline->finishing = true;
+    sync_cond_broadcast(&pipeline->read_ready);
+    sync_cond_broadcast(&pipeline->read_space);
+    sync_cond_broadcast(&pipeline->match_ready);
+    sync_mutex_unlock(&pipeline->lock);
+
+    size_t thread_count = pipeline->config.io_threads + pipeline->config.match_threads;
+    for (size_t i = 0; i < thread_count; i++) {
+        if (pipeline->threads[i].started) {
+            sync_thread_join(&pipeline->threads[i].thread);
+        }
+    }
+    pipeline->finished = true;
+}
+
+void pipeline_destroy(pipeline_t *pipeline) {
+    if (!pipeline) return;
+
+    pipeline_finish(pipeline);
+    sync_cond_destroy(&pipeline->read_ready);
+    sync_cond_destroy(&pipeline->read_space);
+    sync_cond_destroy(&pipeline->buffer_freed);
+    sync_cond_destroy(&pipeline->match_ready);
+    sync_mutex_destroy(&pipeline->lock);
+    pipeline_release(pipeline);
+}
+
+bool pipeline_get_stats(pipeline_t *pipeline, pipeline_stats_t *stats) {
+    if (!pipeline || !stats) return false;
+
+    sync_mutex_lock(&pipeline->lock);
+    *stats = pipeline->stats;
+    stats->read_queue_mean = pipeline->read_samples > 0
+        ? (double)pipeline->read_depth_sum / (double)pipeline->read_samples : 0.0;
+    stats->match_queue_mean = pipeline->match_samples > 0
+        ? (double)pipeline->match_depth_sum / (double)pipeline->match_samples : 0.0;
+    sync_mutex_unlock(&pipeline->lock);
+    return true;
+}
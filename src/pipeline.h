@@ -0,0 +1,68 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cancel.h"
+
+// Two-stage file processing: I/O threads read queued files whole into a
+// fixed set of buffers, match threads consume the filled buffers. Either
+// stage can run ahead of the other by as many buffers as there are, so a
+// thread blocked on the disk never holds up matching and a slow match never
+// leaves the disk idle. Memory stays at buffer_count * buffer_size.
+
+typedef struct pipeline pipeline_t;
+
+// Runs on a match thread exactly once for every accepted submission. data
+// is NULL when the file could not be read or the pipeline was cancelled,
+// and is only valid during the call. thread is the match thread's index in
+// [0, match_threads), for per-thread state.
+typedef void (*pipeline_match_t)(void *job, const unsigned char *data, size_t length,
+                                 size_t thread, void *user_data);
+
+typedef struct {
+    size_t io_threads;                // 0 = 2
+    size_t match_threads;             // 0 = one per CPU
+    size_t buffer_count;              // 0 = twice the thread count
+    size_t buffer_size;               // files are read up to this many bytes
+    size_t read_queue_depth;          // 0 = 8 per buffer
+    pipeline_match_t match;
+    void *user_data;
+    cancel_token_t *cancel;           // optional; reads are skipped once it fires
+} pipeline_config_t;
+
+pipeline_t* pipeline_create(const pipeline_config_t *config);
+
+size_t pipeline_match_thread_count(const pipeline_t *pipeline);
+
+// Queues a file of the given size to be read. The path must stay valid
+// until the match callback has run for the job. Blocks while the read queue
+// is full; returns false once the pipeline is finishing.
+bool pipeline_submit(pipeline_t *pipeline, const char *path, uint64_t size, void *job);
+
+// Accepts nothing more, waits until every queued file has been matched and
+// stops the threads.
+void pipeline_finish(pipeline_t *pipeline);
+
+// Finishes first if needed.
+void pipeline_destroy(pipeline_t *pipeline);
+
+// Queue depths are sampled as each item is added, so the means show how
+// far one stage typically ran ahead of the next.
+typedef struct {
+    uint64_t files_read;
+    uint64_t bytes_read;
+    size_t read_queue_capacity;
+    size_t read_queue_peak;
+    double read_queue_mean;
+    size_t match_queue_capacity;      // the buffer count
+    size_t match_queue_peak;
+    double match_queue_mean;
+    uint64_t submit_waits;            // submissions that found the read queue full
+    uint64_t buffer_waits;            // reads that found every buffer in use
+} pipeline_stats_t;
+
+bool pipeline_get_stats(pipeline_t *pipeline, pipeline_stats_t *stats);
+
+#endif
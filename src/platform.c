@@ -75,6 +75,35 @@ HRESULT make_long_path(const char *path, wchar_t **long_path) {
     }
 }
 
+char* platform_full_path(const char *utf8_path) {
+    if (!utf8_path) return NULL;
+
+    wchar_t *wide_path;
+    if (utf8_to_wide(utf8_path, &wide_path) < 0) return NULL;
+
+    DWORD needed = GetFullPathNameW(wide_path, 0, NULL, NULL);
+    if (needed == 0) {
+        free(wide_path);
+        return NULL;
+    }
+
+    wchar_t *full_path = malloc(needed * sizeof(wchar_t));
+    if (!full_path) {
+        free(wide_path);
+        return NULL;
+    }
+
+    DWORD written = GetFullPathNameW(wide_path, needed, full_path, NULL);
+    free(wide_path);
+
+    char *result = NULL;
+    if (written > 0 && written < needed) {
+        wide_to_utf8(full_path, &result);
+    }
+    free(full_path);
+    return result;
+}
+
 struct platform_dir_iter {
     HANDLE find_handle;
     WIN32_FIND_DATAW find_data;
@@ -176,4 +205,154 @@ void platform_free_file_info(platform_file_info_t *info) {
     free(info->name);
     free(info->name_wide);
     memset(info, 0, sizeof(*info));
-}
\ No newline at end of file
+}
+
+bool platform_get_file_usage(const char *utf8_path, platform_file_usage_t *usage) {
+    if (!utf8_path || !usage) return false;
+
+    wchar_t *wide_path;
+    if (FAILED(make_long_path(utf8_path, &wide_path))) {
+        return false;
+    }
+
+    // Attribute-only access: no data is read and sharing never conflicts.
+    HANDLE handle = CreateFileW(wide_path, FILE_READ_ATTRIBUTES,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                                OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT, NULL);
+    free(wide_path);
+
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    FILE_STANDARD_INFO standard_info;
+    BY_HANDLE_FILE_INFORMATION handle_info;
+    bool ok = GetFileInformationByHandleEx(handle, FileStandardInfo, &standard_info, sizeof(standard_info)) &&
+              GetFileInformationByHandle(handle, &handle_info);
+    CloseHandle(handle);
+
+    if (!ok) return false;
+
+    usage->allocated_size = (uint64_t)standard_info.AllocationSize.QuadPart;
+    usage->link_count = standard_info.NumberOfLinks;
+    usage->volume_serial = handle_info.dwVolumeSerialNumber;
+    usage->file_index = ((uint64_t)handle_info.nFileIndexHigh << 32) | handle_info.nFileIndexLow;
+    return true;
+}
+
+HANDLE platform_open_file(const char *utf8_path, bool sequential) {
+    if (!utf8_path) return INVALID_HANDLE_VALUE;
+
+    wchar_t *wide_path;
+    if (FAILED(make_long_path(utf8_path, &wide_path))) {
+        return INVALID_HANDLE_VALUE;
+    }
+
+    HANDLE handle = CreateFileW(wide_path, GENERIC_READ,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                                OPEN_EXISTING, sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, NULL);
+    free(wide_path);
+    return handle;
+}
+
+bool platform_read_at(HANDLE file, uint64_t offset, void *buffer, size_t length, size_t *bytes_read) {
+    if (file == INVALID_HANDLE_VALUE || !buffer || !bytes_read) return false;
+
+    *bytes_read = 0;
+
+    // Positioned reads keep a handle usable without seeking first.
+    OVERLAPPED overlapped = {0};
+    overlapped.Offset = (DWORD)(offset & 0xFFFFFFFFu);
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+    DWORD chunk = length > 0x40000000u ? 0x40000000u : (DWORD)length;
+    DWORD got = 0;
+    if (!ReadFile(file, buffer, chunk, &got, &overlapped)) {
+        return GetLastError() == ERROR_HANDLE_EOF;
+    }
+
+    *bytes_read = got;
+    return true;
+}
+
+bool platform_map_file(const char *utf8_path, platform_mapped_file_t *mapped) {
+    if (!mapped) return false;
+    memset(mapped, 0, sizeof(*mapped));
+
+    mapped->file = platform_open_file(utf8_path, true);
+    if (mapped->file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mapped->file, &size)) {
+        platform_unmap_file(mapped);
+        return false;
+    }
+    mapped->size = (uint64_t)size.QuadPart;
+    if (mapped->size == 0 || mapped->size > (uint64_t)SIZE_MAX) {
+        // Nothing to map, or too large for this address space.
+        bool empty = mapped->size == 0;
+        if (!empty) platform_unmap_file(mapped);
+        return empty;
+    }
+
+    mapped->mapping = CreateFileMappingW(mapped->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapped->mapping) {
+        mapped->data = MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (!mapped->data) {
+        platform_unmap_file(mapped);
+        return false;
+    }
+    return true;
+}
+
+void platform_unmap_file(platform_mapped_file_t *mapped) {
+    if (!mapped) return;
+
+    if (mapped->data) {
+        UnmapViewOfFile(mapped->data);
+    }
+    if (mapped->mapping) {
+        CloseHandle(mapped->mapping);
+    }
+    if (mapped->file && mapped->file != INVALID_HANDLE_VALUE) {
+        CloseHandle(mapped->file);
+    }
+    memset(mapped, 0, sizeof(*mapped));
+}
+
+char* platform_read_text_file(const char *utf8_path, size_t max_bytes) {
+    HANDLE file = platform_open_file(utf8_path, true);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    size_t capacity = max_bytes < 4096 ? max_bytes : 4096;
+    size_t length = 0;
+    char *text = malloc(capacity + 1);
+
+    while (text) {
+        if (length == capacity) {
+            if (capacity >= max_bytes) break;
+            size_t new_capacity = capacity * 2 < max_bytes ? capacity * 2 : max_bytes;
+            char *grown = realloc(text, new_capacity + 1);
+            if (!grown) {
+                free(text);
+                text = NULL;
+                break;
+            }
+            text = grown;
+            capacity = new_capacity;
+        }
+
+        size_t got = 0;
+        if (!platform_read_at(file, length, text + length, capacity - length, &got) || got == 0) {
+            break;
+        }
+        length += got;
+    }
+
+    CloseHandle(file);
+    if (text) {
+        text[length] = '\0';
+    }
+    return text;
+}
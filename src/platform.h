@@ -38,6 +38,9 @@ void free_converted_string(void *str);
 
 HRESULT make_long_path(const char *path, wchar_t **long_path);
 
+// Absolute, separator-normalised form of a path (caller frees), or NULL.
+char* platform_full_path(const char *utf8_path);
+
 typedef struct platform_dir_iter platform_dir_iter_t;
 typedef struct {
     char *name;
@@ -48,9 +51,36 @@ typedef struct {
     bool is_symlink;
 } platform_file_info_t;
 
+typedef struct {
+    uint64_t allocated_size;
+    uint32_t link_count;
+    uint32_t volume_serial;
+    uint64_t file_index;
+} platform_file_usage_t;
+
 platform_dir_iter_t* platform_opendir(const char *utf8_path);
 bool platform_readdir(platform_dir_iter_t *iter, platform_file_info_t *info);
 void platform_closedir(platform_dir_iter_t *iter);
 void platform_free_file_info(platform_file_info_t *info);
 
+bool platform_get_file_usage(const char *utf8_path, platform_file_usage_t *usage);
+
+HANDLE platform_open_file(const char *utf8_path, bool sequential);
+bool platform_read_at(HANDLE file, uint64_t offset, void *buffer, size_t length, size_t *bytes_read);
+
+// Read-only view of a whole file. Empty files map to data == NULL, size 0.
+typedef struct {
+    HANDLE file;
+    HANDLE mapping;
+    const unsigned char *data;
+    uint64_t size;
+} platform_mapped_file_t;
+
+bool platform_map_file(const char *utf8_path, platform_mapped_file_t *mapped);
+void platform_unmap_file(platform_mapped_file_t *mapped);
+
+// Reads at most max_bytes of a small text file into a NUL-terminated buffer
+// (caller frees), or NULL if it cannot be opened.
+char* platform_read_text_file(const char *utf8_path, size_t max_bytes);
+
 #endif
\ No newline at end of file
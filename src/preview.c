@@ -5,11 +5,114 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <inttypes.h>
+#include <stdarg.h>
 #include <windows.h>
 
-rq_file_type_t detect_file_type(const char *filepath) {
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Lines longer than this many bytes are cut short.
+#define PREVIEW_LINE_SHOWN 100
+
+// Only this many leading bytes decide whether a file looks like text.
+#define PREVIEW_TEXT_PROBE 512
+
+// Leading bytes of common formats, checked before the extension so that a
+// renamed file is still recognised. Two-letter signatures that plain text
+// could start with (BMP's "BM", an executable's "MZ") are left to the
+// extension and the text test.
+typedef struct {
+    size_t offset;
+    const char *magic;
+    size_t length;
+    rq_file_type_t type;
+} file_signature_t;
+
+#define FILE_SIGNATURE(offset, magic, type) { offset, magic, sizeof(magic) - 1, type }
+
+static const file_signature_t file_signatures[] = {
+    FILE_SIGNATURE(0, "\x89PNG\r\n\x1A\n", RQ_FILE_TYPE_IMAGE),
+    FILE_SIGNATURE(0, "\xFF\xD8\xFF", RQ_FILE_TYPE_IMAGE),
+    FILE_SIGNATURE(0, "GIF87a", RQ_FILE_TYPE_IMAGE),
+    FILE_SIGNATURE(0, "GIF89a", RQ_FILE_TYPE_IMAGE),
+    FILE_SIGNATURE(0, "II*\0", RQ_FILE_TYPE_IMAGE),
+    FILE_SIGNATURE(0, "MM\0*", RQ_FILE_TYPE_IMAGE),
+    FILE_SIGNATURE(8, "WEBP", RQ_FILE_TYPE_IMAGE),           // RIFF container
+    FILE_SIGNATURE(0, "\0\0\1\0", RQ_FILE_TYPE_IMAGE),       // .ico
+    FILE_SIGNATURE(0, "8BPS", RQ_FILE_TYPE_IMAGE),
+
+    FILE_SIGNATURE(4, "ftypM4A ", RQ_FILE_TYPE_AUDIO),
+    FILE_SIGNATURE(4, "ftyp", RQ_FILE_TYPE_VIDEO),           // .mp4, .mov, .3gp
+    FILE_SIGNATURE(0, "\x1A\x45\xDF\xA3", RQ_FILE_TYPE_VIDEO), // .mkv, .webm
+    FILE_SIGNATURE(8, "AVI ", RQ_FILE_TYPE_VIDEO),
+    FILE_SIGNATURE(0, "FLV\x01", RQ_FILE_TYPE_VIDEO),
+    FILE_SIGNATURE(0, "\0\0\1\xBA", RQ_FILE_TYPE_VIDEO),     // MPEG program stream
+    FILE_SIGNATURE(0, "\0\0\1\xB3", RQ_FILE_TYPE_VIDEO),
+
+    FILE_SIGNATURE(0, "ID3", RQ_FILE_TYPE_AUDIO),
+    FILE_SIGNATURE(0, "\xFF\xFB", RQ_FILE_TYPE_AUDIO),       // MPEG audio frames
+    FILE_SIGNATURE(0, "\xFF\xF3", RQ_FILE_TYPE_AUDIO),
+    FILE_SIGNATURE(0, "\xFF\xF2", RQ_FILE_TYPE_AUDIO),
+    FILE_SIGNATURE(0, "\xFF\xF1", RQ_FILE_TYPE_AUDIO),       // AAC (ADTS)
+    FILE_SIGNATURE(0, "\xFF\xF9", RQ_FILE_TYPE_AUDIO),
+    FILE_SIGNATURE(0, "fLaC", RQ_FILE_TYPE_AUDIO),
+    FILE_SIGNATURE(0, "OggS", RQ_FILE_TYPE_AUDIO),
+    FILE_SIGNATURE(8, "WAVE", RQ_FILE_TYPE_AUDIO),
+    FILE_SIGNATURE(8, "AIFF", RQ_FILE_TYPE_AUDIO),
+
+    FILE_SIGNATURE(0, "PK\3\4", RQ_FILE_TYPE_ARCHIVE),
+    FILE_SIGNATURE(0, "PK\5\6", RQ_FILE_TYPE_ARCHIVE),       // empty zip
+    FILE_SIGNATURE(0, "Rar!\x1A\x07", RQ_FILE_TYPE_ARCHIVE),
+    FILE_SIGNATURE(0, "7z\xBC\xAF\x27\x1C", RQ_FILE_TYPE_ARCHIVE),
+    FILE_SIGNATURE(0, "\x1F\x8B", RQ_FILE_TYPE_ARCHIVE),
+    FILE_SIGNATURE(0, "BZh", RQ_FILE_TYPE_ARCHIVE),
+    FILE_SIGNATURE(0, "\xFD" "7zXZ\0", RQ_FILE_TYPE_ARCHIVE),
+    FILE_SIGNATURE(0, "MSCF", RQ_FILE_TYPE_ARCHIVE),
+    FILE_SIGNATURE(0, "!<arch>\n", RQ_FILE_TYPE_ARCHIVE),    // .deb
+    FILE_SIGNATURE(0, "\xED\xAB\xEE\xDB", RQ_FILE_TYPE_ARCHIVE), // .rpm
+    FILE_SIGNATURE(257, "ustar", RQ_FILE_TYPE_ARCHIVE),
+};
+
+static bool looks_like_text(const unsigned char *data, size_t length) {
+    if (length > PREVIEW_TEXT_PROBE) length = PREVIEW_TEXT_PROBE;
+    if (length == 0) return true;
+
+    if (length >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) {
+        return true;
+    }
+
+    if (length >= 2 && ((data[0] == 0xFF && data[1] == 0xFE) ||
+                        (data[0] == 0xFE && data[1] == 0xFF))) {
+        return false;
+    }
+
+    if (memchr(data, 0, length)) return false;
+
+    size_t printable = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (isprint(data[i]) || isspace(data[i])) {
+            printable++;
+        }
+    }
+
+    return (printable * 100 / length) >= 95;
+}
+
+rq_file_type_t detect_file_type(const char *filepath, const unsigned char *head, size_t length) {
     if (!filepath) return RQ_FILE_TYPE_UNKNOWN;
 
+    if (head) {
+        for (size_t i = 0; i < sizeof(file_signatures) / sizeof(file_signatures[0]); i++) {
+            const file_signature_t *signature = &file_signatures[i];
+            if (signature->offset + signature->length <= length &&
+                memcmp(head + signature->offset, signature->magic, signature->length) == 0) {
+                return signature->type;
+            }
+        }
+    }
+
     if (has_extension(filepath, text_extensions)) {
         return RQ_FILE_TYPE_TEXT;
     }
@@ -26,7 +129,7 @@ rq_file_type_t detect_file_type(const char *filepath) {
         return RQ_FILE_TYPE_ARCHIVE;
     }
 
-    if (is_text_file(filepath)) {
+    if (head && looks_like_text(head, length)) {
         return RQ_FILE_TYPE_TEXT;
     }
 
@@ -44,113 +147,206 @@ const char* file_type_to_string(rq_file_type_t type) {
     }
 }
 
-bool is_text_file(const char *filepath) {
-    FILE *file = fopen(filepath, "rb");
-    if (!file) return false;
+void preview_buffer_free(preview_buffer_t *buffer) {
+    if (!buffer) return;
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->capacity = 0;
+}
 
-    unsigned char buffer[512];
-    size_t bytes_read = fread(buffer, 1, sizeof(buffer), file);
-    fclose(file);
+void preview_text_free(preview_text_t *text) {
+    if (!text) return;
+    free(text->data);
+    text->data = NULL;
+    text->length = 0;
+    text->capacity = 0;
+}
 
-    if (bytes_read == 0) return true;
+// Output that does not fit in memory is cut short.
+static void preview_printf(preview_text_t *text, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    va_list retry;
+    va_copy(retry, args);
 
-    if (bytes_read >= 3 && buffer[0] == 0xEF && buffer[1] == 0xBB && buffer[2] == 0xBF) {
-        return true;
+    size_t room = text->capacity - text->length;
+    int needed = vsnprintf(room > 0 ? text->data + text->length : NULL, room, format, args);
+    if (needed >= 0 && (size_t)needed >= room) {
+        size_t capacity = text->capacity > 0 ? text->capacity : 256;
+        while (capacity - text->length <= (size_t)needed) {
+            capacity *= 2;
+        }
+        char *data = realloc(text->data, capacity);
+        if (data) {
+            text->data = data;
+            text->capacity = capacity;
+            vsnprintf(text->data + text->length, capacity - text->length, format, retry);
+        } else {
+            needed = -1;
+        }
     }
-
-    if (bytes_read >= 2 && ((buffer[0] == 0xFF && buffer[1] == 0xFE) ||
-                           (buffer[0] == 0xFE && buffer[1] == 0xFF))) {
-        return false;
+    if (needed > 0) {
+        text->length += (size_t)needed;
     }
 
-    for (size_t i = 0; i < bytes_read; i++) {
-        if (buffer[i] == 0) return false;
-    }
+    va_end(retry);
+    va_end(args);
+}
 
-    size_t printable = 0;
-    for (size_t i = 0; i < bytes_read; i++) {
-        if (isprint(buffer[i]) || isspace(buffer[i])) {
-            printable++;
-        }
+// Offset of the first line break in [from, to), or to. Sixteen bytes are
+// compared at a time where SSE2 is available, so short lines do not each
+// cost a call into the C library.
+static size_t preview_find_newline(const unsigned char *data, size_t from, size_t to) {
+    size_t i = from;
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= to; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(data + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+        if (mask) return i + (size_t)__builtin_ctz(mask);
     }
-
-    return (printable * 100 / bytes_read) >= 95;
+#endif
+    const unsigned char *hit = memchr(data + i, '\n', to - i);
+    return hit ? (size_t)(hit - data) : to;
 }
 
-int preview_text_file(const char *filepath, size_t max_lines, FILE *output) {
-    FILE *file = fopen(filepath, "r");
-    if (!file) {
-        fprintf(output, "  [Error: Cannot open file]\n");
-        return -1;
+// Cut lines back up to a lead byte, so no character is split.
+static void preview_line(preview_text_t *output, const unsigned char *line, size_t length) {
+    if (length <= PREVIEW_LINE_SHOWN) {
+        preview_printf(output, "  %.*s\n", (int)length, (const char*)line);
+        return;
     }
 
-    char line[1024];
+    size_t cut = PREVIEW_LINE_SHOWN - 3;
+    while (cut > 0 && (line[cut] & 0xC0) == 0x80) {
+        cut--;
+    }
+    preview_printf(output, "  %.*s...\n", (int)cut, (const char*)line);
+}
+
+// The head is already in the buffer (filled bytes of it). More is read only
+// while a line still to be shown, or skipped, has not ended; a line longer
+// than the buffer is shown from its start and counts once however long it
+// is, and if it is the last one shown, the rest of it is never read.
+static int preview_text_lines(HANDLE file, preview_buffer_t *buffer, size_t filled, uint64_t size,
+                              size_t max_lines, preview_text_t *output, const cancel_token_t *cancel) {
+    unsigned char *data = buffer->data;
+    uint64_t base = 0;                // file offset of data[0]
+    bool eof = filled < buffer->capacity;
+    size_t pos = 0;
     size_t line_count = 0;
-    bool has_more = false;
+    bool skipping = false;            // inside a line already shown
+
+    while (!cancel_token_cancelled(cancel)) {
+        if (line_count == max_lines || (!skipping && pos == filled && eof)) break;
 
-    while (line_count < max_lines && fgets(line, sizeof(line), file)) {
-        size_t len = strlen(line);
-        if (len > 0 && line[len-1] == '\n') {
-            line[len-1] = '\0';
+        size_t newline = preview_find_newline(data, pos, filled);
+        if (newline < filled || eof) {
+            if (!skipping) {
+                size_t length = newline - pos;
+                if (newline < filled && length > 0 && data[newline - 1] == '\r') {
+                    length--;
+                }
+                preview_line(output, data + pos, length);
+                line_count++;
+            }
+            skipping = false;
+            pos = newline < filled ? newline + 1 : filled;
+            continue;
         }
 
-        if (strlen(line) > 100) {
-            line[97] = '.';
-            line[98] = '.';
-            line[99] = '.';
-            line[100] = '\0';
+        if (!skipping && pos == 0 && filled == buffer->capacity) {
+            preview_line(output, data, filled);
+            line_count++;
+            skipping = true;
+            pos = filled;
+            continue;
+        }
+        if (skipping) {
+            pos = filled;
         }
 
-        fprintf(output, "  %s\n", line);
-        line_count++;
-    }
+        // Keep the unfinished line and read on behind it.
+        memmove(data, data + pos, filled - pos);
+        base += pos;
+        filled -= pos;
+        pos = 0;
 
-    if (fgets(line, sizeof(line), file)) {
-        has_more = true;
+        size_t wanted = buffer->capacity - filled;
+        size_t bytes_read = 0;
+        if (!platform_read_at(file, base + filled, data + filled, wanted, &bytes_read)) {
+            bytes_read = 0;
+        }
+        filled += bytes_read;
+        eof = bytes_read < wanted;
     }
 
-    fclose(file);
-
+    // What lies past the buffer is judged by the size the search reported.
+    bool has_more = line_count == max_lines && (pos < filled || base + filled < size);
     if (has_more) {
-        fprintf(output, "  [...more lines...]\n");
+        preview_printf(output, "  [...more lines...]\n");
     } else if (line_count == 0) {
-        fprintf(output, "  [Empty file]\n");
+        preview_printf(output, "  [Empty file]\n");
     }
 
     return 0;
 }
 
-int preview_file_summary(const char *filepath, FILE *output) {
-    rq_file_type_t type = detect_file_type(filepath);
-
-    HANDLE hFile = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL,
-                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (hFile == INVALID_HANDLE_VALUE) {
-        fprintf(output, "  [Error: Cannot access file]\n");
-        return -1;
+static void preview_summary(rq_file_type_t type, uint64_t size, preview_text_t *output) {
+    char size_str[64];
+    if (size < 1024) {
+        snprintf(size_str, sizeof(size_str), "%" PRIu64 " bytes", size);
+    } else if (size < 1024 * 1024) {
+        snprintf(size_str, sizeof(size_str), "%.1f KB", size / 1024.0);
+    } else if (size < 1024 * 1024 * 1024) {
+        snprintf(size_str, sizeof(size_str), "%.1f MB", size / (1024.0 * 1024.0));
+    } else {
+        snprintf(size_str, sizeof(size_str), "%.1f GB", size / (1024.0 * 1024.0 * 1024.0));
     }
 
-    LARGE_INTEGER fileSize;
-    if (!GetFileSizeEx(hFile, &fileSize)) {
-        CloseHandle(hFile);
-        fprintf(output, "  [Error: Cannot get file size]\n");
-        return -1;
+    preview_printf(output, "  Type: %s, Size: %s\n", file_type_to_string(type), size_str);
+}
+
+int preview_file(const char *filepath, uint64_t size, size_t max_lines, preview_buffer_t *buffer,
+                 preview_text_t *output, const cancel_token_t *cancel) {
+    if (!filepath || !buffer || !output) return -1;
+
+    if (!buffer->data) {
+        buffer->data = malloc(PREVIEW_HEAD_SIZE);
+        if (!buffer->data) {
+            preview_printf(output, "  [Error: Out of memory]\n");
+            return -1;
+        }
+        buffer->capacity = PREVIEW_HEAD_SIZE;
     }
 
-    CloseHandle(hFile);
+    HANDLE file = platform_open_file(filepath, true);
+    if (file == INVALID_HANDLE_VALUE) {
+        // The size is known anyway; only text needs the contents.
+        rq_file_type_t type = detect_file_type(filepath, NULL, 0);
+        if (type == RQ_FILE_TYPE_TEXT) {
+            preview_printf(output, "  [Error: Cannot open file]\n");
+            return -1;
+        }
+        preview_summary(type, size, output);
+        return 0;
+    }
 
-    char size_str[64];
-    if (fileSize.QuadPart < 1024) {
-        snprintf(size_str, sizeof(size_str), "%lld bytes", fileSize.QuadPart);
-    } else if (fileSize.QuadPart < 1024 * 1024) {
-        snprintf(size_str, sizeof(size_str), "%.1f KB", fileSize.QuadPart / 1024.0);
-    } else if (fileSize.QuadPart < 1024 * 1024 * 1024) {
-        snprintf(size_str, sizeof(size_str), "%.1f MB", fileSize.QuadPart / (1024.0 * 1024.0));
-    } else {
-        snprintf(size_str, sizeof(size_str), "%.1f GB", fileSize.QuadPart / (1024.0 * 1024.0 * 1024.0));
+    size_t length = 0;
+    if (!platform_read_at(file, 0, buffer->data, buffer->capacity, &length)) {
+        CloseHandle(file);
+        preview_printf(output, "  [Error: Cannot read file]\n");
+        return -1;
     }
 
-    fprintf(output, "  Type: %s, Size: %s\n", file_type_to_string(type), size_str);
+    rq_file_type_t type = detect_file_type(filepath, buffer->data, length);
+    if (type != RQ_FILE_TYPE_TEXT) {
+        CloseHandle(file);
+        preview_summary(type, size, output);
+        return 0;
+    }
 
-    return 0;
+    int status = preview_text_lines(file, buffer, length, size, max_lines, output, cancel);
+    CloseHandle(file);
+    return status;
 }
@@ -1,9 +1,11 @@
 #ifndef PREVIEW_H
 #define PREVIEW_H
 
+#include "cancel.h"
 #include <stdio.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum {
     RQ_FILE_TYPE_TEXT,
@@ -14,14 +16,40 @@ typedef enum {
     RQ_FILE_TYPE_UNKNOWN
 } rq_file_type_t;
 
-int preview_text_file(const char *filepath, size_t max_lines, FILE *output);
+// A file's head is read this much at once; it drives both classification
+// and, for text, the lines shown.
+#define PREVIEW_HEAD_SIZE (16u * 1024u)
 
-rq_file_type_t detect_file_type(const char *filepath);
+// Read buffer reused across previews by one thread.
+typedef struct {
+    unsigned char *data;
+    size_t capacity;
+} preview_buffer_t;
 
-const char* file_type_to_string(rq_file_type_t type);
+void preview_buffer_free(preview_buffer_t *buffer);
+
+// What a preview shows, collected so that it can be printed later in one
+// piece.
+typedef struct {
+    char *data;                       // NUL-terminated once anything is added
+    size_t length;
+    size_t capacity;
+} preview_text_t;
+
+void preview_text_free(preview_text_t *text);
 
-bool is_text_file(const char *filepath);
+// Classifies by the signature in the file's leading bytes, then by
+// extension, then by whether the bytes look like text. With head == NULL
+// only the extension is used.
+rq_file_type_t detect_file_type(const char *filepath, const unsigned char *head, size_t length);
+
+const char* file_type_to_string(rq_file_type_t type);
 
-int preview_file_summary(const char *filepath, FILE *output);
+// Appends the first max_lines lines of a text file to output, or the type
+// and size of any other. size is the one the search already has, so the
+// file is opened once and, unless its lines run past the head, read once.
+// Stops between lines once cancel fires (cancel may be NULL).
+int preview_file(const char *filepath, uint64_t size, size_t max_lines, preview_buffer_t *buffer,
+                 preview_text_t *output, const cancel_token_t *cancel);
 
 #endif
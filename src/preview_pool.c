@@ -0,0 +1,216 @@
+#include "preview_pool.h"
+#include "preview.h"
+#include "sync.h"
+#include <stdlib.h>
+
+typedef struct preview_task {
+    const char *path;
+    uint64_t size;
+    const void *item;
+    preview_text_t text;
+    bool done;
+    struct preview_task *next;        // submitted after this one
+} preview_task_t;
+
+typedef struct {
+    preview_pool_t *pool;
+    sync_thread_t thread;
+    bool started;
+} preview_thread_t;
+
+struct preview_pool {
+    preview_pool_config_t config;
+
+    sync_mutex_t lock;
+    sync_cond_t task_ready;           // a task was queued, or finishing began
+    sync_cond_t task_space;           // a task was emitted, or finishing began
+
+    preview_task_t *oldest;           // not yet emitted, in submission order
+    preview_task_t *newest;
+    preview_task_t *pending;          // the first one no thread has taken
+    size_t queued;                    // submitted and not yet emitted
+    bool emitting;                    // one thread emits; the rest leave it to it
+    bool finishing;
+    bool finished;
+
+    preview_thread_t *threads;
+};
+
+// Called with the lock held. The emitting thread drops the lock around each
+// emit and looks again afterwards, so a task another thread finishes in the
+// meantime is never left behind.
+static void preview_pool_emit(preview_pool_t *pool) {
+    if (pool->emitting) return;
+    pool->emitting = true;
+
+    while (pool->oldest && pool->oldest->done) {
+        preview_task_t *task = pool->oldest;
+        pool->oldest = task->next;
+        if (!pool->oldest) pool->newest = NULL;
+        sync_mutex_unlock(&pool->lock);
+
+        if (!cancel_token_cancelled(pool->config.cancel)) {
+            pool->config.emit(task->item, task->text.data ? task->text.data : "", task->text.length,
+                              pool->config.user_data);
+        }
+        preview_text_free(&task->text);
+        free(task);
+
+        sync_mutex_lock(&pool->lock);
+        pool->queued--;
+        sync_cond_signal(&pool->task_space);
+    }
+    pool->emitting = false;
+}
+
+static void preview_worker(void *arg) {
+    preview_thread_t *self = (preview_thread_t*)arg;
+    preview_pool_t *pool = self->pool;
+    preview_buffer_t buffer = {0};
+
+    sync_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->pending && !pool->finishing) {
+            sync_cond_wait(&pool->task_ready, &pool->lock, SYNC_WAIT_INFINITE);
+        }
+        if (!pool->pending) break;
+
+        preview_task_t *task = pool->pending;
+        pool->pending = task->next;
+        sync_mutex_unlock(&pool->lock);
+
+        // Cancelled tasks are still completed, empty, to keep the order.
+        if (!cancel_token_cancelled(pool->config.cancel)) {
+            preview_file(task->path, task->size, pool->config.max_lines, &buffer, &task->text,
+                         pool->config.cancel);
+        }
+
+        sync_mutex_lock(&pool->lock);
+        task->done = true;
+        preview_pool_emit(pool);
+    }
+    sync_mutex_unlock(&pool->lock);
+    preview_buffer_free(&buffer);
+}
+
+preview_pool_t* preview_pool_create(const preview_pool_config_t *config) {
+    if (!config || !config->emit) return NULL;
+
+    preview_pool_t *pool = calloc(1, sizeof(preview_pool_t));
+    if (!pool) return NULL;
+
+    pool->config = *config;
+    preview_pool_config_t *c = &pool->config;
+    if (c->threads == 0) c->threads = sync_cpu_count();
+    if (c->threads == 0) c->threads = 1;
+    if (c->threads > PREVIEW_POOL_MAX_THREADS) c->threads = PREVIEW_POOL_MAX_THREADS;
+    if (c->queue_depth == 0) c->queue_depth = PREVIEW_POOL_TASKS_PER_THREAD * c->threads;
+
+    pool->threads = calloc(c->threads, sizeof(preview_thread_t));
+    if (!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+    if (!sync_mutex_init(&pool->lock)) {
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    if (!sync_cond_init(&pool->task_ready)) {
+        sync_mutex_destroy(&pool->lock);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    if (!sync_cond_init(&pool->task_space)) {
+        sync_cond_destroy(&pool->task_ready);
+        sync_mutex_destroy(&pool->lock);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+
+    size_t started = 0;
+    for (size_t i = 0; i < c->threads; i++) {
+        preview_thread_t *thread = &pool->threads[i];
+        thread->pool = pool;
+        thread->started = sync_thread_start(&thread->thread, preview_worker, thread);
+        if (thread->started) started++;
+    }
+    if (started == 0) {
+        preview_pool_destroy(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+bool preview_pool_submit(preview_pool_t *pool, const char *path, uint64_t size, const void *item) {
+    if (!pool || !path) return false;
+
+    preview_task_t *task = calloc(1, sizeof(preview_task_t));
+    if (!task) return false;
+    task->path = path;
+    task->size = size;
+    task->item = item;
+
+    sync_mutex_lock(&pool->lock);
+    while (pool->queued == pool->config.queue_depth && !pool->finishing) {
+        sync_cond_wait(&pool->task_space, &pool->lock, SYNC_WAIT_INFINITE);
+    }
+    if (pool->finishing) {
+        sync_mutex_unlock(&pool->lock);
+        free(task);
+        return false;
+    }
+
+    if (pool->newest) {
+        pool->newest->next = task;
+    } else {
+        pool->oldest = task;
+    }
+    pool->newest = task;
+    pool->queued++;
+    if (!pool->pending) {
+        pool->pending = task;
+    }
+    sync_cond_signal(&pool->task_ready);
+    sync_mutex_unlock(&pool->lock);
+    return true;
+}
+
+void preview_pool_finish(preview_pool_t *pool) {
+    if (!pool || pool->finished) return;
+
+    sync_mutex_lock(&pool->lock);
+    pool->finishing = true;
+    sync_cond_broadcast(&pool->task_ready);
+    sync_cond_broadcast(&pool->task_space);
+    sync_mutex_unlock(&pool->lock);
+
+    // Threads leave only once nothing is pending, and the last task to
+    // finish emits whatever is left.
+    for (size_t i = 0; i < pool->config.threads; i++) {
+        if (pool->threads[i].started) {
+            sync_thread_join(&pool->threads[i].thread);
+        }
+    }
+    pool->finished = true;
+}
+
+void preview_pool_destroy(preview_pool_t *pool) {
+    if (!pool) return;
+
+    preview_pool_finish(pool);
+    while (pool->oldest) {
+        preview_task_t *next = pool->oldest->next;
+        preview_text_free(&pool->oldest->text);
+        free(pool->oldest);
+        pool->oldest = next;
+    }
+    sync_cond_destroy(&pool->task_space);
+    sync_cond_destroy(&pool->task_ready);
+    sync_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
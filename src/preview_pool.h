@@ -0,0 +1,50 @@
+#ifndef PREVIEW_POOL_H
+#define PREVIEW_POOL_H
+
+#include "cancel.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Generates previews on threads of its own, one result per task, each into
+// a buffer of its own, and hands them back in the order they were
+// submitted. A task that finishes early waits until every earlier one has
+// been emitted; whichever thread completes the oldest task emits it and the
+// finished ones behind it. A slow file or terminal holds up the output; the
+// threads that submit are only held up once queue_depth tasks are waiting
+// to be emitted.
+
+typedef struct preview_pool preview_pool_t;
+
+// Runs once for every accepted submission, in submission order and never
+// concurrently. text is only valid during the call.
+typedef void (*preview_emit_t)(const void *item, const char *text, size_t length, void *user_data);
+
+typedef struct {
+    size_t threads;                   // 0 = one per CPU, up to PREVIEW_POOL_MAX_THREADS
+    size_t max_lines;
+    size_t queue_depth;               // 0 = PREVIEW_POOL_TASKS_PER_THREAD per thread
+    preview_emit_t emit;
+    void *user_data;
+    const cancel_token_t *cancel;     // optional; nothing is emitted once it fires
+} preview_pool_config_t;
+
+#define PREVIEW_POOL_MAX_THREADS 8
+#define PREVIEW_POOL_TASKS_PER_THREAD 16
+
+preview_pool_t* preview_pool_create(const preview_pool_config_t *config);
+
+// Queues a preview of the file at path, whose size the caller already
+// knows. path and item must stay valid until the task is emitted. Waits
+// while queue_depth tasks are not yet emitted; returns false once the pool
+// is finishing.
+bool preview_pool_submit(preview_pool_t *pool, const char *path, uint64_t size, const void *item);
+
+// Accepts nothing more, waits until every task has been emitted and stops
+// the threads.
+void preview_pool_finish(preview_pool_t *pool);
+
+// Finishes first if needed.
+void preview_pool_destroy(preview_pool_t *pool);
+
+#endif
@@ -0,0 +1,961 @@
+#include "dfa.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DFA_MAX_REPEAT 255            // largest bound accepted in {n,m}
+#define DFA_MAX_PROGRAM 16384         // instructions, after expanding repeats
+#define DFA_MAX_STATES 512            // cached states per thread before a flush
+#define DFA_HASH_SIZE (DFA_MAX_STATES * 2)
+
+typedef struct {
+    uint32_t bits[8];
+} dfa_set_t;
+
+static void dfa_set_add(dfa_set_t *set, unsigned char c) {
+    set->bits[c >> 5] |= 1u << (c & 31);
+}
+
+static bool dfa_set_has(const dfa_set_t *set, unsigned char c) {
+    return (set->bits[c >> 5] >> (c & 31)) & 1u;
+}
+
+static void dfa_set_add_range(dfa_set_t *set, unsigned lo, unsigned hi) {
+    for (unsigned c = lo; c <= hi; c++) {
+        dfa_set_add(set, (unsigned char)c);
+    }
+}
+
+static unsigned char dfa_lower(unsigned char c) {
+    return c >= 'A' && c <= 'Z' ? (unsigned char)(c - 'A' + 'a') : c;
+}
+
+// Adds the other case of every ASCII letter already in the set.
+static void dfa_set_fold(dfa_set_t *set) {
+    for (unsigned c = 'a'; c <= 'z'; c++) {
+        unsigned upper = c - 'a' + 'A';
+        if (dfa_set_has(set, (unsigned char)c) || dfa_set_has(set, (unsigned char)upper)) {
+            dfa_set_add(set, (unsigned char)c);
+            dfa_set_add(set, (unsigned char)upper);
+        }
+    }
+}
+
+// ---- Parsing -------------------------------------------------------------
+
+typedef enum {
+    DFA_NODE_CLASS,
+    DFA_NODE_EMPTY,
+    DFA_NODE_CONCAT,
+    DFA_NODE_ALT,
+    DFA_NODE_STAR,
+    DFA_NODE_PLUS,
+    DFA_NODE_QUEST,
+    DFA_NODE_BOL,
+    DFA_NODE_EOL
+} dfa_node_type_t;
+
+// Nodes refer to each other by index; a repeat reuses its operand's index,
+// which is compiled once per use.
+typedef struct {
+    dfa_node_type_t type;
+    int left;
+    int right;
+    uint32_t set;                     // DFA_NODE_CLASS
+    int literal;                      // the byte of a plain literal, else -1
+} dfa_node_t;
+
+typedef struct {
+    const unsigned char *p;
+    bool case_sensitive;
+    bool error;
+    dfa_node_t *nodes;
+    size_t node_count;
+    size_t node_capacity;
+    dfa_set_t *sets;
+    size_t set_count;
+    size_t set_capacity;
+} dfa_parser_t;
+
+static int dfa_node(dfa_parser_t *parser, dfa_node_type_t type, int left, int right) {
+    if (parser->error) return -1;
+
+    if (parser->node_count == parser->node_capacity) {
+        size_t capacity = parser->node_capacity ? parser->node_capacity * 2 : 64;
+        dfa_node_t *grown = realloc(parser->nodes, capacity * sizeof(dfa_node_t));
+        if (!grown) {
+            parser->error = true;
+            return -1;
+        }
+        parser->nodes = grown;
+        parser->node_capacity = capacity;
+    }
+
+    dfa_node_t *node = &parser->nodes[parser->node_count];
+    node->type = type;
+    node->left = left;
+    node->right = right;
+    node->set = 0;
+    node->literal = -1;
+    return (int)parser->node_count++;
+}
+
+static int dfa_class_node(dfa_parser_t *parser, const dfa_set_t *set, int literal) {
+    if (parser->set_count == parser->set_capacity) {
+        size_t capacity = parser->set_capacity ? parser->set_capacity * 2 : 16;
+        dfa_set_t *grown = realloc(parser->sets, capacity * sizeof(dfa_set_t));
+        if (!grown) {
+            parser->error = true;
+            return -1;
+        }
+        parser->sets = grown;
+        parser->set_capacity = capacity;
+    }
+
+    int index = dfa_node(parser, DFA_NODE_CLASS, -1, -1);
+    if (index < 0) return -1;
+
+    dfa_set_t folded = *set;
+    if (!parser->case_sensitive) {
+        dfa_set_fold(&folded);
+    }
+    parser->sets[parser->set_count] = folded;
+    parser->nodes[index].set = (uint32_t)parser->set_count++;
+    parser->nodes[index].literal = literal;
+    return index;
+}
+
+static int dfa_hex_digit(unsigned char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parses the escape after a backslash into a set. Returns the byte for
+// single-byte escapes, -1 for classes like \d, or -2 on an error.
+static int dfa_parse_escape(dfa_parser_t *parser, dfa_set_t *set) {
+    unsigned char c = *parser->p;
+    if (!c) return -2;
+    parser->p++;
+
+    dfa_set_t shorthand = {{0}};
+    bool negate = false;
+    switch (c) {
+        case 'd': case 'D':
+            dfa_set_add_range(&shorthand, '0', '9');
+            negate = c == 'D';
+            break;
+        case 'w': case 'W':
+            dfa_set_add_range(&shorthand, 'a', 'z');
+            dfa_set_add_range(&shorthand, 'A', 'Z');
+            dfa_set_add_range(&shorthand, '0', '9');
+            dfa_set_add(&shorthand, '_');
+            negate = c == 'W';
+            break;
+        case 's': case 'S':
+            dfa_set_add(&shorthand, ' ');
+            dfa_set_add_range(&shorthand, '\t', '\r');
+            negate = c == 'S';
+            break;
+        case 't': dfa_set_add(set, '\t'); return '\t';
+        case 'n': dfa_set_add(set, '\n'); return '\n';
+        case 'r': dfa_set_add(set, '\r'); return '\r';
+        case 'f': dfa_set_add(set, '\f'); return '\f';
+        case 'v': dfa_set_add(set, '\v'); return '\v';
+        case 'x': {
+            int hi = dfa_hex_digit(parser->p[0]);
+            int lo = hi >= 0 ? dfa_hex_digit(parser->p[1]) : -1;
+            if (lo < 0) return -2;
+            parser->p += 2;
+            unsigned char byte = (unsigned char)(hi * 16 + lo);
+            dfa_set_add(set, byte);
+            return byte;
+        }
+        default:
+            // Letters and digits are reserved for escapes we do not support.
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+                return -2;
+            }
+            dfa_set_add(set, c);
+            return c;
+    }
+
+    for (size_t i = 0; i < 8; i++) {
+        set->bits[i] |= negate ? ~shorthand.bits[i] : shorthand.bits[i];
+    }
+    return -1;
+}
+
+static int dfa_parse_bracket(dfa_parser_t *parser) {
+    dfa_set_t set = {{0}};
+    bool negate = false;
+    if (*parser->p == '^') {
+        negate = true;
+        parser->p++;
+    }
+
+    bool first = true;
+    while (*parser->p && (*parser->p != ']' || first)) {
+        first = false;
+
+        int lo;
+        if (*parser->p == '\\') {
+            parser->p++;
+            lo = dfa_parse_escape(parser, &set);
+            if (lo == -2) {
+                parser->error = true;
+                return -1;
+            }
+            if (lo == -1) continue;
+        } else {
+            lo = *parser->p++;
+            dfa_set_add(&set, (unsigned char)lo);
+        }
+
+        if (parser->p[0] == '-' && parser->p[1] && parser->p[1] != ']') {
+            parser->p++;
+            int hi;
+            if (*parser->p == '\\') {
+                parser->p++;
+                dfa_set_t ignored = {{0}};
+                hi = dfa_parse_escape(parser, &ignored);
+                if (hi < 0) {
+                    parser->error = true;
+                    return -1;
+                }
+            } else {
+                hi = *parser->p++;
+            }
+            if (hi < lo) {
+                parser->error = true;
+                return -1;
+            }
+            dfa_set_add_range(&set, (unsigned)lo, (unsigned)hi);
+        }
+    }
+
+    if (*parser->p != ']') {
+        parser->error = true;
+        return -1;
+    }
+    parser->p++;
+
+    if (!parser->case_sensitive) {
+        dfa_set_fold(&set);
+    }
+    if (negate) {
+        for (size_t i = 0; i < 8; i++) {
+            set.bits[i] = ~set.bits[i];
+        }
+    }
+    return dfa_class_node(parser, &set, -1);
+}
+
+static int dfa_parse_alt(dfa_parser_t *parser);
+
+static int dfa_parse_atom(dfa_parser_t *parser) {
+    unsigned char c = *parser->p;
+    dfa_set_t set = {{0}};
+
+    switch (c) {
+        case '(': {
+            parser->p++;
+            if (parser->p[0] == '?' && parser->p[1] == ':') {
+                parser->p += 2;
+            }
+            int inner = dfa_parse_alt(parser);
+            if (*parser->p != ')') {
+                parser->error = true;
+                return -1;
+            }
+            parser->p++;
+            return inner;
+        }
+        case '[':
+            parser->p++;
+            return dfa_parse_bracket(parser);
+        case '.':
+            parser->p++;
+            dfa_set_add_range(&set, 0, 255);
+            return dfa_class_node(parser, &set, -1);
+        case '^':
+            parser->p++;
+            return dfa_node(parser, DFA_NODE_BOL, -1, -1);
+        case '$':
+            parser->p++;
+            return dfa_node(parser, DFA_NODE_EOL, -1, -1);
+        case '\\': {
+            parser->p++;
+            int byte = dfa_parse_escape(parser, &set);
+            if (byte == -2) {
+                parser->error = true;
+                return -1;
+            }
+            return dfa_class_node(parser, &set, byte >= 0 && !parser->case_sensitive ? dfa_lower((unsigned char)byte) : byte);
+        }
+        case '*': case '+': case '?':
+            parser->error = true;     // nothing to repeat
+            return -1;
+        default:
+            parser->p++;
+            dfa_set_add(&set, c);
+            return dfa_class_node(parser, &set, parser->case_sensitive ? c : dfa_lower(c));
+    }
+}
+
+static bool dfa_parse_number(dfa_parser_t *parser, int *value) {
+    if (*parser->p < '0' || *parser->p > '9') return false;
+    int number = 0;
+    while (*parser->p >= '0' && *parser->p <= '9') {
+        number = number * 10 + (*parser->p++ - '0');
+        if (number > DFA_MAX_REPEAT) return false;
+    }
+    *value = number;
+    return true;
+}
+
+// x{min,max} becomes min copies of x followed by x* or by max-min of x?.
+static int dfa_expand_repeat(dfa_parser_t *parser, int atom, int min, int max) {
+    int result = -1;
+    for (int i = 0; i < min; i++) {
+        result = result < 0 ? atom : dfa_node(parser, DFA_NODE_CONCAT, result, atom);
+    }
+    if (max < 0) {
+        int star = dfa_node(parser, DFA_NODE_STAR, atom, -1);
+        result = result < 0 ? star : dfa_node(parser, DFA_NODE_CONCAT, result, star);
+    } else {
+        for (int i = min; i < max; i++) {
+            int quest = dfa_node(parser, DFA_NODE_QUEST, atom, -1);
+            result = result < 0 ? quest : dfa_node(parser, DFA_NODE_CONCAT, result, quest);
+        }
+    }
+    return result < 0 ? dfa_node(parser, DFA_NODE_EMPTY, -1, -1) : result;
+}
+
+static int dfa_parse_repeat(dfa_parser_t *parser) {
+    int atom = dfa_parse_atom(parser);
+
+    while (!parser->error) {
+        unsigned char c = *parser->p;
+        if (c == '*' || c == '+' || c == '?') {
+            parser->p++;
+            dfa_node_type_t type = c == '*' ? DFA_NODE_STAR : c == '+' ? DFA_NODE_PLUS : DFA_NODE_QUEST;
+            atom = dfa_node(parser, type, atom, -1);
+        } else if (c == '{' && parser->p[1] >= '0' && parser->p[1] <= '9') {
+            parser->p++;
+            int min = 0;
+            int max = 0;
+            bool ok = dfa_parse_number(parser, &min);
+            if (ok && *parser->p == ',') {
+                parser->p++;
+                max = -1;
+                if (*parser->p != '}') {
+                    ok = dfa_parse_number(parser, &max) && max >= min;
+                }
+            } else {
+                max = min;
+            }
+            if (!ok || *parser->p != '}') {
+                parser->error = true;
+                return -1;
+            }
+            parser->p++;
+            atom = dfa_expand_repeat(parser, atom, min, max);
+        } else {
+            break;
+        }
+
+        // Laziness only changes which match is reported, not whether a
+        // line matches.
+        if (*parser->p == '?') {
+            parser->p++;
+        }
+    }
+    return atom;
+}
+
+static int dfa_parse_concat(dfa_parser_t *parser) {
+    int result = -1;
+    while (!parser->error && *parser->p && *parser->p != '|' && *parser->p != ')') {
+        int item = dfa_parse_repeat(parser);
+        result = result < 0 ? item : dfa_node(parser, DFA_NODE_CONCAT, result, item);
+    }
+    return result < 0 ? dfa_node(parser, DFA_NODE_EMPTY, -1, -1) : result;
+}
+
+static int dfa_parse_alt(dfa_parser_t *parser) {
+    int left = dfa_parse_concat(parser);
+    while (!parser->error && *parser->p == '|') {
+        parser->p++;
+        int right = dfa_parse_concat(parser);
+        left = dfa_node(parser, DFA_NODE_ALT, left, right);
+    }
+    return left;
+}
+
+// ---- Compilation to an NFA program ---------------------------------------
+
+typedef enum {
+    DFA_OP_CLASS,                     // consume a byte in sets[arg], go to x
+    DFA_OP_SPLIT,                     // go to x and y
+    DFA_OP_JMP,
+    DFA_OP_BOL,
+    DFA_OP_EOL,
+    DFA_OP_MATCH
+} dfa_op_t;
+
+typedef struct {
+    uint8_t op;
+    uint32_t arg;
+    uint32_t x;
+    uint32_t y;
+} dfa_inst_t;
+
+struct dfa_program {
+    dfa_inst_t *insts;
+    size_t inst_count;
+    dfa_set_t *sets;
+    uint8_t byte_class[256];          // bytes no set tells apart share a class
+    unsigned char class_byte[256];    // one byte of each class
+    size_t class_count;
+    char *literal;
+};
+
+// Nested repeats can multiply a small pattern into a huge one, even when
+// the copies are empty and emit nothing, so every node visited is counted.
+typedef struct {
+    dfa_program_t *program;
+    size_t capacity;
+    size_t budget;
+    const dfa_node_t *nodes;
+} dfa_compiler_t;
+
+static bool dfa_emit(dfa_compiler_t *compiler, dfa_op_t op, uint32_t arg, uint32_t x, uint32_t y) {
+    dfa_program_t *program = compiler->program;
+    if (program->inst_count == compiler->capacity) return false;
+    dfa_inst_t *inst = &program->insts[program->inst_count++];
+    inst->op = (uint8_t)op;
+    inst->arg = arg;
+    inst->x = x;
+    inst->y = y;
+    return true;
+}
+
+static bool dfa_compile_node(dfa_compiler_t *compiler, int index) {
+    if (compiler->budget == 0) return false;
+    compiler->budget--;
+
+    dfa_program_t *program = compiler->program;
+    const dfa_node_t *node = &compiler->nodes[index];
+    uint32_t pc = (uint32_t)program->inst_count;
+
+    switch (node->type) {
+        case DFA_NODE_EMPTY:
+            return true;
+        case DFA_NODE_CLASS:
+            return dfa_emit(compiler, DFA_OP_CLASS, node->set, pc + 1, 0);
+        case DFA_NODE_BOL:
+            return dfa_emit(compiler, DFA_OP_BOL, 0, pc + 1, 0);
+        case DFA_NODE_EOL:
+            return dfa_emit(compiler, DFA_OP_EOL, 0, pc + 1, 0);
+        case DFA_NODE_CONCAT:
+            return dfa_compile_node(compiler, node->left) && dfa_compile_node(compiler, node->right);
+        case DFA_NODE_ALT: {
+            if (!dfa_emit(compiler, DFA_OP_SPLIT, 0, pc + 1, 0) || !dfa_compile_node(compiler, node->left)) {
+                return false;
+            }
+            uint32_t jump = (uint32_t)program->inst_count;
+            if (!dfa_emit(compiler, DFA_OP_JMP, 0, 0, 0)) return false;
+            program->insts[pc].y = (uint32_t)program->inst_count;
+            if (!dfa_compile_node(compiler, node->right)) return false;
+            program->insts[jump].x = (uint32_t)program->inst_count;
+            return true;
+        }
+        case DFA_NODE_STAR:
+            if (!dfa_emit(compiler, DFA_OP_SPLIT, 0, pc + 1, 0) ||
+                !dfa_compile_node(compiler, node->left) ||
+                !dfa_emit(compiler, DFA_OP_JMP, 0, pc, 0)) {
+                return false;
+            }
+            program->insts[pc].y = (uint32_t)program->inst_count;
+            return true;
+        case DFA_NODE_PLUS:
+            if (!dfa_compile_node(compiler, node->left)) return false;
+            return dfa_emit(compiler, DFA_OP_SPLIT, 0, pc, (uint32_t)program->inst_count + 1);
+        case DFA_NODE_QUEST:
+            if (!dfa_emit(compiler, DFA_OP_SPLIT, 0, pc + 1, 0) || !dfa_compile_node(compiler, node->left)) {
+                return false;
+            }
+            program->insts[pc].y = (uint32_t)program->inst_count;
+            return true;
+    }
+    return false;
+}
+
+static void dfa_flatten_concat(const dfa_node_t *nodes, int index, int *items, size_t *count, size_t capacity) {
+    if (*count == capacity) return;
+    if (nodes[index].type == DFA_NODE_CONCAT) {
+        dfa_flatten_concat(nodes, nodes[index].left, items, count, capacity);
+        dfa_flatten_concat(nodes, nodes[index].right, items, count, capacity);
+    } else {
+        items[(*count)++] = index;
+    }
+}
+
+// Longest run of plain literals in the top-level concatenation; anything
+// under an alternation or a repeat is optional and cannot be required.
+static char* dfa_find_literal(const dfa_node_t *nodes, size_t capacity, int root) {
+    int *items = malloc(capacity * sizeof(int));
+    if (!items) return NULL;
+
+    size_t count = 0;
+    dfa_flatten_concat(nodes, root, items, &count, capacity);
+
+    size_t best_start = 0;
+    size_t best_length = 0;
+    size_t run_start = 0;
+    for (size_t i = 0; i <= count; i++) {
+        bool literal = i < count && nodes[items[i]].type == DFA_NODE_CLASS && nodes[items[i]].literal > 0;
+        if (literal) continue;
+        if (i - run_start > best_length) {
+            best_start = run_start;
+            best_length = i - run_start;
+        }
+        run_start = i + 1;
+    }
+
+    char *text = NULL;
+    if (best_length > 0 && (text = malloc(best_length + 1)) != NULL) {
+        for (size_t i = 0; i < best_length; i++) {
+            text[i] = (char)nodes[items[best_start + i]].literal;
+        }
+        text[best_length] = '\0';
+    }
+    free(items);
+    return text;
+}
+
+// Numbers runs of bytes that every set treats alike, so transition tables
+// have one column per run instead of one per byte.
+static void dfa_compute_byte_classes(dfa_program_t *program, size_t set_count) {
+    bool boundary[256] = {false};
+    for (size_t s = 0; s < set_count; s++) {
+        for (unsigned c = 1; c < 256; c++) {
+            if (dfa_set_has(&program->sets[s], (unsigned char)c) != dfa_set_has(&program->sets[s], (unsigned char)(c - 1))) {
+                boundary[c] = true;
+            }
+        }
+    }
+
+    size_t class_index = 0;
+    program->class_byte[0] = 0;
+    for (unsigned c = 0; c < 256; c++) {
+        if (c > 0 && boundary[c]) {
+            class_index++;
+            program->class_byte[class_index] = (unsigned char)c;
+        }
+        program->byte_class[c] = (uint8_t)class_index;
+    }
+    program->class_count = class_index + 1;
+}
+
+dfa_program_t* dfa_compile(const char *pattern, bool case_sensitive) {
+    if (!pattern) return NULL;
+
+    dfa_parser_t parser = {0};
+    parser.p = (const unsigned char*)pattern;
+    parser.case_sensitive = case_sensitive;
+
+    int root = dfa_parse_alt(&parser);
+    dfa_program_t *program = NULL;
+    if (parser.error || root < 0 || *parser.p != '\0') {
+        goto cleanup;
+    }
+
+    program = calloc(1, sizeof(dfa_program_t));
+    if (!program) goto cleanup;
+
+    dfa_compiler_t compiler = { program, DFA_MAX_PROGRAM - 1, DFA_MAX_PROGRAM * 4, parser.nodes };
+    program->insts = malloc(DFA_MAX_PROGRAM * sizeof(dfa_inst_t));
+    if (!program->insts || !dfa_compile_node(&compiler, root)) {
+        dfa_program_free(program);
+        program = NULL;
+        goto cleanup;
+    }
+    compiler.capacity = DFA_MAX_PROGRAM;
+    if (!dfa_emit(&compiler, DFA_OP_MATCH, 0, 0, 0)) {
+        dfa_program_free(program);
+        program = NULL;
+        goto cleanup;
+    }
+
+    program->sets = parser.sets;
+    parser.sets = NULL;
+    dfa_compute_byte_classes(program, parser.set_count);
+    program->literal = dfa_find_literal(parser.nodes, DFA_MAX_PROGRAM, root);
+
+cleanup:
+    free(parser.nodes);
+    free(parser.sets);
+    return program;
+}
+
+void dfa_program_free(dfa_program_t *program) {
+    if (!program) return;
+    free(program->insts);
+    free(program->sets);
+    free(program->literal);
+    free(program);
+}
+
+const char* dfa_required_literal(const dfa_program_t *program) {
+    return program ? program->literal : NULL;
+}
+
+// ---- Lazy DFA ------------------------------------------------------------
+
+// A DFA state is the sorted set of NFA instructions that consume a byte,
+// match, or wait for the end of the line. Each also carries the start of
+// the program, so a match may begin at any byte.
+
+#define DFA_STATE_MATCH 0x01
+#define DFA_STATE_EOL_KNOWN 0x02       // the two below are cached per state,
+#define DFA_STATE_EOL_MATCH 0x04       // once for lines that had bytes and
+#define DFA_STATE_EMPTY_KNOWN 0x08     // once for empty lines, where '^' after
+#define DFA_STATE_EMPTY_MATCH 0x10     // '$' still holds
+
+struct dfa_cache {
+    const dfa_program_t *program;
+    size_t state_count;
+    int32_t *transitions;             // state_count x class_count, -1 = not built
+    uint8_t *flags;
+    uint32_t *set_start;              // offset of each state's set in pool
+    uint32_t *set_length;
+    uint32_t *pool;
+    size_t pool_used;
+    size_t pool_capacity;
+    int32_t hash[DFA_HASH_SIZE];
+    int32_t start_state;              // at the start of a line, or -1
+
+    // Scratch space for building a state.
+    uint32_t *marks;
+    uint32_t generation;
+    uint32_t *stack;
+    uint32_t *building;
+    size_t building_count;
+};
+
+dfa_cache_t* dfa_cache_create(const dfa_program_t *program) {
+    if (!program) return NULL;
+
+    dfa_cache_t *cache = calloc(1, sizeof(dfa_cache_t));
+    if (!cache) return NULL;
+
+    size_t insts = program->inst_count;
+    cache->program = program;
+    cache->pool_capacity = DFA_MAX_STATES * 16 > insts * 4 ? DFA_MAX_STATES * 16 : insts * 4;
+    cache->transitions = malloc(DFA_MAX_STATES * program->class_count * sizeof(int32_t));
+    cache->flags = malloc(DFA_MAX_STATES);
+    cache->set_start = malloc(DFA_MAX_STATES * sizeof(uint32_t));
+    cache->set_length = malloc(DFA_MAX_STATES * sizeof(uint32_t));
+    cache->pool = malloc(cache->pool_capacity * sizeof(uint32_t));
+    cache->marks = calloc(insts, sizeof(uint32_t));
+    cache->stack = malloc(insts * sizeof(uint32_t));
+    cache->building = malloc(insts * sizeof(uint32_t));
+
+    if (!cache->transitions || !cache->flags || !cache->set_start || !cache->set_length ||
+        !cache->pool || !cache->marks || !cache->stack || !cache->building) {
+        dfa_cache_free(cache);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < DFA_HASH_SIZE; i++) {
+        cache->hash[i] = -1;
+    }
+    cache->start_state = -1;
+    return cache;
+}
+
+void dfa_cache_free(dfa_cache_t *cache) {
+    if (!cache) return;
+    free(cache->transitions);
+    free(cache->flags);
+    free(cache->set_start);
+    free(cache->set_length);
+    free(cache->pool);
+    free(cache->marks);
+    free(cache->stack);
+    free(cache->building);
+    free(cache);
+}
+
+static void dfa_cache_flush(dfa_cache_t *cache) {
+    cache->state_count = 0;
+    cache->pool_used = 0;
+    cache->start_state = -1;
+    for (size_t i = 0; i < DFA_HASH_SIZE; i++) {
+        cache->hash[i] = -1;
+    }
+}
+
+static void dfa_begin_set(dfa_cache_t *cache) {
+    cache->building_count = 0;
+    if (++cache->generation == 0) {
+        memset(cache->marks, 0, cache->program->inst_count * sizeof(uint32_t));
+        cache->generation = 1;
+    }
+}
+
+// Adds everything reachable from pc without consuming a byte.
+static void dfa_add_closure(dfa_cache_t *cache, uint32_t pc, bool at_line_start) {
+    const dfa_inst_t *insts = cache->program->insts;
+    size_t depth = 0;
+
+    if (cache->marks[pc] == cache->generation) return;
+    cache->marks[pc] = cache->generation;
+    cache->stack[depth++] = pc;
+
+    while (depth > 0) {
+        const dfa_inst_t *inst = &insts[cache->stack[--depth]];
+        uint32_t next[2];
+        size_t next_count = 0;
+
+        switch (inst->op) {
+            case DFA_OP_CLASS:
+            case DFA_OP_EOL:
+            case DFA_OP_MATCH:
+                cache->building[cache->building_count++] = (uint32_t)(inst - insts);
+                break;
+            case DFA_OP_SPLIT:
+                next[next_count++] = inst->x;
+                next[next_count++] = inst->y;
+                break;
+            case DFA_OP_JMP:
+                next[next_count++] = inst->x;
+                break;
+            case DFA_OP_BOL:
+                if (at_line_start) {
+                    next[next_count++] = inst->x;
+                }
+                break;
+        }
+
+        for (size_t i = 0; i < next_count; i++) {
+            if (cache->marks[next[i]] != cache->generation) {
+                cache->marks[next[i]] = cache->generation;
+                cache->stack[depth++] = next[i];
+            }
+        }
+    }
+}
+
+static int dfa_compare_pc(const void *a, const void *b) {
+    uint32_t left = *(const uint32_t*)a;
+    uint32_t right = *(const uint32_t*)b;
+    return left < right ? -1 : left > right;
+}
+
+static uint32_t dfa_hash_set(const uint32_t *set, size_t count) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < count; i++) {
+        hash = (hash ^ set[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Finds or adds the state for the set being built. Returns -1 when the
+// cache is full; the caller flushes it and tries again.
+static int32_t dfa_intern_set(dfa_cache_t *cache) {
+    const dfa_program_t *program = cache->program;
+    size_t count = cache->building_count;
+    qsort(cache->building, count, sizeof(uint32_t), dfa_compare_pc);
+
+    size_t slot = dfa_hash_set(cache->building, count) % DFA_HASH_SIZE;
+    while (cache->hash[slot] >= 0) {
+        int32_t state = cache->hash[slot];
+        if (cache->set_length[state] == count &&
+            memcmp(cache->pool + cache->set_start[state], cache->building, count * sizeof(uint32_t)) == 0) {
+            return state;
+        }
+        slot = (slot + 1) % DFA_HASH_SIZE;
+    }
+
+    if (cache->state_count == DFA_MAX_STATES || cache->pool_used + count > cache->pool_capacity) {
+        return -1;
+    }
+
+    int32_t state = (int32_t)cache->state_count++;
+    cache->hash[slot] = state;
+    cache->set_start[state] = (uint32_t)cache->pool_used;
+    cache->set_length[state] = (uint32_t)count;
+    memcpy(cache->pool + cache->pool_used, cache->building, count * sizeof(uint32_t));
+    cache->pool_used += count;
+
+    uint8_t flags = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (program->insts[cache->building[i]].op == DFA_OP_MATCH) {
+            flags |= DFA_STATE_MATCH;
+        }
+    }
+    cache->flags[state] = flags;
+
+    int32_t *row = cache->transitions + (size_t)state * program->class_count;
+    for (size_t i = 0; i < program->class_count; i++) {
+        row[i] = -1;
+    }
+    return state;
+}
+
+static int32_t dfa_start_state(dfa_cache_t *cache) {
+    if (cache->start_state < 0) {
+        dfa_begin_set(cache);
+        dfa_add_closure(cache, 0, true);
+        cache->start_state = dfa_intern_set(cache);
+        if (cache->start_state < 0) {
+            dfa_cache_flush(cache);
+            dfa_begin_set(cache);
+            dfa_add_closure(cache, 0, true);
+            cache->start_state = dfa_intern_set(cache);
+        }
+    }
+    return cache->start_state;
+}
+
+// Builds the transition from state on bytes of the given class. A full
+// cache is flushed first, so the returned index may be the only one left.
+static int32_t dfa_step(dfa_cache_t *cache, int32_t state, uint8_t byte_class) {
+    const dfa_program_t *program = cache->program;
+    unsigned char byte = program->class_byte[byte_class];
+
+    dfa_begin_set(cache);
+    const uint32_t *set = cache->pool + cache->set_start[state];
+    for (size_t i = 0; i < cache->set_length[state]; i++) {
+        const dfa_inst_t *inst = &program->insts[set[i]];
+        if (inst->op == DFA_OP_CLASS && dfa_set_has(&program->sets[inst->arg], byte)) {
+            dfa_add_closure(cache, inst->x, false);
+        }
+    }
+    dfa_add_closure(cache, 0, false);
+
+    int32_t next = dfa_intern_set(cache);
+    if (next < 0) {
+        // The set being built lives in scratch space, so it survives.
+        dfa_cache_flush(cache);
+        next = dfa_intern_set(cache);
+        return next;
+    }
+
+    cache->transitions[(size_t)state * program->class_count + byte_class] = next;
+    return next;
+}
+
+// Whether the line would match if it ended in this state.
+static bool dfa_matches_at_eol(dfa_cache_t *cache, int32_t state, bool empty_line) {
+    uint8_t known = empty_line ? DFA_STATE_EMPTY_KNOWN : DFA_STATE_EOL_KNOWN;
+    uint8_t match = empty_line ? DFA_STATE_EMPTY_MATCH : DFA_STATE_EOL_MATCH;
+    uint8_t flags = cache->flags[state];
+    if (flags & known) {
+        return (flags & match) != 0;
+    }
+
+    const dfa_program_t *program = cache->program;
+    const uint32_t *set = cache->pool + cache->set_start[state];
+    bool matched = false;
+
+    dfa_begin_set(cache);
+    for (size_t i = 0; i < cache->set_length[state] && !matched; i++) {
+        if (program->insts[set[i]].op != DFA_OP_EOL) continue;
+
+        // Past '$' only more anchors and the end of the program can follow.
+        uint32_t start = program->insts[set[i]].x;
+        size_t depth = 0;
+        if (cache->marks[start] != cache->generation) {
+            cache->marks[start] = cache->generation;
+            cache->stack[depth++] = start;
+        }
+        while (depth > 0 && !matched) {
+            const dfa_inst_t *inst = &program->insts[cache->stack[--depth]];
+            uint32_t next[2];
+            size_t next_count = 0;
+
+            switch (inst->op) {
+                case DFA_OP_MATCH:
+                    matched = true;
+                    break;
+                case DFA_OP_SPLIT:
+                    next[next_count++] = inst->x;
+                    next[next_count++] = inst->y;
+                    break;
+                case DFA_OP_JMP:
+                case DFA_OP_EOL:
+                    next[next_count++] = inst->x;
+                    break;
+                case DFA_OP_BOL:
+                    if (empty_line) {
+                        next[next_count++] = inst->x;
+                    }
+                    break;
+                default:
+                    break;
+            }
+
+            for (size_t j = 0; j < next_count; j++) {
+                if (cache->marks[next[j]] != cache->generation) {
+                    cache->marks[next[j]] = cache->generation;
+                    cache->stack[depth++] = next[j];
+                }
+            }
+        }
+    }
+
+    cache->flags[state] = (uint8_t)(flags | known | (matched ? match : 0));
+    return matched;
+}
+
+void dfa_line_begin(dfa_cache_t *cache, dfa_line_t *line) {
+    line->state = dfa_start_state(cache);
+    line->empty = true;
+    line->matched = line->state >= 0 && (cache->flags[line->state] & DFA_STATE_MATCH);
+}
+
+void dfa_line_feed(dfa_cache_t *cache, dfa_line_t *line, const unsigned char *data, size_t length) {
+    if (line->matched || line->state < 0 || length == 0) return;
+    line->empty = false;
+
+    const dfa_program_t *program = cache->program;
+    const uint8_t *byte_class = program->byte_class;
+    size_t class_count = program->class_count;
+    int32_t state = line->state;
+
+    for (size_t i = 0; i < length; i++) {
+        uint8_t c = byte_class[data[i]];
+        int32_t next = cache->transitions[(size_t)state * class_count + c];
+        if (next < 0) {
+            next = dfa_step(cache, state, c);
+            if (next < 0) {
+                state = -1;
+                break;
+            }
+        }
+        state = next;
+        if (cache->flags[state] & DFA_STATE_MATCH) {
+            line->matched = true;
+            break;
+        }
+    }
+    line->state = state;
+}
+
+bool dfa_line_end(dfa_cache_t *cache, dfa_line_t *line) {
+    if (line->matched) return true;
+    if (line->state < 0) return false;
+    line->matched = dfa_matches_at_eol(cache, line->state, line->empty);
+    return line->matched;
+}
+
+bool dfa_match_line(dfa_cache_t *cache, const unsigned char *data, size_t length) {
+    dfa_line_t line;
+    dfa_line_begin(cache, &line);
+    dfa_line_feed(cache, &line, data, length);
+    return dfa_line_end(cache, &line);
+}
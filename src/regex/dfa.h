@@ -0,0 +1,52 @@
+#ifndef DFA_H
+#define DFA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte-oriented regexes for content search, matched line by line like grep:
+// a line matches when any part of it does, '^' and '$' anchor to the line,
+// and nothing matches across a line break.
+//
+// Supports literals, '.', [classes] with ranges and negation, \d \w \s and
+// their negations, \t \n \r \f \v \xHH, escaped punctuation, grouping with
+// (...) and (?:...), '|', and the quantifiers * + ? {n} {n,} {n,m} (a
+// trailing '?' for laziness is accepted and ignored). Everything works on
+// bytes, so '.' matches one byte of a multibyte UTF-8 character.
+//
+// The compiled program is immutable and can be shared between threads. The
+// DFA is built lazily from it, one state at a time, in a per-thread cache of
+// fixed size that is flushed and rebuilt when full; memory use does not
+// depend on how much text is scanned.
+
+typedef struct dfa_program dfa_program_t;
+typedef struct dfa_cache dfa_cache_t;
+
+// Returns NULL on a syntax error or an unsupported construct (back
+// references, \b and friends).
+dfa_program_t* dfa_compile(const char *pattern, bool case_sensitive);
+void dfa_program_free(dfa_program_t *program);
+
+// The longest literal that every match must contain, or NULL. It is
+// lower-cased when the program ignores case (ASCII only).
+const char* dfa_required_literal(const dfa_program_t *program);
+
+dfa_cache_t* dfa_cache_create(const dfa_program_t *program);
+void dfa_cache_free(dfa_cache_t *cache);
+
+// A line can be fed in pieces, so it may span read buffers. The line must
+// not include its terminating '\n'.
+typedef struct {
+    int32_t state;
+    bool matched;
+    bool empty;
+} dfa_line_t;
+
+void dfa_line_begin(dfa_cache_t *cache, dfa_line_t *line);
+void dfa_line_feed(dfa_cache_t *cache, dfa_line_t *line, const unsigned char *data, size_t length);
+bool dfa_line_end(dfa_cache_t *cache, dfa_line_t *line);
+
+bool dfa_match_line(dfa_cache_t *cache, const unsigned char *data, size_t length);
+
+#endif
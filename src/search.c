@@ -4,50 +4,111 @@
 #include "platform.h"
 #include "thread_pool.h"
 #include "criteria.h"
+#include "order.h"
+#include "topk.h"
+#include "du.h"
+#include "dupes.h"
+#include "archive.h"
+#include "ignore.h"
+#include "sync.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strsafe.h>
 
+#define SEARCH_CANCEL_CHECK_BATCH 64
+
+// Content searches of files this large are split into line-aligned ranges
+// of at least SEARCH_SPLIT_RANGE_SIZE bytes that workers scan in parallel.
+#define SEARCH_SPLIT_MIN_SIZE (64ull * 1024 * 1024)
+#define SEARCH_SPLIT_RANGE_SIZE (16ull * 1024 * 1024)
+#define SEARCH_SPLIT_MAX_RANGES 256
+
 static thread_pool_stats_t last_thread_stats = {0};
 static bool last_thread_stats_valid = false;
+static search_timing_t last_search_timing = {0};
+static bool last_search_timing_valid = false;
+static pipeline_stats_t last_pipeline_stats = {0};
+static bool last_pipeline_stats_valid = false;
 
 typedef struct {
     search_context_t *ctx;
-    char *directory_path;
+    const char *root;
     size_t depth;
+    order_node_t *order_node;
+    du_node_t *du_node;
+    ignore_stack_t *ignores;
+    skip_cursor_t skip_cursor;
+    bool boosted;                     // at or below a --boost directory
+    size_t size_class;
+    char directory_path[];            // stored inline, sized by size_class
 } directory_work_t;
 
-static const char* system_paths[] = {
-    "\\$Recycle.Bin", "\\System Volume Information", "\\Windows\\System32",
-    "\\Windows\\SysWOW64", "\\Program Files", "\\Program Files (x86)",
-    "\\ProgramData", "\\Recovery", "\\Intel", "\\AMD", "\\NVIDIA",
-    "\\hiberfil.sys", "\\pagefile.sys", "\\swapfile.sys"
-};
+// Path capacity of each directory work slab; most paths fit the first one.
+static const size_t directory_work_path_sizes[SEARCH_WORK_SIZE_CLASSES] = { 128, 256, MAX_PATH * 2 };
 
-static const char* skip_directories[] = {
-    "$RECYCLE.BIN", "System Volume Information", "Windows", "Program Files",
-    "Program Files (x86)", "ProgramData", "Recovery", "Intel", "AMD", "NVIDIA",
-    "node_modules", ".git", ".svn", "__pycache__", "obj", "bin", "Debug",
-    "Release", ".vs", "packages", "bower_components", "dist", "build"
-};
+static directory_work_t* directory_work_create(search_context_t *ctx, const char *path) {
+    size_t length = strlen(path) + 1;
+    size_t size_class = 0;
+    while (size_class < SEARCH_WORK_SIZE_CLASSES && length > directory_work_path_sizes[size_class]) {
+        size_class++;
+    }
+    if (size_class == SEARCH_WORK_SIZE_CLASSES) return NULL;
+
+    directory_work_t *work = slab_alloc(ctx->work_slabs[size_class], thread_pool_worker_index(ctx->thread_pool));
+    if (!work) return NULL;
+
+    memset(work, 0, sizeof(*work));
+    work->ctx = ctx;
+    work->size_class = size_class;
+    memcpy(work->directory_path, path, length);
+    return work;
+}
 
-bool is_system_directory(const char *path) {
-    if (!path) return false;
+static void directory_work_release(directory_work_t *work) {
+    search_context_t *ctx = work->ctx;
+    ignore_stack_release(work->ignores);
+    slab_free(ctx->work_slabs[work->size_class], thread_pool_worker_index(ctx->thread_pool), work);
+}
 
-    for (size_t i = 0; i < sizeof(system_paths) / sizeof(system_paths[0]); i++) {
-        if (strstr(path, system_paths[i])) return true;
+// Boost paths are either absolute or relative to the root being searched.
+static bool directory_is_boosted(const search_criteria_t *criteria, const char *root, const char *path) {
+    size_t root_len = strlen(root);
+    while (root_len > 0 && root[root_len - 1] == '\\') root_len--;
+
+    for (size_t i = 0; i < criteria->boost_paths_count; i++) {
+        const char *boost = criteria->boost_paths[i];
+        size_t boost_len = strlen(boost);
+        while (boost_len > 0 && boost[boost_len - 1] == '\\') boost_len--;
+        if (boost_len == 0) continue;
+
+        const char *candidate = path;
+        if (_strnicmp(path, boost, boost_len) != 0 || (path[boost_len] != '\0' && path[boost_len] != '\\')) {
+            if (_strnicmp(path, root, root_len) != 0 || path[root_len] != '\\') continue;
+            candidate = path + root_len + 1;
+            if (_strnicmp(candidate, boost, boost_len) != 0 ||
+                (candidate[boost_len] != '\0' && candidate[boost_len] != '\\')) {
+                continue;
+            }
+        }
+        return true;
     }
     return false;
 }
 
-bool should_skip_directory(const char *dirname, const search_criteria_t *criteria) {
-    if (!dirname || !criteria || !criteria->skip_common_dirs) return false;
+static void process_directory_work(void *context, void *user_data);
 
-    for (size_t i = 0; i < sizeof(skip_directories) / sizeof(skip_directories[0]); i++) {
-        if (_stricmp(dirname, skip_directories[i]) == 0) return true;
+// In shallow-first mode boosted trees come first, then everything else by depth.
+static bool directory_work_submit(search_context_t *ctx, directory_work_t *work) {
+    if (!ctx->shallow_first) {
+        return thread_pool_submit(ctx->thread_pool, process_directory_work, work);
     }
-    return false;
+
+    unsigned priority = 0;
+    if (!work->boosted) {
+        priority = work->depth < THREAD_POOL_PRIORITY_LEVELS ? (unsigned)work->depth + 1 : THREAD_POOL_PRIORITY_LEVELS;
+    }
+    return thread_pool_submit_priority(ctx->thread_pool, process_directory_work, work, priority);
 }
 
 search_result_t* create_search_result(const char *path, uint64_t size, FILETIME mtime) {
@@ -62,38 +123,85 @@ search_result_t* create_search_result(const char *path, uint64_t size, FILETIME
         return NULL;
     }
 
+    result->root = NULL;
     result->size = size;
     result->mtime = mtime;
+    result->found_ns = 0;
+    result->matches = NULL;
     result->next = NULL;
 
     return result;
 }
 
-static bool add_result_safe(search_context_t *ctx, const char *path, uint64_t size, FILETIME mtime) {
-    if (!ctx || !path) return false;
+// The consumer wants nothing more: stop accepting results and stop the walk.
+static void close_results(search_context_t *ctx) {
+    atomic_store(&ctx->results_closed, true);
+    cancel_token_cancel(&ctx->cancel, CANCEL_REASON_SATISFIED);
+}
+
+// Workers reuse their own read buffer; any other thread brings a temporary
+// one.
+static int content_search_on_thread(search_context_t *ctx, const char *path, uint64_t size,
+                                    uint64_t begin, uint64_t end,
+                                    content_match_t **matches, uint64_t *lines) {
+    size_t worker = thread_pool_worker_index(ctx->thread_pool);
+    if (worker < ctx->content_buffer_count) {
+        return content_search_range(ctx->content, &ctx->content_buffers[worker], path, size,
+                                    begin, end, &ctx->cancel, matches, lines);
+    }
+
+    content_buffer_t buffer = {0};
+    int status = content_search_range(ctx->content, &buffer, path, size, begin, end,
+                                      &ctx->cancel, matches, lines);
+    content_buffer_free(&buffer);
+    return status;
+}
+
+// Runs the content predicate on a file that passed every other criterion.
+// Unreadable files do not match.
+static bool content_matches(search_context_t *ctx, const char *path, uint64_t size,
+                            content_match_t **matches) {
+    return content_search_on_thread(ctx, path, size, 0, size, matches, NULL) > 0;
+}
 
-    if (atomic_load(&ctx->should_stop)) {
+// Takes ownership of matches, which may be NULL.
+static bool add_result_safe(search_context_t *ctx, const char *root, const char *path,
+                            uint64_t size, FILETIME mtime, content_match_t *matches) {
+    if (!ctx || !path) {
+        content_free_matches(matches);
+        return false;
+    }
+
+    if (atomic_load(&ctx->results_closed)) {
+        content_free_matches(matches);
         return false;
     }
 
     if (ctx->criteria->max_results > 0 &&
         atomic_load(&ctx->total_results) >= ctx->criteria->max_results) {
-        atomic_store(&ctx->should_stop, true);
+        close_results(ctx);
+        content_free_matches(matches);
         return false;
     }
 
     search_result_t *result = create_search_result(path, size, mtime);
-    if (!result) return false;
+    if (!result) {
+        content_free_matches(matches);
+        return false;
+    }
+    result->root = root;
+    result->matches = matches;
 
     bool continue_search = true;
     if (ctx->result_callback) {
         continue_search = ctx->result_callback(result, ctx->result_user_data);
         if (!continue_search) {
-            atomic_store(&ctx->should_stop, true);
+            close_results(ctx);
         }
     }
 
     EnterCriticalSection(&ctx->results_lock);
+    result->found_ns = sync_now_ns();
     if (!ctx->results_head) {
         ctx->results_head = result;
         ctx->results_tail = result;
@@ -106,12 +214,247 @@ static bool add_result_safe(search_context_t *ctx, const char *path, uint64_t si
 
     if (ctx->criteria->max_results > 0 &&
         atomic_load(&ctx->total_results) >= ctx->criteria->max_results) {
-        atomic_store(&ctx->should_stop, true);
+        close_results(ctx);
     }
 
     return continue_search;
 }
 
+typedef struct content_split content_split_t;
+
+typedef struct {
+    content_split_t *split;
+    uint64_t begin;
+    uint64_t end;
+    content_match_t *matches;         // numbered from the range's first line
+    uint64_t lines;                   // lines starting in the range
+    bool found;
+} content_range_t;
+
+// One large file whose ranges are searched as separate pool items. The
+// range that finishes last renumbers and joins the matches and reports the
+// file, so its lines come out in file order with exact numbers.
+struct content_split {
+    search_context_t *ctx;
+    const char *root;
+    char *path;
+    uint64_t size;
+    FILETIME mtime;
+    atomic_size_t remaining;
+    size_t range_count;
+    content_range_t ranges[];
+};
+
+static void content_split_finish(content_split_t *split) {
+    content_match_t *matches = NULL;
+    content_match_t **tail = &matches;
+    bool found = false;
+    uint64_t line_base = 0;
+
+    for (size_t i = 0; i < split->range_count; i++) {
+        content_range_t *range = &split->ranges[i];
+        found = found || range->found;
+        for (content_match_t *match = range->matches; match; match = match->next) {
+            match->line += line_base;
+        }
+        *tail = range->matches;
+        while (*tail) {
+            tail = &(*tail)->next;
+        }
+        line_base += range->lines;
+    }
+
+    if (found) {
+        add_result_safe(split->ctx, split->root, split->path, split->size, split->mtime, matches);
+    } else {
+        content_free_matches(matches);
+    }
+    free(split->path);
+    free(split);
+}
+
+static void process_content_range(void *context, void *user_data) {
+    (void)context;
+
+    content_range_t *range = (content_range_t*)user_data;
+    content_split_t *split = range->split;
+    search_context_t *ctx = split->ctx;
+
+    if (!atomic_load(&ctx->results_closed)) {
+        range->found = content_search_on_thread(ctx, split->path, split->size, range->begin, range->end,
+                                                &range->matches, &range->lines) > 0;
+    }
+    if (atomic_fetch_sub(&split->remaining, 1) == 1) {
+        content_split_finish(split);
+    }
+}
+
+// Takes over the content search of a large file, reporting it later from
+// whichever worker finishes it. Returns false, leaving the file to the
+// caller, when it is too small to split or the job cannot be set up.
+static bool content_split_submit(search_context_t *ctx, const char *root, const char *path,
+                                 uint64_t size, FILETIME mtime) {
+    if (size < SEARCH_SPLIT_MIN_SIZE || thread_pool_worker_count(ctx->thread_pool) < 2) return false;
+
+    // Only the first range would see the leading bytes that decide the
+    // encoding. UTF-16 text is left to the caller, which searches it whole.
+    content_encoding_t encoding = content_file_encoding(path);
+    if (encoding == CONTENT_ENCODING_BINARY) return true;
+    if (encoding != CONTENT_ENCODING_UTF8) return false;
+
+    uint64_t range_size = size / SEARCH_SPLIT_MAX_RANGES + 1;
+    if (range_size < SEARCH_SPLIT_RANGE_SIZE) range_size = SEARCH_SPLIT_RANGE_SIZE;
+    size_t range_count = (size_t)((size + range_size - 1) / range_size);
+
+    content_split_t *split = calloc(1, sizeof(content_split_t) + range_count * sizeof(content_range_t));
+    if (!split) return false;
+    split->path = _strdup(path);
+    if (!split->path) {
+        free(split);
+        return false;
+    }
+
+    split->ctx = ctx;
+    split->root = root;
+    split->size = size;
+    split->mtime = mtime;
+    split->range_count = range_count;
+    atomic_init(&split->remaining, range_count);
+    for (size_t i = 0; i < range_count; i++) {
+        content_range_t *range = &split->ranges[i];
+        range->split = split;
+        range->begin = (uint64_t)i * range_size;
+        range->end = size - range->begin > range_size ? range->begin + range_size : size;
+    }
+
+    // The first range runs here; the split may be gone once it returns.
+    for (size_t i = 1; i < range_count; i++) {
+        if (!thread_pool_submit(ctx->thread_pool, process_content_range, &split->ranges[i])) {
+            process_content_range(NULL, &split->ranges[i]);
+        }
+    }
+    process_content_range(NULL, &split->ranges[0]);
+    return true;
+}
+
+// A small file on its way through the content pipeline.
+typedef struct {
+    const char *root;
+    uint64_t size;
+    FILETIME mtime;
+    char path[];
+} content_read_t;
+
+static void content_pipeline_match(void *job, const unsigned char *data, size_t length,
+                                   size_t thread, void *user_data) {
+    search_context_t *ctx = (search_context_t*)user_data;
+    content_read_t *read = (content_read_t*)job;
+
+    if (data && thread < ctx->pipeline_buffer_count && !atomic_load(&ctx->results_closed)) {
+        content_match_t *matches = NULL;
+        if (content_search_buffer(ctx->content, &ctx->pipeline_buffers[thread], data, length,
+                                  &ctx->cancel, &matches) > 0) {
+            add_result_safe(ctx, read->root, read->path, read->size, read->mtime, matches);
+        }
+    }
+    free(read);
+}
+
+// Hands a file whose matching lines are reported as found to a stage that
+// searches it later: small files go through the read-ahead pipeline, very
+// large ones are split. Returns false if the caller should search it now,
+// as it does every compressed file; many of those still decompress in
+// parallel, one per walk worker.
+static bool content_search_deferred(search_context_t *ctx, const char *root, const char *path,
+                                    uint64_t size, FILETIME mtime) {
+    if (content_is_compressed(ctx->content, path)) return false;
+    if (ctx->content_pipeline && size <= CONTENT_READ_WHOLE_MAX) {
+        size_t length = strlen(path) + 1;
+        content_read_t *read = malloc(sizeof(content_read_t) + length);
+        if (!read) return false;
+        read->root = root;
+        read->size = size;
+        read->mtime = mtime;
+        memcpy(read->path, path, length);
+
+        if (pipeline_submit(ctx->content_pipeline, read->path, size, read)) return true;
+        free(read);
+        return false;
+    }
+    return content_split_submit(ctx, root, path, size, mtime);
+}
+
+static uint64_t filetime_to_u64(const FILETIME *ft) {
+    return ((uint64_t)ft->dwHighDateTime << 32) | ft->dwLowDateTime;
+}
+
+// Sorted and top-N results carry the lines found while walking, so nothing
+// is read again here, under the order tree's lock.
+static bool order_emit_result(const char *root, const char *path, uint64_t size, FILETIME mtime,
+                              content_match_t *matches, void *user_data) {
+    search_context_t *ctx = (search_context_t*)user_data;
+    return add_result_safe(ctx, root, path, size, mtime, matches);
+}
+
+// One archive being listed for --archives. Members are matched like files,
+// by their base name, and reported as "archive!/member".
+typedef struct {
+    directory_work_t *work;
+    size_t name_offset;               // of the archive's own name in path
+    size_t prefix_length;             // of "archive!/"
+    char path[MAX_PATH * 2];
+} archive_walk_t;
+
+static bool archive_member_found(const archive_entry_t *entry, void *user_data) {
+    archive_walk_t *walk = (archive_walk_t*)user_data;
+    directory_work_t *work = walk->work;
+    search_context_t *ctx = work->ctx;
+
+    if (cancel_token_cancelled(&ctx->cancel) || atomic_load(&ctx->results_closed)) return false;
+
+    const char *slash = strrchr(entry->name, '/');
+    platform_file_info_t info = {0};
+    info.name = (char*)(slash ? slash + 1 : entry->name);
+    info.size = entry->size;
+    info.mtime = entry->mtime;
+    info.is_directory = entry->is_directory;
+
+    if (!ctx->criteria->include_hidden && info.name[0] == '.') return true;
+    if (FAILED(StringCchCopyA(walk->path + walk->prefix_length, sizeof(walk->path) - walk->prefix_length,
+                              entry->name))) {
+        return true;
+    }
+    if (!matches_criteria(&info, walk->path, ctx->criteria)) return true;
+
+    // Members sort right after the archive among its directory's entries.
+    if (ctx->topk) {
+        uint64_t key = ctx->criteria->top_by == RQ_TOP_BY_MTIME ? filetime_to_u64(&info.mtime) : info.size;
+        topk_offer(ctx->topk, key, work->root, walk->path, info.size, info.mtime, NULL);
+    } else if (work->order_node) {
+        order_node_add_file(work->order_node, walk->path, walk->name_offset, info.size, info.mtime, NULL);
+    } else {
+        add_result_safe(ctx, work->root, walk->path, info.size, info.mtime, NULL);
+    }
+    return true;
+}
+
+// Unreadable and malformed archives are passed over like unreadable files.
+static void search_archive(directory_work_t *work, const char *path, size_t name_offset, uint64_t size) {
+    archive_format_t format = archive_format_for_path(path);
+    if (format == ARCHIVE_NONE) return;
+
+    archive_walk_t walk;
+    walk.work = work;
+    walk.name_offset = name_offset;
+    if (FAILED(StringCchCopyA(walk.path, sizeof(walk.path), path)) ||
+        FAILED(StringCchCatA(walk.path, sizeof(walk.path), "!/"))) {
+        return;
+    }
+    walk.prefix_length = strlen(walk.path);
+
+    archive_list(path, format, size, &work->ctx->cancel, archive_member_found, &walk);
+}
+
 bool matches_criteria(const platform_file_info_t *file_info, const char *full_path,
                      const search_criteria_t *criteria) {
     (void)full_path;
@@ -136,17 +479,117 @@ bool matches_criteria(const platform_file_info_t *file_info, const char *full_pa
     return true;
 }
 
-static void process_directory_work(void *context, void *user_data) {
-    (void)context;
+// Subdirectories found by one worker that have not been handed to the pool
+// yet. The worker keeps taking the newest (deepest) one itself; the oldest
+// ones, which tend to root the biggest subtrees, are offered to idle workers.
+typedef struct {
+    directory_work_t **items;
+    size_t head;
+    size_t count;
+    size_t capacity;
+    directory_work_t *inline_items[64];
+} directory_backlog_t;
+
+static bool directory_backlog_push(directory_backlog_t *backlog, directory_work_t *work) {
+    if (backlog->count == backlog->capacity) {
+        if (backlog->head > 0) {
+            memmove(backlog->items, backlog->items + backlog->head,
+                    (backlog->count - backlog->head) * sizeof(directory_work_t*));
+            backlog->count -= backlog->head;
+            backlog->head = 0;
+        } else {
+            size_t new_capacity = backlog->capacity * 2;
+            directory_work_t **grown = malloc(new_capacity * sizeof(directory_work_t*));
+            if (!grown) return false;
+            memcpy(grown, backlog->items, backlog->count * sizeof(directory_work_t*));
+            if (backlog->items != backlog->inline_items) {
+                free(backlog->items);
+            }
+            backlog->items = grown;
+            backlog->capacity = new_capacity;
+        }
+    }
 
-    directory_work_t *work = (directory_work_t*)user_data;
-    search_context_t *ctx = work->ctx;
+    backlog->items[backlog->count++] = work;
+    return true;
+}
 
-    if (atomic_load(&ctx->should_stop)) {
-        goto cleanup;
+// Hands the oldest entries to the pool while it has workers waiting for
+// something to do, always keeping one back for the calling thread. In
+// shallow-first mode everything goes to the pool so the queue can order it.
+static void directory_backlog_offload(directory_backlog_t *backlog, search_context_t *ctx) {
+    size_t keep = ctx->shallow_first ? 0 : 1;
+    while (backlog->count - backlog->head > keep &&
+           (ctx->shallow_first || thread_pool_has_idle_capacity(ctx->thread_pool))) {
+        if (!directory_work_submit(ctx, backlog->items[backlog->head])) {
+            return;
+        }
+        backlog->head++;
+    }
+}
+
+// A directory's entries, read ahead of matching when ignore files are in
+// use, so that only the ones the listing shows are opened. Entries not
+// read ahead come straight from the iterator.
+typedef struct {
+    platform_file_info_t *entries;
+    size_t count;
+    size_t capacity;
+    size_t next;
+    bool complete;                    // the iterator has nothing more to give
+} directory_listing_t;
+
+// Returns the ignore_file_bit() of every ignore file listed. If memory runs
+// short, the rest of the listing is left to the iterator and every ignore
+// file is assumed present.
+static unsigned directory_listing_read(directory_listing_t *listing, platform_dir_iter_t *iter,
+                                       search_context_t *ctx) {
+    unsigned present = 0;
+    for (;;) {
+        if (listing->count == listing->capacity) {
+            size_t capacity = listing->capacity ? listing->capacity * 2 : 64;
+            platform_file_info_t *grown = realloc(listing->entries, capacity * sizeof(platform_file_info_t));
+            if (!grown) return IGNORE_FILES_ALL;
+            listing->entries = grown;
+            listing->capacity = capacity;
+        }
+
+        if ((listing->count + 1) % SEARCH_CANCEL_CHECK_BATCH == 0 && cancel_token_check(&ctx->cancel)) {
+            listing->complete = true;
+            return present;
+        }
+        platform_file_info_t *info = &listing->entries[listing->count];
+        if (!platform_readdir(iter, info)) {
+            listing->complete = true;
+            return present;
+        }
+        present |= ignore_file_bit(info->name);
+        listing->count++;
+    }
+}
+
+static bool directory_listing_next(directory_listing_t *listing, platform_dir_iter_t *iter,
+                                   platform_file_info_t *info) {
+    if (listing->next < listing->count) {
+        *info = listing->entries[listing->next++];
+        return true;
     }
+    return !listing->complete && platform_readdir(iter, info);
+}
 
-    if (is_system_directory(work->directory_path)) {
+static void directory_listing_free(directory_listing_t *listing) {
+    while (listing->next < listing->count) {
+        platform_free_file_info(&listing->entries[listing->next++]);
+    }
+    free(listing->entries);
+}
+
+static void scan_directory(directory_work_t *work, directory_backlog_t *backlog) {
+    search_context_t *ctx = work->ctx;
+    size_t shard = thread_pool_worker_index(ctx->thread_pool);
+    ignore_stack_t *ignores = NULL;
+
+    if (cancel_token_check(&ctx->cancel)) {
         goto cleanup;
     }
 
@@ -155,9 +598,24 @@ static void process_directory_work(void *context, void *user_data) {
         goto cleanup;
     }
 
+    // Rules declared here apply to this directory's entries and are shared
+    // by reference with every subdirectory below it. Only the ignore files
+    // the listing shows are opened.
+    directory_listing_t listing = {0};
+    if (ctx->criteria->use_ignore_files) {
+        unsigned present = directory_listing_read(&listing, dir_iter, ctx);
+        ignores = ignore_stack_push(work->ignores, work->directory_path, present);
+    }
+
     platform_file_info_t file_info;
-    while (platform_readdir(dir_iter, &file_info)) {
-        if (atomic_load(&ctx->should_stop)) {
+    size_t entries = 0;
+    while (directory_listing_next(&listing, dir_iter, &file_info)) {
+        // The flag is free to read; the deadline and parent tokens are
+        // looked at once per batch of entries.
+        bool cancelled = ++entries % SEARCH_CANCEL_CHECK_BATCH == 0
+            ? cancel_token_check(&ctx->cancel)
+            : cancel_token_cancelled(&ctx->cancel);
+        if (cancelled) {
             platform_free_file_info(&file_info);
             break;
         }
@@ -181,53 +639,152 @@ static void process_directory_work(void *context, void *user_data) {
             continue;
         }
 
+        // Ignored directories are pruned here, before they are ever opened.
+        if (ignores && ignore_stack_matches(ignores, full_path, file_info.name, file_info.is_directory)) {
+            platform_free_file_info(&file_info);
+            continue;
+        }
+
         if (file_info.is_directory) {
             if (file_info.is_symlink && !ctx->criteria->follow_symlinks) {
                 platform_free_file_info(&file_info);
                 continue;
             }
 
-            if (!should_skip_directory(file_info.name, ctx->criteria)) {
+            skip_cursor_t child_cursor;
+            if (!skip_rules_check(ctx->skip_rules, work->skip_cursor, file_info.name, &child_cursor)) {
                 // Check depth limit before recursing into subdirectory
                 // max_depth == 0 means current directory only (no recursion)
                 // work->depth starts at 0, so depth 1+ directories require max_depth >= 1
                 if (work->depth < ctx->criteria->max_depth) {
-                    directory_work_t *subdir_work = malloc(sizeof(directory_work_t));
+                    directory_work_t *subdir_work = directory_work_create(ctx, full_path);
                     if (subdir_work) {
-                        subdir_work->ctx = ctx;
-                        subdir_work->directory_path = _strdup(full_path);
+                        subdir_work->root = work->root;
                         subdir_work->depth = work->depth + 1;
+                        subdir_work->ignores = ignore_stack_retain(ignores);
+                        subdir_work->skip_cursor = child_cursor;
+                        subdir_work->boosted = work->boosted ||
+                            (ctx->criteria->boost_paths_count > 0 &&
+                             directory_is_boosted(ctx->criteria, work->root, full_path));
+
+                        bool linked = true;
+                        if (work->order_node) {
+                            subdir_work->order_node = order_node_add_dir(work->order_node, full_path,
+                                                                         strlen(full_path) - strlen(file_info.name));
+                            linked = subdir_work->order_node != NULL;
+                        }
+                        if (linked && work->du_node) {
+                            subdir_work->du_node = du_node_add_child(ctx->du, work->du_node, full_path);
+                            linked = subdir_work->du_node != NULL;
+                        }
 
-                        if (subdir_work->directory_path) {
-                            atomic_fetch_add(&ctx->queued_dirs, 1);
-                            if (!thread_pool_submit(ctx->thread_pool, process_directory_work, subdir_work)) {
+                        if (linked) {
+                            // Whether this runs here or on another worker is decided once
+                            // the listing is done and the handle is closed.
+                            sync_counter_add(&ctx->queued_dirs, shard, 1);
+                            if (!directory_backlog_push(backlog, subdir_work) &&
+                                !directory_work_submit(ctx, subdir_work)) {
                                 process_directory_work(NULL, subdir_work);
                             }
                         } else {
-                            free(subdir_work);
+                            directory_work_release(subdir_work);
                         }
                     }
                 }
             }
         } else {
-            if (matches_criteria(&file_info, full_path, ctx->criteria)) {
-                add_result_safe(ctx, full_path, file_info.size, file_info.mtime);
+            bool matched = matches_criteria(&file_info, full_path, ctx->criteria);
+            content_match_t *matches = NULL;
+            if (matched && ctx->content) {
+                // Line details are only wanted when the file is reported;
+                // sorted and top-N results keep theirs until emitted.
+                bool report = !work->du_node && !ctx->dupes;
+                bool unordered = report && !ctx->topk && !work->order_node;
+                if (unordered && content_search_deferred(ctx, work->root, full_path, file_info.size, file_info.mtime)) {
+                    matched = false;  // reported once the deferred search is done
+                } else {
+                    matched = content_matches(ctx, full_path, file_info.size, report ? &matches : NULL);
+                }
+            }
+            if (matched) {
+                if (work->du_node) {
+                    du_node_add_file(ctx->du, work->du_node, full_path, file_info.size);
+                } else if (ctx->dupes) {
+                    // Empty files are all trivially identical; not worth reporting.
+                    if (file_info.size > 0) {
+                        dupes_add(ctx->dupes, full_path, file_info.size);
+                    }
+                } else if (ctx->topk) {
+                    uint64_t key = ctx->criteria->top_by == RQ_TOP_BY_MTIME
+                        ? filetime_to_u64(&file_info.mtime) : file_info.size;
+                    topk_offer(ctx->topk, key, work->root, full_path, file_info.size, file_info.mtime, matches);
+                } else if (work->order_node) {
+                    order_node_add_file(work->order_node, full_path, strlen(full_path) - strlen(file_info.name),
+                                        file_info.size, file_info.mtime, matches);
+                } else {
+                    add_result_safe(ctx, work->root, full_path, file_info.size, file_info.mtime, matches);
+                }
             }
-            atomic_fetch_add(&ctx->processed_files, 1);
+            // Members have no content to search and nothing to total or hash.
+            if (ctx->criteria->search_archives && !ctx->content && !work->du_node && !ctx->dupes) {
+                search_archive(work, full_path, strlen(full_path) - strlen(file_info.name), file_info.size);
+            }
+            sync_counter_add(&ctx->processed_files, shard, 1);
         }
 
         platform_free_file_info(&file_info);
     }
 
+    directory_listing_free(&listing);
     platform_closedir(dir_iter);
 
 cleanup:
-    free(work->directory_path);
-    free(work);
-    atomic_fetch_sub(&ctx->queued_dirs, 1);
+    if (work->order_node) {
+        order_tree_publish(ctx->order_tree, work->order_node);
+    }
+    if (work->du_node) {
+        du_node_complete(ctx->du, work->du_node);
+    }
+    ignore_stack_release(ignores);
+    directory_work_release(work);
+    sync_counter_add(&ctx->queued_dirs, shard, (uint64_t)-1);
 }
 
-static bool search_progress_callback(size_t processed_files, size_t queued_dirs, void *user_data) {
+// Leaf and small directories are walked inline on the thread that found
+// them; the pool only sees work when it has idle workers to run it.
+static void process_directory_work(void *context, void *user_data) {
+    (void)context;
+
+    directory_work_t *work = (directory_work_t*)user_data;
+    search_context_t *ctx = work->ctx;
+
+    directory_backlog_t backlog;
+    backlog.items = backlog.inline_items;
+    backlog.head = 0;
+    backlog.count = 0;
+    backlog.capacity = sizeof(backlog.inline_items) / sizeof(backlog.inline_items[0]);
+
+    while (work) {
+        scan_directory(work, &backlog);
+        directory_backlog_offload(&backlog, ctx);
+
+        work = NULL;
+        if (backlog.count > backlog.head) {
+            work = backlog.items[--backlog.count];
+            if (backlog.count == backlog.head) {
+                backlog.head = backlog.count = 0;
+            }
+        }
+    }
+
+    if (backlog.items != backlog.inline_items) {
+        free(backlog.items);
+    }
+}
+
+static bool search_progress_callback(size_t completed_items, size_t active_items, void *user_data) {
+    (void)completed_items;
+    (void)active_items;
     search_context_t *ctx = (search_context_t*)user_data;
 
     if (ctx->thread_pool) {
@@ -236,17 +793,68 @@ static bool search_progress_callback(size_t processed_files, size_t queued_dirs,
     }
 
     if (ctx->progress_callback) {
+        size_t processed_files = (size_t)sync_counter_read(&ctx->processed_files);
+        size_t queued_dirs = (size_t)sync_counter_read(&ctx->queued_dirs);
         size_t total_results = atomic_load(&ctx->total_results);
         return ctx->progress_callback(processed_files, queued_dirs, total_results, ctx->progress_user_data);
     }
 
-    return !atomic_load(&ctx->should_stop);
+    return !cancel_token_cancelled(&ctx->cancel);
 }
 
-int search_files_advanced(search_criteria_t *criteria,
-                         search_result_t **results, size_t *count,
-                         result_callback_t result_callback, void *result_user_data,
-                         search_progress_callback_t progress_callback, void *progress_user_data) {
+// Results are appended under the lock in the order their timestamps were
+// taken, so the list is already sorted by found_ns.
+static void record_search_timing(const search_context_t *ctx) {
+    search_timing_t timing = {0};
+    timing.elapsed_ns = sync_now_ns() - ctx->start_ns;
+    timing.result_count = atomic_load(&ctx->total_results);
+
+    size_t ninety = (timing.result_count * 9 + 9) / 10;
+    size_t index = 0;
+    for (const search_result_t *result = ctx->results_head; result; result = result->next) {
+        index++;
+        if (index == 1) {
+            timing.first_result_ns = result->found_ns - ctx->start_ns;
+        }
+        if (index == ninety) {
+            timing.ninety_percent_ns = result->found_ns - ctx->start_ns;
+            break;
+        }
+    }
+
+    last_search_timing = timing;
+    last_search_timing_valid = true;
+}
+
+static void search_context_release(search_context_t *ctx) {
+    thread_pool_destroy(ctx->thread_pool);
+    // Every directory work item has been released by now.
+    for (size_t i = 0; i < SEARCH_WORK_SIZE_CLASSES; i++) {
+        slab_pool_destroy(ctx->work_slabs[i]);
+    }
+    sync_counter_destroy(&ctx->processed_files);
+    sync_counter_destroy(&ctx->queued_dirs);
+    order_tree_destroy(ctx->order_tree);
+    topk_destroy(ctx->topk);
+    skip_rules_destroy(ctx->skip_rules);
+    for (size_t i = 0; i < ctx->content_buffer_count; i++) {
+        content_buffer_free(&ctx->content_buffers[i]);
+    }
+    free(ctx->content_buffers);
+    pipeline_destroy(ctx->content_pipeline);
+    for (size_t i = 0; i < ctx->pipeline_buffer_count; i++) {
+        content_buffer_free(&ctx->pipeline_buffers[i]);
+    }
+    free(ctx->pipeline_buffers);
+    content_matcher_destroy(ctx->content);
+    DeleteCriticalSection(&ctx->results_lock);
+}
+
+static int search_run(search_criteria_t *criteria,
+                      search_result_t **results, size_t *count,
+                      result_callback_t result_callback, void *result_user_data,
+                      search_progress_callback_t progress_callback, void *progress_user_data,
+                      du_tree_t *du, dupes_set_t *dupes) {
     if (!criteria || !criteria_validate(criteria)) return -1;
 
     if (results) *results = NULL;
@@ -254,71 +862,284 @@ int search_files_advanced(search_criteria_t *criteria,
 
     search_context_t ctx = {0};
     ctx.criteria = criteria;
+    ctx.shallow_first = criteria->shallow_first || criteria->boost_paths_count > 0;
     atomic_init(&ctx.total_results, 0);
-    atomic_init(&ctx.processed_files, 0);
-    atomic_init(&ctx.queued_dirs, 0);
-    atomic_init(&ctx.should_stop, false);
+    atomic_init(&ctx.results_closed, false);
+    cancel_token_init(&ctx.cancel, criteria->cancel, cancel_deadline_after_ms(criteria->timeout_ms));
     ctx.results_head = NULL;
     ctx.results_tail = NULL;
     ctx.result_callback = result_callback;
     ctx.result_user_data = result_user_data;
     ctx.progress_callback = progress_callback;
     ctx.progress_user_data = progress_user_data;
+    ctx.du = du;
+    ctx.dupes = dupes;
+    last_pipeline_stats_valid = false;
 
     if (!InitializeCriticalSectionAndSpinCount(&ctx.results_lock, 4000)) {
         return -1;
     }
 
     thread_pool_config_t pool_config = {0};
-    pool_config.max_threads = criteria->max_threads;
+    if (criteria->max_threads > 0) {
+        pool_config.max_threads = criteria->max_threads;
+        pool_config.min_threads = criteria->max_threads;
+    } else {
+        pool_config.max_threads = criteria->threads_max;
+        pool_config.min_threads = criteria->threads_min;
+    }
     pool_config.progress_cb = search_progress_callback;
     pool_config.progress_user_data = &ctx;
-    pool_config.stop_flag = &ctx.should_stop;
+    pool_config.progress_interval_ms = criteria->progress_interval_ms;
+    pool_config.cancel = &ctx.cancel;
 
     ctx.thread_pool = thread_pool_create(&pool_config);
     if (!ctx.thread_pool) {
-        DeleteCriticalSection(&ctx.results_lock);
+        search_context_release(&ctx);
+        return -1;
+    }
+
+    size_t worker_count = thread_pool_worker_count(ctx.thread_pool);
+    if (!sync_counter_init(&ctx.processed_files, worker_count) ||
+        !sync_counter_init(&ctx.queued_dirs, worker_count)) {
+        search_context_release(&ctx);
+        return -1;
+    }
+    for (size_t i = 0; i < SEARCH_WORK_SIZE_CLASSES; i++) {
+        ctx.work_slabs[i] = slab_pool_create(sizeof(directory_work_t) + directory_work_path_sizes[i], worker_count);
+        if (!ctx.work_slabs[i]) {
+            search_context_release(&ctx);
+            return -1;
+        }
+    }
+
+    if (criteria->content_pattern) {
+        // Buffers are allocated on first use, so idle workers cost nothing.
+        ctx.content = content_matcher_create(criteria->content_pattern, criteria->case_sensitive,
+                                             criteria->content_regex, criteria->content_decompress);
+        ctx.content_buffers = calloc(worker_count, sizeof(content_buffer_t));
+        if (!ctx.content || !ctx.content_buffers) {
+            search_context_release(&ctx);
+            return -1;
+        }
+        ctx.content_buffer_count = worker_count;
+    }
+
+    bool aggregating = du || dupes;
+
+    if (criteria->sort_mode == RQ_SORT_PATH && !aggregating) {
+        ctx.order_tree = order_tree_create(order_emit_result, &ctx);
+        if (!ctx.order_tree) {
+            search_context_release(&ctx);
+            return -1;
+        }
+    }
+
+    ctx.skip_rules = skip_rules_create(criteria->skip_common_dirs);
+    bool skip_ok = ctx.skip_rules != NULL;
+    for (size_t i = 0; skip_ok && i < criteria->skip_dirs_count; i++) {
+        skip_ok = skip_rules_add_name(ctx.skip_rules, criteria->skip_dirs[i]);
+    }
+    for (size_t i = 0; skip_ok && i < criteria->skip_paths_count; i++) {
+        skip_ok = skip_rules_add_path(ctx.skip_rules, criteria->skip_paths[i]);
+    }
+    if (!skip_ok) {
+        search_context_release(&ctx);
+        return -1;
+    }
+
+    if (criteria->top_count > 0 && !aggregating) {
+        ctx.topk = topk_create(criteria->top_count, criteria->top_ascending);
+        if (!ctx.topk) {
+            search_context_release(&ctx);
+            return -1;
+        }
+    }
+
+    if (ctx.content && !aggregating && !ctx.order_tree && !ctx.topk) {
+        // Results are reported as found, so small files can be read ahead
+        // by I/O threads and searched by separate match threads.
+        pipeline_config_t pipeline_config = {0};
+        pipeline_config.buffer_size = CONTENT_READ_WHOLE_MAX;
+        pipeline_config.match = content_pipeline_match;
+        pipeline_config.user_data = &ctx;
+        pipeline_config.cancel = &ctx.cancel;
+        ctx.content_pipeline = pipeline_create(&pipeline_config);
+        if (ctx.content_pipeline) {
+            size_t match_threads = pipeline_match_thread_count(ctx.content_pipeline);
+            ctx.pipeline_buffers = calloc(match_threads, sizeof(content_buffer_t));
+            if (!ctx.pipeline_buffers) {
+                search_context_release(&ctx);
+                return -1;
+            }
+            ctx.pipeline_buffer_count = match_threads;
+        }
+    }
+
+    // Callers that only fill in root_path still get a single-root search.
+    if (criteria->root_count == 0 && criteria->root_path &&
+        !criteria_add_root(criteria, criteria->root_path)) {
+        search_context_release(&ctx);
         return -1;
     }
+    criteria_normalize_roots(criteria);
 
-    directory_work_t *initial_work = malloc(sizeof(directory_work_t));
+    // All roots are prepared before any is submitted, so a failure never
+    // leaves part of the search running.
+    directory_work_t **initial_work = calloc(criteria->root_count, sizeof(directory_work_t*));
     if (!initial_work) {
-        thread_pool_destroy(ctx.thread_pool);
-        DeleteCriticalSection(&ctx.results_lock);
+        search_context_release(&ctx);
         return -1;
     }
 
-    initial_work->ctx = &ctx;
-    initial_work->directory_path = _strdup(criteria->root_path);
-    initial_work->depth = 0;
+    bool prepared = true;
+    for (size_t i = 0; i < criteria->root_count && prepared; i++) {
+        const char *root = criteria->root_paths[i];
+        directory_work_t *work = directory_work_create(&ctx, root);
+        initial_work[i] = work;
+        if (!work) {
+            prepared = false;
+            break;
+        }
+
+        work->root = root;
+        work->depth = 0;
+        work->boosted = criteria->boost_paths_count > 0 && directory_is_boosted(criteria, root, root);
+
+        // Roots are searched even when a skip rule names them; only what is
+        // below them is checked.
+        char *full_root = platform_full_path(root);
+        work->skip_cursor = skip_rules_locate(ctx.skip_rules, full_root ? full_root : root);
+        free(full_root);
 
-    if (!initial_work->directory_path) {
+        if (ctx.order_tree) {
+            work->order_node = order_tree_add_root(ctx.order_tree, root);
+        }
+        if (ctx.du) {
+            work->du_node = du_tree_add_root(ctx.du, root);
+        }
+
+        prepared = (!ctx.order_tree || work->order_node) &&
+                   (!ctx.du || work->du_node);
+    }
+
+    if (!prepared) {
+        for (size_t i = 0; i < criteria->root_count; i++) {
+            if (initial_work[i]) {
+                directory_work_release(initial_work[i]);
+            }
+        }
         free(initial_work);
-        thread_pool_destroy(ctx.thread_pool);
-        DeleteCriticalSection(&ctx.results_lock);
+        search_context_release(&ctx);
         return -1;
     }
 
-    atomic_fetch_add(&ctx.queued_dirs, 1);
-    if (!thread_pool_submit(ctx.thread_pool, process_directory_work, initial_work)) {
-        process_directory_work(NULL, initial_work);
+    if (ctx.order_tree) {
+        order_tree_seal_roots(ctx.order_tree);
+    }
+
+    // Every root feeds the same pool, so the workers are shared across trees.
+    ctx.start_ns = sync_now_ns();
+    for (size_t i = 0; i < criteria->root_count; i++) {
+        sync_counter_add(&ctx.queued_dirs, THREAD_POOL_NOT_A_WORKER, 1);
+        if (!directory_work_submit(&ctx, initial_work[i])) {
+            process_directory_work(NULL, initial_work[i]);
+        }
     }
+    free(initial_work);
 
-    bool completed = thread_pool_wait_completion(ctx.thread_pool, criteria->timeout_ms);
-    if (!completed) {
-        atomic_store(&ctx.should_stop, true);
-        thread_pool_wait_completion(ctx.thread_pool, 5000);
+    // The token carries the timeout. Once it fires, items still queued
+    // see it on their first check, so draining them in destroy is quick.
+    thread_pool_wait_completion(ctx.thread_pool, THREAD_POOL_INFINITE);
+
+    if (ctx.dupes && !cancel_token_check(&ctx.cancel)) {
+        // Hashing reuses the traversal's workers once the tree is exhausted.
+        dupes_resolve(ctx.dupes, ctx.thread_pool, &ctx.cancel);
     }
 
     last_thread_stats_valid = thread_pool_get_stats(ctx.thread_pool, &last_thread_stats);
 
     thread_pool_destroy(ctx.thread_pool);
-    DeleteCriticalSection(&ctx.results_lock);
+    ctx.thread_pool = NULL;
+
+    if (ctx.content_pipeline) {
+        // Nothing submits any more; let the queued files drain.
+        pipeline_finish(ctx.content_pipeline);
+        last_pipeline_stats_valid = pipeline_get_stats(ctx.content_pipeline, &last_pipeline_stats);
+    }
+
+    int status = 0;
+    switch (cancel_token_reason(&ctx.cancel)) {
+        case CANCEL_REASON_DEADLINE:  status = -2; break;
+        case CANCEL_REASON_REQUESTED: status = -3; break;
+        default: break;
+    }
+
+    if (ctx.topk) {
+        // Heaps are merged once every worker is done; the winners go through
+        // the regular result path so callbacks and --max-results still apply.
+        // A cancelled search still reports the best of what it saw.
+        topk_emit(ctx.topk, order_emit_result, &ctx);
+    }
+
+    search_context_release(&ctx);
+    record_search_timing(&ctx);
 
     if (results) *results = ctx.results_head;
     if (count) *count = atomic_load(&ctx.total_results);
 
-    return completed ? 0 : -2;
+    return status;
+}
+
+int search_files_advanced(search_criteria_t *criteria,
+                         search_result_t **results, size_t *count,
+                         result_callback_t result_callback, void *result_user_data,
+                         search_progress_callback_t progress_callback, void *progress_user_data) {
+    return search_run(criteria, results, count, result_callback, result_user_data,
+                      progress_callback, progress_user_data, NULL, NULL);
+}
+
+int search_disk_usage(search_criteria_t *criteria, du_row_t **rows, size_t *count,
+                      search_progress_callback_t progress_callback, void *progress_user_data) {
+    if (!criteria || !rows || !count) return -1;
+
+    *rows = NULL;
+    *count = 0;
+
+    du_tree_t *du = du_tree_create(criteria->du_depth);
+    if (!du) return -1;
+
+    int status = search_run(criteria, NULL, NULL, NULL, NULL,
+                            progress_callback, progress_user_data, du, NULL);
+    if (status != -1) {
+        *rows = du_tree_take_rows(du, count);
+    }
+
+    du_tree_destroy(du);
+    return status;
+}
+
+int search_duplicates(search_criteria_t *criteria, dupe_group_t **groups, size_t *count,
+                      search_progress_callback_t progress_callback, void *progress_user_data) {
+    if (!criteria || !groups || !count) return -1;
+
+    *groups = NULL;
+    *count = 0;
+
+    size_t io_depth = criteria->max_threads > 0 ? criteria->max_threads * 2 : 16;
+    if (io_depth > 64) io_depth = 64;
+
+    dupes_set_t *dupes = dupes_create(io_depth);
+    if (!dupes) return -1;
+
+    int status = search_run(criteria, NULL, NULL, NULL, NULL,
+                            progress_callback, progress_user_data, NULL, dupes);
+    if (status == 0) {
+        *groups = dupes_take_groups(dupes, count);
+    }
+
+    dupes_destroy(dupes);
+    return status;
 }
 
 int search_files_fast(search_criteria_t *criteria, search_result_t **results, size_t *count) {
@@ -327,19 +1148,36 @@ int search_files_fast(search_criteria_t *criteria, search_result_t **results, si
 
 void search_request_cancellation(search_context_t *ctx) {
     if (ctx) {
-        atomic_store(&ctx->should_stop, true);
+        cancel_token_cancel(&ctx->cancel, CANCEL_REASON_REQUESTED);
     }
 }
 
 void free_search_results(search_result_t *results) {
     while (results) {
         search_result_t *next = results->next;
+        content_free_matches(results->matches);
         free(results->path);
         free(results);
         results = next;
     }
 }
 
+bool get_last_search_timing(search_timing_t *timing) {
+    if (!timing || !last_search_timing_valid) {
+        return false;
+    }
+    *timing = last_search_timing;
+    return true;
+}
+
+bool get_last_search_pipeline_stats(pipeline_stats_t *stats) {
+    if (!stats || !last_pipeline_stats_valid) {
+        return false;
+    }
+    *stats = last_pipeline_stats;
+    return true;
+}
+
 bool get_last_search_thread_stats(thread_pool_stats_t *stats) {
     if (!stats || !last_thread_stats_valid) {
         return false;
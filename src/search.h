@@ -5,18 +5,34 @@
 #include "platform.h"
 #include "pattern.h"
 #include "thread_pool.h"
+#include "order.h"
+#include "topk.h"
+#include "du.h"
+#include "dupes.h"
+#include "skiplist.h"
+#include "slab.h"
+#include "sync.h"
+#include "cancel.h"
+#include "content.h"
+#include "pipeline.h"
 #include <windows.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdatomic.h>
 
+// Directory work descriptors come from one slab per path length class.
+#define SEARCH_WORK_SIZE_CLASSES 3
+
 typedef struct search_result search_result_t;
 typedef struct search_context search_context_t;
 
 struct search_result {
+    const char *root;        // the criteria root this result was found under
     char *path;
     uint64_t size;
     FILETIME mtime;
+    uint64_t found_ns;       // sync_now_ns() when the result was added
+    content_match_t *matches; // matching lines when searching content
     search_result_t *next;
 };
 
@@ -27,13 +43,23 @@ typedef bool (*search_progress_callback_t)(size_t processed_files, size_t queued
 
 struct search_context {
     search_criteria_t *criteria;
-    atomic_size_t total_results;
-    atomic_size_t processed_files;
-    atomic_size_t queued_dirs;
+    uint64_t start_ns;
+    bool shallow_first;               // directories are queued by depth/boost
+
+    // Polled for every entry by every worker, so nothing that is written
+    // often shares their cache line.
+    char padding_before_stop[SYNC_CACHE_LINE];
+    cancel_token_t cancel;            // child of criteria->cancel, carries the timeout
+    atomic_bool results_closed;       // --max-results reached or the callback declined
+    char padding_after_stop[SYNC_CACHE_LINE];
+
+    sync_counter_t processed_files;   // sharded by pool worker
+    sync_counter_t queued_dirs;
+
+    atomic_size_t total_results;      // exact, for --max-results
     search_result_t *results_head;
     search_result_t *results_tail;
     CRITICAL_SECTION results_lock;
-    atomic_bool should_stop;
 
     result_callback_t result_callback;
     void *result_user_data;
@@ -41,6 +67,19 @@ struct search_context {
     void *progress_user_data;
 
     thread_pool_t *thread_pool;
+    order_tree_t *order_tree;
+    topk_set_t *topk;
+    du_tree_t *du;
+    dupes_set_t *dupes;
+    skip_rules_t *skip_rules;
+    slab_pool_t *work_slabs[SEARCH_WORK_SIZE_CLASSES];
+
+    content_matcher_t *content;       // --contains, or NULL
+    content_buffer_t *content_buffers; // one per pool worker
+    size_t content_buffer_count;
+    pipeline_t *content_pipeline;     // small files when results are reported as found
+    content_buffer_t *pipeline_buffers; // one per match thread
+    size_t pipeline_buffer_count;
 };
 
 int search_files_fast(search_criteria_t *criteria, search_result_t **results, size_t *count);
@@ -50,17 +89,46 @@ int search_files_advanced(search_criteria_t *criteria,
                          result_callback_t result_callback, void *result_user_data,
                          search_progress_callback_t progress_callback, void *progress_user_data);
 
+// Aggregates per-directory totals instead of collecting results. Rows are
+// returned sorted by path; release them with du_free_rows().
+int search_disk_usage(search_criteria_t *criteria, du_row_t **rows, size_t *count,
+                      search_progress_callback_t progress_callback, void *progress_user_data);
+
+// Reports groups of files with identical content. Release the groups with
+// dupes_free_groups(). Nothing is reported if the search is stopped.
+int search_duplicates(search_criteria_t *criteria, dupe_group_t **groups, size_t *count,
+                      search_progress_callback_t progress_callback, void *progress_user_data);
+
 void free_search_results(search_result_t *results);
 search_result_t* create_search_result(const char *path, uint64_t size, FILETIME mtime);
 
 bool matches_criteria(const platform_file_info_t *file_info, const char *full_path,
                      const search_criteria_t *criteria);
 
-bool is_system_directory(const char *path);
-bool should_skip_directory(const char *dirname, const search_criteria_t *criteria);
-
 void search_request_cancellation(search_context_t *ctx);
 
+// search_files_advanced(), search_disk_usage() and search_duplicates()
+// return -2 when criteria->timeout_ms ran out and -3 when criteria->cancel
+// (or a progress callback) stopped them. Either way the first two return
+// whatever was found up to that point as usual. search_duplicates() returns
+// no groups: hashing only starts once the walk is complete, so none has
+// been confirmed.
+
 bool get_last_search_thread_stats(thread_pool_stats_t *stats);
 
+// How quickly the last search produced its results, measured from the
+// moment the first root was queued.
+typedef struct {
+    size_t result_count;
+    uint64_t first_result_ns;
+    uint64_t ninety_percent_ns;       // when 90% of the results were in
+    uint64_t elapsed_ns;
+} search_timing_t;
+
+bool get_last_search_timing(search_timing_t *timing);
+
+// Read and match queue statistics of the last content search, when it used
+// the pipeline.
+bool get_last_search_pipeline_stats(pipeline_stats_t *stats);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,322 @@
+#include "skiplist.h"
+#include "pattern.h"
+#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SKIP_ROOT_NODE 0
+#define SKIP_FNV_OFFSET 0xcbf29ce484222325ULL
+#define SKIP_FNV_PRIME 0x100000001b3ULL
+#define SKIP_IS_SEP(c) ((c) == '\\' || (c) == '/')
+
+// Relative to the volume root; matched as whole components only.
+static const char* skip_default_paths[] = {
+    "$Recycle.Bin", "System Volume Information", "Windows\\System32",
+    "Windows\\SysWOW64", "Program Files", "Program Files (x86)",
+    "ProgramData", "Recovery", "Intel", "AMD", "NVIDIA"
+};
+
+static const char* skip_default_names[] = {
+    "$RECYCLE.BIN", "System Volume Information", "Windows", "Program Files",
+    "Program Files (x86)", "ProgramData", "Recovery", "Intel", "AMD", "NVIDIA",
+    "node_modules", ".git", ".svn", "__pycache__", "obj", "bin", "Debug",
+    "Release", ".vs", "packages", "bower_components", "dist", "build"
+};
+
+typedef struct {
+    uint64_t hash;
+    char *name;
+} skip_name_slot_t;
+
+typedef struct {
+    uint64_t hash;
+    uint32_t parent;
+    uint32_t child;
+    char *name;
+} skip_edge_t;
+
+struct skip_rules {
+    skip_name_slot_t *names;          // open addressing, power-of-two capacity
+    size_t name_capacity;
+    size_t name_count;
+
+    skip_edge_t *edges;               // trie edges keyed by (parent, name)
+    size_t edge_capacity;
+    size_t edge_count;
+
+    bool *terminal;                   // per trie node: the path itself is skipped
+    size_t node_count;
+    size_t node_capacity;
+};
+
+static uint64_t skip_hash(const char *s, size_t len, uint64_t seed) {
+    uint64_t hash = SKIP_FNV_OFFSET ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)g_ascii_tolower[(unsigned char)s[i]];
+        hash *= SKIP_FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t skip_edge_seed(uint32_t parent) {
+    return ((uint64_t)parent + 1) * 0x9E3779B97F4A7C15ULL;
+}
+
+static bool skip_name_equals(const char *stored, const char *name, size_t len) {
+    return _strnicmp(stored, name, len) == 0 && stored[len] == '\0';
+}
+
+static bool skip_names_grow(skip_rules_t *rules) {
+    size_t new_capacity = rules->name_capacity ? rules->name_capacity * 2 : 64;
+    skip_name_slot_t *slots = calloc(new_capacity, sizeof(skip_name_slot_t));
+    if (!slots) return false;
+
+    for (size_t i = 0; i < rules->name_capacity; i++) {
+        skip_name_slot_t *old = &rules->names[i];
+        if (!old->name) continue;
+        size_t at = (size_t)old->hash & (new_capacity - 1);
+        while (slots[at].name) at = (at + 1) & (new_capacity - 1);
+        slots[at] = *old;
+    }
+
+    free(rules->names);
+    rules->names = slots;
+    rules->name_capacity = new_capacity;
+    return true;
+}
+
+static bool skip_edges_grow(skip_rules_t *rules) {
+    size_t new_capacity = rules->edge_capacity ? rules->edge_capacity * 2 : 64;
+    skip_edge_t *edges = calloc(new_capacity, sizeof(skip_edge_t));
+    if (!edges) return false;
+
+    for (size_t i = 0; i < rules->edge_capacity; i++) {
+        skip_edge_t *old = &rules->edges[i];
+        if (!old->name) continue;
+        size_t at = (size_t)old->hash & (new_capacity - 1);
+        while (edges[at].name) at = (at + 1) & (new_capacity - 1);
+        edges[at] = *old;
+    }
+
+    free(rules->edges);
+    rules->edges = edges;
+    rules->edge_capacity = new_capacity;
+    return true;
+}
+
+static uint32_t skip_node_create(skip_rules_t *rules) {
+    if (rules->node_count == rules->node_capacity) {
+        size_t new_capacity = rules->node_capacity ? rules->node_capacity * 2 : 32;
+        bool *grown = realloc(rules->terminal, new_capacity * sizeof(bool));
+        if (!grown) return SKIP_CURSOR_NONE;
+        rules->terminal = grown;
+        rules->node_capacity = new_capacity;
+    }
+    rules->terminal[rules->node_count] = false;
+    return (uint32_t)rules->node_count++;
+}
+
+static uint32_t skip_edge_find(const skip_rules_t *rules, uint32_t parent, const char *name, size_t len) {
+    if (rules->edge_count == 0) return SKIP_CURSOR_NONE;
+
+    uint64_t hash = skip_hash(name, len, skip_edge_seed(parent));
+    size_t mask = rules->edge_capacity - 1;
+    for (size_t at = (size_t)hash & mask; rules->edges[at].name; at = (at + 1) & mask) {
+        const skip_edge_t *edge = &rules->edges[at];
+        if (edge->hash == hash && edge->parent == parent && skip_name_equals(edge->name, name, len)) {
+            return edge->child;
+        }
+    }
+    return SKIP_CURSOR_NONE;
+}
+
+static uint32_t skip_edge_insert(skip_rules_t *rules, uint32_t parent, const char *name, size_t len) {
+    uint32_t existing = skip_edge_find(rules, parent, name, len);
+    if (existing != SKIP_CURSOR_NONE) return existing;
+
+    if ((rules->edge_count + 1) * 2 > rules->edge_capacity && !skip_edges_grow(rules)) {
+        return SKIP_CURSOR_NONE;
+    }
+
+    char *copy = malloc(len + 1);
+    if (!copy) return SKIP_CURSOR_NONE;
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+
+    uint32_t child = skip_node_create(rules);
+    if (child == SKIP_CURSOR_NONE) {
+        free(copy);
+        return SKIP_CURSOR_NONE;
+    }
+
+    uint64_t hash = skip_hash(name, len, skip_edge_seed(parent));
+    size_t mask = rules->edge_capacity - 1;
+    size_t at = (size_t)hash & mask;
+    while (rules->edges[at].name) at = (at + 1) & mask;
+
+    rules->edges[at].hash = hash;
+    rules->edges[at].parent = parent;
+    rules->edges[at].child = child;
+    rules->edges[at].name = copy;
+    rules->edge_count++;
+    return child;
+}
+
+// Skips "C:", "\\?\C:", "\\server\share" and "\\?\UNC\server\share" so the
+// rest of the path is relative to the volume root.
+static const char* skip_volume_relative(const char *path) {
+    const char *p = path;
+    bool unc = false;
+
+    if (strncmp(p, "\\\\?\\", 4) == 0) {
+        p += 4;
+        if (_strnicmp(p, "UNC\\", 4) == 0) {
+            p += 4;
+            unc = true;
+        }
+    } else if (SKIP_IS_SEP(p[0]) && SKIP_IS_SEP(p[1])) {
+        p += 2;
+        unc = true;
+    }
+
+    if (unc) {
+        for (int part = 0; part < 2 && *p; part++) {
+            while (*p && !SKIP_IS_SEP(*p)) p++;
+            while (SKIP_IS_SEP(*p)) p++;
+        }
+        return p;
+    }
+
+    if (((p[0] >= 'A' && p[0] <= 'Z') || (p[0] >= 'a' && p[0] <= 'z')) && p[1] == ':') {
+        p += 2;
+    }
+    return p;
+}
+
+skip_rules_t* skip_rules_create(bool with_common_names) {
+    skip_rules_t *rules = calloc(1, sizeof(skip_rules_t));
+    if (!rules) return NULL;
+
+    bool ok = skip_node_create(rules) == SKIP_ROOT_NODE;
+
+    for (size_t i = 0; ok && i < sizeof(skip_default_paths) / sizeof(skip_default_paths[0]); i++) {
+        ok = skip_rules_add_path(rules, skip_default_paths[i]);
+    }
+    for (size_t i = 0; ok && with_common_names && i < sizeof(skip_default_names) / sizeof(skip_default_names[0]); i++) {
+        ok = skip_rules_add_name(rules, skip_default_names[i]);
+    }
+
+    if (!ok) {
+        skip_rules_destroy(rules);
+        return NULL;
+    }
+    return rules;
+}
+
+bool skip_rules_add_name(skip_rules_t *rules, const char *name) {
+    if (!rules || !name || !*name) return false;
+
+    size_t len = strlen(name);
+    uint64_t hash = skip_hash(name, len, 0);
+
+    if ((rules->name_count + 1) * 2 > rules->name_capacity && !skip_names_grow(rules)) {
+        return false;
+    }
+
+    size_t mask = rules->name_capacity - 1;
+    size_t at = (size_t)hash & mask;
+    for (; rules->names[at].name; at = (at + 1) & mask) {
+        if (rules->names[at].hash == hash && skip_name_equals(rules->names[at].name, name, len)) {
+            return true;
+        }
+    }
+
+    rules->names[at].name = _strdup(name);
+    if (!rules->names[at].name) return false;
+    rules->names[at].hash = hash;
+    rules->name_count++;
+    return true;
+}
+
+bool skip_rules_add_path(skip_rules_t *rules, const char *path) {
+    if (!rules || !path) return false;
+
+    const char *p = skip_volume_relative(path);
+    uint32_t node = SKIP_ROOT_NODE;
+
+    while (*p) {
+        while (SKIP_IS_SEP(*p)) p++;
+        if (!*p) break;
+
+        const char *start = p;
+        while (*p && !SKIP_IS_SEP(*p)) p++;
+
+        node = skip_edge_insert(rules, node, start, (size_t)(p - start));
+        if (node == SKIP_CURSOR_NONE) return false;
+    }
+
+    // Skipping the volume root itself would skip everything; ignore it.
+    if (node != SKIP_ROOT_NODE) {
+        rules->terminal[node] = true;
+    }
+    return true;
+}
+
+void skip_rules_destroy(skip_rules_t *rules) {
+    if (!rules) return;
+
+    for (size_t i = 0; i < rules->name_capacity; i++) {
+        free(rules->names[i].name);
+    }
+    for (size_t i = 0; i < rules->edge_capacity; i++) {
+        free(rules->edges[i].name);
+    }
+    free(rules->names);
+    free(rules->edges);
+    free(rules->terminal);
+    free(rules);
+}
+
+skip_cursor_t skip_rules_locate(const skip_rules_t *rules, const char *dir_path) {
+    if (!rules || !dir_path) return SKIP_CURSOR_NONE;
+
+    const char *p = skip_volume_relative(dir_path);
+    skip_cursor_t cursor = SKIP_ROOT_NODE;
+
+    while (*p && cursor != SKIP_CURSOR_NONE) {
+        while (SKIP_IS_SEP(*p)) p++;
+        if (!*p) break;
+
+        const char *start = p;
+        while (*p && !SKIP_IS_SEP(*p)) p++;
+        cursor = skip_edge_find(rules, cursor, start, (size_t)(p - start));
+    }
+    return cursor;
+}
+
+bool skip_rules_check(const skip_rules_t *rules, skip_cursor_t cursor, const char *name,
+                      skip_cursor_t *child_cursor) {
+    if (child_cursor) *child_cursor = SKIP_CURSOR_NONE;
+    if (!rules || !name) return false;
+
+    size_t len = strlen(name);
+
+    if (rules->name_count > 0) {
+        uint64_t hash = skip_hash(name, len, 0);
+        size_t mask = rules->name_capacity - 1;
+        for (size_t at = (size_t)hash & mask; rules->names[at].name; at = (at + 1) & mask) {
+            if (rules->names[at].hash == hash && skip_name_equals(rules->names[at].name, name, len)) {
+                return true;
+            }
+        }
+    }
+
+    if (cursor == SKIP_CURSOR_NONE) return false;
+
+    skip_cursor_t child = skip_edge_find(rules, cursor, name, len);
+    if (child != SKIP_CURSOR_NONE && rules->terminal[child]) {
+        return true;
+    }
+    if (child_cursor) *child_cursor = child;
+    return false;
+}
@@ -0,0 +1,33 @@
+#ifndef SKIPLIST_H
+#define SKIPLIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Directories to leave out of a walk: bare names skipped at any depth, and
+// paths relative to the volume root ("Windows\System32") skipped only there.
+// Built once per search, then read-only and shared by all workers.
+typedef struct skip_rules skip_rules_t;
+
+// Position in the path trie, carried from a directory to its children so
+// each check is a single lookup.
+typedef uint32_t skip_cursor_t;
+#define SKIP_CURSOR_NONE UINT32_MAX
+
+// Starts from the built-in system paths; the common build/VCS names are
+// added too when with_common_names is set.
+skip_rules_t* skip_rules_create(bool with_common_names);
+bool skip_rules_add_name(skip_rules_t *rules, const char *name);
+bool skip_rules_add_path(skip_rules_t *rules, const char *path);
+void skip_rules_destroy(skip_rules_t *rules);
+
+// Cursor for an arbitrary directory, walked once from its volume root.
+skip_cursor_t skip_rules_locate(const skip_rules_t *rules, const char *dir_path);
+
+// True when the child called name of the directory at cursor is skipped;
+// *child_cursor receives the cursor to hand to that child otherwise.
+bool skip_rules_check(const skip_rules_t *rules, skip_cursor_t cursor, const char *name,
+                      skip_cursor_t *child_cursor);
+
+#endif
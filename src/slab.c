@@ -0,0 +1,186 @@
+#include "slab.h"
+#include "sync.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SLAB_BATCH 64                 // objects moved between a cache and the depot at once
+#define SLAB_CHUNK_OBJECTS 256        // objects carved from one malloc
+#define SLAB_ALIGN 16
+
+// Free objects are chained through their first word; the first object of a
+// batch parked in the depot also links to the next batch in its second word.
+typedef struct slab_free_object {
+    struct slab_free_object *next;
+    struct slab_free_object *next_batch;
+} slab_free_object_t;
+
+typedef struct slab_chunk {
+    struct slab_chunk *next;
+} slab_chunk_t;
+
+typedef struct {
+    slab_free_object_t *head;
+    size_t count;
+    char padding[64 - sizeof(slab_free_object_t*) - sizeof(size_t)];
+} slab_cache_t;
+
+struct slab_pool {
+    size_t object_size;
+    size_t cache_count;
+    slab_cache_t *caches;
+
+    sync_mutex_t lock;                // guards the depot and the chunk list
+    slab_free_object_t *depot;        // full batches
+    slab_free_object_t *loose;        // objects freed without a cache
+    size_t loose_count;
+    slab_chunk_t *chunks;
+};
+
+slab_pool_t* slab_pool_create(size_t object_size, size_t cache_count) {
+    slab_pool_t *pool = calloc(1, sizeof(slab_pool_t));
+    if (!pool) return NULL;
+
+    if (object_size < sizeof(slab_free_object_t)) {
+        object_size = sizeof(slab_free_object_t);
+    }
+    pool->object_size = (object_size + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1);
+    pool->cache_count = cache_count;
+
+    pool->caches = calloc(cache_count > 0 ? cache_count : 1, sizeof(slab_cache_t));
+    if (!pool->caches || !sync_mutex_init(&pool->lock)) {
+        free(pool->caches);
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+// Carves a new chunk into a chain of free objects. Called with the lock held.
+static slab_free_object_t* slab_grow_locked(slab_pool_t *pool, size_t *count) {
+    size_t header = (sizeof(slab_chunk_t) + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1);
+    slab_chunk_t *chunk = malloc(header + SLAB_CHUNK_OBJECTS * pool->object_size);
+    if (!chunk) return NULL;
+
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+
+    char *base = (char*)chunk + header;
+    slab_free_object_t *head = NULL;
+    for (size_t i = SLAB_CHUNK_OBJECTS; i-- > 0;) {
+        slab_free_object_t *object = (slab_free_object_t*)(base + i * pool->object_size);
+        object->next = head;
+        head = object;
+    }
+    *count = SLAB_CHUNK_OBJECTS;
+    return head;
+}
+
+// Refills an empty cache with a parked batch, or a fresh chunk.
+static void slab_refill(slab_pool_t *pool, slab_cache_t *cache) {
+    sync_mutex_lock(&pool->lock);
+    if (pool->depot) {
+        slab_free_object_t *batch = pool->depot;
+        pool->depot = batch->next_batch;
+        cache->head = batch;
+        cache->count = SLAB_BATCH;
+    } else if (pool->loose) {
+        cache->head = pool->loose;
+        cache->count = pool->loose_count;
+        pool->loose = NULL;
+        pool->loose_count = 0;
+    } else {
+        cache->head = slab_grow_locked(pool, &cache->count);
+    }
+    sync_mutex_unlock(&pool->lock);
+}
+
+// Detaches SLAB_BATCH objects from an overfull cache and parks them.
+static void slab_flush(slab_pool_t *pool, slab_cache_t *cache) {
+    slab_free_object_t *batch = cache->head;
+    slab_free_object_t *last = batch;
+    for (size_t i = 1; i < SLAB_BATCH; i++) {
+        last = last->next;
+    }
+    cache->head = last->next;
+    cache->count -= SLAB_BATCH;
+    last->next = NULL;
+
+    sync_mutex_lock(&pool->lock);
+    batch->next_batch = pool->depot;
+    pool->depot = batch;
+    sync_mutex_unlock(&pool->lock);
+}
+
+void* slab_alloc(slab_pool_t *pool, size_t cache_index) {
+    if (!pool) return NULL;
+
+    if (cache_index >= pool->cache_count) {
+        sync_mutex_lock(&pool->lock);
+        slab_free_object_t *object = pool->loose;
+        if (object) {
+            pool->loose = object->next;
+            pool->loose_count--;
+        } else if (pool->depot) {
+            // Break a parked batch up into loose objects.
+            object = pool->depot;
+            pool->depot = object->next_batch;
+            pool->loose = object->next;
+            pool->loose_count = SLAB_BATCH - 1;
+        } else {
+            size_t count = 0;
+            object = slab_grow_locked(pool, &count);
+            if (object) {
+                pool->loose = object->next;
+                pool->loose_count = count - 1;
+            }
+        }
+        sync_mutex_unlock(&pool->lock);
+        return object;
+    }
+
+    slab_cache_t *cache = &pool->caches[cache_index];
+    if (!cache->head) {
+        slab_refill(pool, cache);
+        if (!cache->head) return NULL;
+    }
+
+    slab_free_object_t *object = cache->head;
+    cache->head = object->next;
+    cache->count--;
+    return object;
+}
+
+void slab_free(slab_pool_t *pool, size_t cache_index, void *object) {
+    if (!pool || !object) return;
+
+    slab_free_object_t *node = (slab_free_object_t*)object;
+
+    if (cache_index >= pool->cache_count) {
+        sync_mutex_lock(&pool->lock);
+        node->next = pool->loose;
+        pool->loose = node;
+        pool->loose_count++;
+        sync_mutex_unlock(&pool->lock);
+        return;
+    }
+
+    slab_cache_t *cache = &pool->caches[cache_index];
+    node->next = cache->head;
+    cache->head = node;
+    if (++cache->count >= 2 * SLAB_BATCH) {
+        slab_flush(pool, cache);
+    }
+}
+
+void slab_pool_destroy(slab_pool_t *pool) {
+    if (!pool) return;
+
+    while (pool->chunks) {
+        slab_chunk_t *next = pool->chunks->next;
+        free(pool->chunks);
+        pool->chunks = next;
+    }
+    sync_mutex_destroy(&pool->lock);
+    free(pool->caches);
+    free(pool);
+}
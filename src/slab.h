@@ -0,0 +1,26 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Fixed-size object allocator with one unlocked cache per worker. Objects
+// freed on another worker than the one that allocated them simply join the
+// freeing worker's cache; caches that grow too large hand a whole batch to
+// a shared depot, and empty caches refill a batch at a time from it, so the
+// shared lock is taken once per batch rather than once per object.
+typedef struct slab_pool slab_pool_t;
+
+#define SLAB_NO_CACHE ((size_t)-1)
+
+// cache_count is the number of workers; any other cache index (including
+// SLAB_NO_CACHE) goes straight to the locked depot.
+slab_pool_t* slab_pool_create(size_t object_size, size_t cache_count);
+
+void* slab_alloc(slab_pool_t *pool, size_t cache);
+void slab_free(slab_pool_t *pool, size_t cache, void *object);
+
+// Releases every chunk at once; outstanding objects become invalid.
+void slab_pool_destroy(slab_pool_t *pool);
+
+#endif
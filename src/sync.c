@@ -0,0 +1,242 @@
+// Must come before any system header, sync.h's included: strict C17 hides
+// clock_gettime, CLOCK_MONOTONIC and pthread_condattr_setclock otherwise.
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "sync.h"
+
+#ifdef _WIN32
+
+bool sync_mutex_init(sync_mutex_t *mutex) {
+    return InitializeCriticalSectionAndSpinCount(&mutex->cs, 4000) != 0;
+}
+
+void sync_mutex_lock(sync_mutex_t *mutex) {
+    EnterCriticalSection(&mutex->cs);
+}
+
+void sync_mutex_unlock(sync_mutex_t *mutex) {
+    LeaveCriticalSection(&mutex->cs);
+}
+
+void sync_mutex_destroy(sync_mutex_t *mutex) {
+    DeleteCriticalSection(&mutex->cs);
+}
+
+bool sync_cond_init(sync_cond_t *cond) {
+    InitializeConditionVariable(&cond->cv);
+    return true;
+}
+
+bool sync_cond_wait(sync_cond_t *cond, sync_mutex_t *mutex, uint32_t timeout_ms) {
+    DWORD wait = timeout_ms == SYNC_WAIT_INFINITE ? INFINITE : (DWORD)timeout_ms;
+    return SleepConditionVariableCS(&cond->cv, &mutex->cs, wait) != 0;
+}
+
+void sync_cond_signal(sync_cond_t *cond) {
+    WakeConditionVariable(&cond->cv);
+}
+
+void sync_cond_broadcast(sync_cond_t *cond) {
+    WakeAllConditionVariable(&cond->cv);
+}
+
+void sync_cond_destroy(sync_cond_t *cond) {
+    (void)cond;
+}
+
+static DWORD WINAPI sync_thread_main(LPVOID param) {
+    sync_thread_t *thread = (sync_thread_t*)param;
+    thread->fn(thread->arg);
+    return 0;
+}
+
+bool sync_thread_start(sync_thread_t *thread, void (*fn)(void *arg), void *arg) {
+    thread->fn = fn;
+    thread->arg = arg;
+    thread->handle = CreateThread(NULL, 0, sync_thread_main, thread, 0, NULL);
+    return thread->handle != NULL;
+}
+
+void sync_thread_join(sync_thread_t *thread) {
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    thread->handle = NULL;
+}
+
+uint64_t sync_now_ns(void) {
+    static LARGE_INTEGER frequency;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    uint64_t ticks = (uint64_t)counter.QuadPart;
+    uint64_t freq = (uint64_t)frequency.QuadPart;
+    // Split to avoid overflowing ticks * 1e9.
+    return (ticks / freq) * 1000000000u + (ticks % freq) * 1000000000u / freq;
+}
+
+uint64_t sync_now_ms(void) {
+    return sync_now_ns() / 1000000u;
+}
+
+void sync_sleep_ms(uint32_t ms) {
+    Sleep(ms);
+}
+
+size_t sync_cpu_count(void) {
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    return system_info.dwNumberOfProcessors > 0 ? system_info.dwNumberOfProcessors : 1;
+}
+
+#else
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+bool sync_mutex_init(sync_mutex_t *mutex) {
+    return pthread_mutex_init(&mutex->mutex, NULL) == 0;
+}
+
+void sync_mutex_lock(sync_mutex_t *mutex) {
+    pthread_mutex_lock(&mutex->mutex);
+}
+
+void sync_mutex_unlock(sync_mutex_t *mutex) {
+    pthread_mutex_unlock(&mutex->mutex);
+}
+
+void sync_mutex_destroy(sync_mutex_t *mutex) {
+    pthread_mutex_destroy(&mutex->mutex);
+}
+
+bool sync_cond_init(sync_cond_t *cond) {
+    pthread_condattr_t attr;
+    if (pthread_condattr_init(&attr) != 0) return false;
+    // Timed waits are measured on the monotonic clock, like sync_now_ms().
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    bool ok = pthread_cond_init(&cond->cond, &attr) == 0;
+    pthread_condattr_destroy(&attr);
+    return ok;
+}
+
+bool sync_cond_wait(sync_cond_t *cond, sync_mutex_t *mutex, uint32_t timeout_ms) {
+    if (timeout_ms == SYNC_WAIT_INFINITE) {
+        return pthread_cond_wait(&cond->cond, &mutex->mutex) == 0;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return pthread_cond_timedwait(&cond->cond, &mutex->mutex, &deadline) != ETIMEDOUT;
+}
+
+void sync_cond_signal(sync_cond_t *cond) {
+    pthread_cond_signal(&cond->cond);
+}
+
+void sync_cond_broadcast(sync_cond_t *cond) {
+    pthread_cond_broadcast(&cond->cond);
+}
+
+void sync_cond_destroy(sync_cond_t *cond) {
+    pthread_cond_destroy(&cond->cond);
+}
+
+static void* sync_thread_main(void *param) {
+    sync_thread_t *thread = (sync_thread_t*)param;
+    thread->fn(thread->arg);
+    return NULL;
+}
+
+bool sync_thread_start(sync_thread_t *thread, void (*fn)(void *arg), void *arg) {
+    thread->fn = fn;
+    thread->arg = arg;
+    return pthread_create(&thread->handle, NULL, sync_thread_main, thread) == 0;
+}
+
+void sync_thread_join(sync_thread_t *thread) {
+    pthread_join(thread->handle, NULL);
+}
+
+uint64_t sync_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+uint64_t sync_now_ms(void) {
+    return sync_now_ns() / 1000000u;
+}
+
+void sync_sleep_ms(uint32_t ms) {
+    struct timespec delay = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+    }
+}
+
+size_t sync_cpu_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t)count : 1;
+}
+
+#endif
+
+#include <stdlib.h>
+
+struct sync_counter_shard {
+    atomic_uint_least64_t value;
+    char padding[SYNC_CACHE_LINE - sizeof(atomic_uint_least64_t)];
+};
+
+bool sync_counter_init(sync_counter_t *counter, size_t owned_shards) {
+    // malloc only promises 16-byte alignment; round up to a line by hand.
+    size_t count = owned_shards + 1;
+    counter->memory = calloc(1, count * sizeof(struct sync_counter_shard) + SYNC_CACHE_LINE - 1);
+    if (!counter->memory) return false;
+
+    uintptr_t aligned = ((uintptr_t)counter->memory + SYNC_CACHE_LINE - 1) & ~(uintptr_t)(SYNC_CACHE_LINE - 1);
+    counter->shards = (struct sync_counter_shard*)aligned;
+    counter->owned_shards = owned_shards;
+    for (size_t i = 0; i < count; i++) {
+        atomic_init(&counter->shards[i].value, 0);
+    }
+    return true;
+}
+
+void sync_counter_add(sync_counter_t *counter, size_t shard, uint64_t delta) {
+    if (shard < counter->owned_shards) {
+        // Single writer: a plain read-modify-write without a locked instruction.
+        atomic_uint_least64_t *value = &counter->shards[shard].value;
+        atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + delta,
+                              memory_order_relaxed);
+    } else {
+        atomic_fetch_add_explicit(&counter->shards[counter->owned_shards].value, delta, memory_order_relaxed);
+    }
+}
+
+uint64_t sync_counter_read(const sync_counter_t *counter) {
+    if (!counter->shards) return 0;
+
+    uint64_t total = 0;
+    for (size_t i = 0; i <= counter->owned_shards; i++) {
+        total += atomic_load_explicit(&counter->shards[i].value, memory_order_relaxed);
+    }
+    return total;
+}
+
+void sync_counter_destroy(sync_counter_t *counter) {
+    free(counter->memory);
+    counter->memory = NULL;
+    counter->shards = NULL;
+}
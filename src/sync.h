@@ -0,0 +1,89 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Minimal threading primitives over Win32 or pthreads, for the code that
+// has to run on both (the thread pool).
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef struct {
+    CRITICAL_SECTION cs;
+} sync_mutex_t;
+
+typedef struct {
+    CONDITION_VARIABLE cv;
+} sync_cond_t;
+
+typedef struct sync_thread {
+    HANDLE handle;
+    void (*fn)(void *arg);
+    void *arg;
+} sync_thread_t;
+#else
+#include <pthread.h>
+
+typedef struct {
+    pthread_mutex_t mutex;
+} sync_mutex_t;
+
+typedef struct {
+    pthread_cond_t cond;
+} sync_cond_t;
+
+typedef struct sync_thread {
+    pthread_t handle;
+    void (*fn)(void *arg);
+    void *arg;
+} sync_thread_t;
+#endif
+
+#define SYNC_WAIT_INFINITE UINT32_MAX
+
+bool sync_mutex_init(sync_mutex_t *mutex);
+void sync_mutex_lock(sync_mutex_t *mutex);
+void sync_mutex_unlock(sync_mutex_t *mutex);
+void sync_mutex_destroy(sync_mutex_t *mutex);
+
+bool sync_cond_init(sync_cond_t *cond);
+// Returns false on timeout. Spurious wakeups are possible, as usual.
+bool sync_cond_wait(sync_cond_t *cond, sync_mutex_t *mutex, uint32_t timeout_ms);
+void sync_cond_signal(sync_cond_t *cond);
+void sync_cond_broadcast(sync_cond_t *cond);
+void sync_cond_destroy(sync_cond_t *cond);
+
+// The sync_thread_t must stay in place until sync_thread_join() returns.
+bool sync_thread_start(sync_thread_t *thread, void (*fn)(void *arg), void *arg);
+void sync_thread_join(sync_thread_t *thread);
+
+// Monotonic clock; sync_now_ns() uses the highest resolution available.
+uint64_t sync_now_ns(void);
+uint64_t sync_now_ms(void);
+void sync_sleep_ms(uint32_t ms);
+size_t sync_cpu_count(void);
+
+#define SYNC_CACHE_LINE 64
+
+// Counter split into cache-line-sized shards so threads that bump it often
+// do not fight over one line. Shards below owned_shards each belong to a
+// single thread (a pool worker index); any other index lands in one extra
+// shared shard. Reads sum every shard, so they are only as exact as a
+// snapshot of concurrently moving counts can be. Subtracting is adding the
+// two's complement.
+typedef struct {
+    void *memory;
+    struct sync_counter_shard *shards;
+    size_t owned_shards;
+} sync_counter_t;
+
+bool sync_counter_init(sync_counter_t *counter, size_t owned_shards);
+void sync_counter_add(sync_counter_t *counter, size_t shard, uint64_t delta);
+uint64_t sync_counter_read(const sync_counter_t *counter);
+void sync_counter_destroy(sync_counter_t *counter);
+
+#endif
@@ -1,45 +1,409 @@
 #include "thread_pool.h"
+#include "sync.h"
+#include "slab.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stddef.h>
 
-struct thread_pool {
-    PTP_POOL pool;
-    TP_CALLBACK_ENVIRON callback_environ;
-    PTP_CLEANUP_GROUP cleanup_group;
-    atomic_size_t active_work_items;
-    atomic_size_t completed_work_items;
-    atomic_size_t total_submitted;
-    atomic_size_t queued_work_items;  // Track queued items ourselves
-    thread_pool_config_t config;
-    CRITICAL_SECTION stats_lock;
-};
+#define TP_DEQUE_INITIAL_CAPACITY 256
+#define TP_STEAL_ROUNDS 2
 
-typedef struct {
+#define TP_CONTROL_INTERVAL_NS 250000000u   // how often the active worker count is revisited
+#define TP_CONTROL_MIN_SAMPLES 32           // fewer completions than this are too noisy to judge
+
+typedef struct work_item {
     work_function_t work_func;
     void *user_data;
-    thread_pool_t *pool;
+    struct work_item *next;           // injection queue link
 } work_item_t;
 
-static VOID CALLBACK thread_pool_work_callback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_WORK work) {
-    (void)instance;
+// Circular buffer of a Chase-Lev deque. Replaced buffers are kept until the
+// pool is destroyed because a thief may still be reading from one.
+typedef struct tp_buffer {
+    long long capacity;
+    struct tp_buffer *retired_next;
+    _Atomic(work_item_t*) slots[];
+} tp_buffer_t;
+
+typedef struct {
+    thread_pool_t *pool;
+    size_t index;
+    sync_thread_t thread;
+    bool started;
+
+    // The owner pushes and takes at the bottom; thieves take from the top.
+    atomic_llong top;
+    atomic_llong bottom;
+    _Atomic(tp_buffer_t*) buffer;
+    tp_buffer_t *retired;
+
+    uint64_t rng;
+} tp_worker_t;
+
+// Hill-climbing state of the concurrency controller. Only the thread that
+// wins tp_control's try-lock touches it.
+typedef struct {
+    atomic_bool busy;
+    uint64_t last_time;
+    size_t last_completed;
+    uint64_t last_busy_ns;
+    double last_throughput;           // items per second at the current limit
+    double last_latency_ns;           // average item run time at the current limit
+    int direction;                    // +1 or -1
+} tp_controller_t;
+
+// Fields are grouped by who writes them, with a line of padding between the
+// groups: read-mostly configuration, the two counts every submit and run
+// touch, the lock-protected queues, and the controller.
+struct thread_pool {
+    tp_worker_t *workers;
+    size_t worker_count;              // also the upper bound on concurrency
+    size_t min_active;
+    slab_pool_t *items;               // one cache per worker
+    thread_pool_config_t config;
+    atomic_size_t active_limit;       // workers at or above it sleep on 'throttle'
+    atomic_bool shutdown;
+    char padding_config[SYNC_CACHE_LINE];
+
+    atomic_size_t active_work_items;  // submitted and not yet finished
+    atomic_size_t queued_work_items;  // submitted and not yet started
+    char padding_counts[SYNC_CACHE_LINE];
+
+    sync_mutex_t lock;                // guards the queues and parking
+    sync_cond_t wake;
+    sync_cond_t idle;                 // signalled when active_work_items hits zero
+    sync_cond_t throttle;
+    work_item_t *inject_head;
+    work_item_t *inject_tail;
+    atomic_size_t inject_count;       // lets workers skip the lock when empty
+    work_item_t *priority_head[THREAD_POOL_PRIORITY_LEVELS];
+    work_item_t *priority_tail[THREAD_POOL_PRIORITY_LEVELS];
+    atomic_size_t priority_count;
+    atomic_size_t sleeping;
+    char padding_queues[SYNC_CACHE_LINE];
+
+    atomic_uint_least64_t next_control_ns;
+    atomic_size_t peak_limit;
+    atomic_size_t limit_changes;
+    tp_controller_t controller;
+
+    // Per-worker shards, summed only when read.
+    sync_counter_t completed_work_items;
+    sync_counter_t total_submitted;
+    sync_counter_t stolen_work_items;
+    sync_counter_t busy_ns;           // summed run time of finished items
+};
+
+static _Thread_local tp_worker_t *tp_current_worker = NULL;
+
+static tp_buffer_t* tp_buffer_create(long long capacity) {
+    tp_buffer_t *buffer = malloc(sizeof(tp_buffer_t) + (size_t)capacity * sizeof(_Atomic(work_item_t*)));
+    if (!buffer) return NULL;
+    buffer->capacity = capacity;
+    buffer->retired_next = NULL;
+    return buffer;
+}
+
+static bool tp_deque_push(tp_worker_t *worker, work_item_t *item) {
+    long long b = atomic_load_explicit(&worker->bottom, memory_order_relaxed);
+    long long t = atomic_load_explicit(&worker->top, memory_order_acquire);
+    tp_buffer_t *buffer = atomic_load_explicit(&worker->buffer, memory_order_relaxed);
+
+    if (b - t > buffer->capacity - 1) {
+        tp_buffer_t *grown = tp_buffer_create(buffer->capacity * 2);
+        if (!grown) return false;
+        for (long long i = t; i < b; i++) {
+            work_item_t *moved = atomic_load_explicit(&buffer->slots[i & (buffer->capacity - 1)],
+                                                      memory_order_relaxed);
+            atomic_store_explicit(&grown->slots[i & (grown->capacity - 1)], moved, memory_order_relaxed);
+        }
+        buffer->retired_next = worker->retired;
+        worker->retired = buffer;
+        atomic_store_explicit(&worker->buffer, grown, memory_order_release);
+        buffer = grown;
+    }
+
+    atomic_store_explicit(&buffer->slots[b & (buffer->capacity - 1)], item, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&worker->bottom, b + 1, memory_order_relaxed);
+    return true;
+}
+
+static work_item_t* tp_deque_take(tp_worker_t *worker) {
+    long long b = atomic_load_explicit(&worker->bottom, memory_order_relaxed) - 1;
+    tp_buffer_t *buffer = atomic_load_explicit(&worker->buffer, memory_order_relaxed);
+    atomic_store_explicit(&worker->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long t = atomic_load_explicit(&worker->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&worker->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    work_item_t *item = atomic_load_explicit(&buffer->slots[b & (buffer->capacity - 1)], memory_order_relaxed);
+    if (t == b) {
+        // Last item: race the thieves for it.
+        if (!atomic_compare_exchange_strong_explicit(&worker->top, &t, t + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed)) {
+            item = NULL;
+        }
+        atomic_store_explicit(&worker->bottom, b + 1, memory_order_relaxed);
+    }
+    return item;
+}
 
-    work_item_t *item = (work_item_t*)context;
+static work_item_t* tp_deque_steal(tp_worker_t *victim) {
+    long long t = atomic_load_explicit(&victim->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long b = atomic_load_explicit(&victim->bottom, memory_order_acquire);
+    if (t >= b) return NULL;
 
-    atomic_fetch_sub(&item->pool->queued_work_items, 1);
+    tp_buffer_t *buffer = atomic_load_explicit(&victim->buffer, memory_order_acquire);
+    work_item_t *item = atomic_load_explicit(&buffer->slots[t & (buffer->capacity - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&victim->top, &t, t + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+    return item;
+}
 
-    if (item->pool->config.stop_flag && atomic_load(item->pool->config.stop_flag)) {
-        goto cleanup;
+static work_item_t* tp_inject_pop(thread_pool_t *pool) {
+    sync_mutex_lock(&pool->lock);
+    work_item_t *item = pool->inject_head;
+    if (item) {
+        pool->inject_head = item->next;
+        if (!pool->inject_head) {
+            pool->inject_tail = NULL;
+        }
+        atomic_fetch_sub(&pool->inject_count, 1);
     }
+    sync_mutex_unlock(&pool->lock);
+    return item;
+}
+
+static work_item_t* tp_priority_pop(thread_pool_t *pool) {
+    work_item_t *item = NULL;
+    sync_mutex_lock(&pool->lock);
+    for (size_t level = 0; level < THREAD_POOL_PRIORITY_LEVELS; level++) {
+        item = pool->priority_head[level];
+        if (item) {
+            pool->priority_head[level] = item->next;
+            if (!item->next) {
+                pool->priority_tail[level] = NULL;
+            }
+            atomic_fetch_sub(&pool->priority_count, 1);
+            break;
+        }
+    }
+    sync_mutex_unlock(&pool->lock);
+    return item;
+}
+
+static uint64_t tp_next_random(tp_worker_t *worker) {
+    uint64_t x = worker->rng;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    worker->rng = x;
+    return x;
+}
+
+static work_item_t* tp_find_work(tp_worker_t *self) {
+    thread_pool_t *pool = self->pool;
+    work_item_t *item;
+
+    if (atomic_load_explicit(&pool->priority_count, memory_order_relaxed) > 0) {
+        item = tp_priority_pop(pool);
+        if (item) return item;
+    }
+
+    item = tp_deque_take(self);
+    if (item) return item;
+
+    if (atomic_load_explicit(&pool->inject_count, memory_order_relaxed) > 0) {
+        item = tp_inject_pop(pool);
+        if (item) return item;
+    }
+
+    size_t count = pool->worker_count;
+    for (int round = 0; round < TP_STEAL_ROUNDS; round++) {
+        size_t start = (size_t)(tp_next_random(self) % count);
+        for (size_t i = 0; i < count; i++) {
+            tp_worker_t *victim = &pool->workers[(start + i) % count];
+            if (victim == self) continue;
+            item = tp_deque_steal(victim);
+            if (item) {
+                sync_counter_add(&pool->stolen_work_items, self->index, 1);
+                return item;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void tp_wake_one(thread_pool_t *pool) {
+    // Pairs with the sleeping/queued re-check in tp_park(): either the
+    // sleeper sees the new item, or we see the sleeper and signal it.
+    if (atomic_load(&pool->sleeping) > 0) {
+        sync_mutex_lock(&pool->lock);
+        sync_cond_signal(&pool->wake);
+        sync_mutex_unlock(&pool->lock);
+    }
+}
+
+static void tp_park(thread_pool_t *pool) {
+    sync_mutex_lock(&pool->lock);
+    atomic_fetch_add(&pool->sleeping, 1);
+    if (atomic_load(&pool->queued_work_items) == 0 && !atomic_load(&pool->shutdown)) {
+        sync_cond_wait(&pool->wake, &pool->lock, SYNC_WAIT_INFINITE);
+    }
+    atomic_fetch_sub(&pool->sleeping, 1);
+    sync_mutex_unlock(&pool->lock);
+}
+
+static void tp_set_limit(thread_pool_t *pool, size_t limit) {
+    size_t previous = atomic_exchange(&pool->active_limit, limit);
+    if (limit == previous) return;
+
+    atomic_fetch_add(&pool->limit_changes, 1);
+    size_t peak = atomic_load(&pool->peak_limit);
+    while (limit > peak && !atomic_compare_exchange_weak(&pool->peak_limit, &peak, limit)) {
+    }
+    if (limit > previous) {
+        sync_mutex_lock(&pool->lock);
+        sync_cond_broadcast(&pool->throttle);
+        sync_mutex_unlock(&pool->lock);
+    }
+}
+
+// One step of the controller: keep moving the limit in the direction that
+// raised throughput, turn around when it fell, and back off when an extra
+// worker bought nothing. A sharp throughput drop with rising latency means
+// the device is thrashing, so the limit is cut by a quarter rather than one
+// step (AIMD-style). The limit only grows while work is actually waiting.
+static void tp_control(thread_pool_t *pool, uint64_t now) {
+    tp_controller_t *ctl = &pool->controller;
+    if (atomic_exchange(&ctl->busy, true)) return;
+
+    size_t completed = (size_t)sync_counter_read(&pool->completed_work_items);
+    uint64_t busy_ns = sync_counter_read(&pool->busy_ns);
+    size_t samples = completed - ctl->last_completed;
+    if (samples < TP_CONTROL_MIN_SAMPLES || now <= ctl->last_time) {
+        atomic_store(&ctl->busy, false);
+        return;
+    }
+
+    double throughput = (double)samples * 1e9 / (double)(now - ctl->last_time);
+    double latency_ns = (double)(busy_ns - ctl->last_busy_ns) / (double)samples;
+    size_t limit = atomic_load(&pool->active_limit);
+    // More workers only help while every running one is busy and work waits.
+    bool saturated = atomic_load(&pool->queued_work_items) > 0 && atomic_load(&pool->sleeping) == 0;
+    size_t step = limit / 8 > 0 ? limit / 8 : 1;
+    size_t next = limit;
+
+    if (ctl->last_throughput > 0) {
+        double ratio = throughput / ctl->last_throughput;
+        if (ratio < 0.75 && latency_ns > ctl->last_latency_ns * 1.5) {
+            ctl->direction = -1;
+            step = limit / 4 > 0 ? limit / 4 : 1;
+        } else if (ratio < 0.95) {
+            ctl->direction = -ctl->direction;
+        } else if (ratio <= 1.05) {
+            ctl->direction = -1;
+        }
+    }
+
+    if (ctl->direction > 0) {
+        if (saturated) {
+            next = limit + step < pool->worker_count ? limit + step : pool->worker_count;
+        }
+    } else {
+        next = limit > pool->min_active + step ? limit - step : pool->min_active;
+    }
+
+    // Nothing to learn when the limit is pinned against a bound.
+    if (next == limit && limit == pool->min_active) {
+        ctl->direction = 1;
+    }
+
+    ctl->last_time = now;
+    ctl->last_completed = completed;
+    ctl->last_busy_ns = busy_ns;
+    ctl->last_throughput = throughput;
+    ctl->last_latency_ns = latency_ns;
 
+    tp_set_limit(pool, next);
+    atomic_store(&ctl->busy, false);
+}
+
+static void tp_run_item(tp_worker_t *self, work_item_t *item) {
+    thread_pool_t *pool = self->pool;
+    bool adaptive = pool->min_active < pool->worker_count;
+    uint64_t started = adaptive ? sync_now_ns() : 0;
+
+    atomic_fetch_sub(&pool->queued_work_items, 1);
     item->work_func(item, item->user_data);
 
-    atomic_fetch_add(&item->pool->completed_work_items, 1);
-    atomic_fetch_sub(&item->pool->active_work_items, 1);
+    slab_free(pool->items, self->index, item);
+
+    if (adaptive) {
+        uint64_t now = sync_now_ns();
+        sync_counter_add(&pool->busy_ns, self->index, now - started);
+
+        uint64_t due = atomic_load_explicit(&pool->next_control_ns, memory_order_relaxed);
+        if (now >= due && atomic_compare_exchange_strong(&pool->next_control_ns, &due,
+                                                         now + TP_CONTROL_INTERVAL_NS)) {
+            tp_control(pool, now);
+        }
+    }
+
+    sync_counter_add(&pool->completed_work_items, self->index, 1);
+    if (atomic_fetch_sub(&pool->active_work_items, 1) == 1) {
+        // Taking the lock orders this against a waiter that has just seen a
+        // non-zero count and is about to block.
+        sync_mutex_lock(&pool->lock);
+        sync_cond_broadcast(&pool->idle);
+        sync_mutex_unlock(&pool->lock);
+    }
+}
+
+static void tp_worker_main(void *arg) {
+    tp_worker_t *self = (tp_worker_t*)arg;
+    thread_pool_t *pool = self->pool;
+    tp_current_worker = self;
+
+    for (;;) {
+        if (self->index >= atomic_load(&pool->active_limit) && !atomic_load(&pool->shutdown)) {
+            // Throttled: anything left in this worker's deque is stolen by
+            // the workers that are still running.
+            sync_mutex_lock(&pool->lock);
+            if (atomic_load(&pool->queued_work_items) > 0) {
+                // A wakeup meant for an active worker may have landed here.
+                sync_cond_signal(&pool->wake);
+            }
+            while (self->index >= atomic_load(&pool->active_limit) && !atomic_load(&pool->shutdown)) {
+                sync_cond_wait(&pool->throttle, &pool->lock, SYNC_WAIT_INFINITE);
+            }
+            sync_mutex_unlock(&pool->lock);
+            continue;
+        }
+
+        work_item_t *item = tp_find_work(self);
+        if (item) {
+            tp_run_item(self, item);
+            continue;
+        }
+
+        // Only leave once nothing is queued anywhere, so every accepted
+        // item gets to run and free its resources.
+        if (atomic_load(&pool->shutdown) && atomic_load(&pool->queued_work_items) == 0) {
+            break;
+        }
+        tp_park(pool);
+    }
 
-cleanup:
-    free(item);
-    CloseThreadpoolWork(work);
+    tp_current_worker = NULL;
 }
 
 thread_pool_t* thread_pool_create(const thread_pool_config_t *config) {
@@ -50,136 +414,291 @@ thread_pool_t* thread_pool_create(const thread_pool_config_t *config) {
 
     pool->config = *config;
 
+    size_t cpus = sync_cpu_count();
+    size_t max_active = config->max_threads;
+    if (max_active == 0) {
+        max_active = cpus * 4 < THREAD_POOL_AUTO_MAX ? cpus * 4 : THREAD_POOL_AUTO_MAX;
+        if (max_active < cpus) max_active = cpus;
+    }
+    size_t min_active = config->min_threads > 0 ? config->min_threads : 1;
+    if (min_active > max_active) min_active = max_active;
+    size_t initial = config->initial_threads > 0 ? config->initial_threads : cpus;
+    if (initial < min_active) initial = min_active;
+    if (initial > max_active) initial = max_active;
+
+    pool->worker_count = max_active;
+    pool->min_active = min_active;
+    atomic_init(&pool->active_limit, initial);
+    atomic_init(&pool->peak_limit, initial);
+    atomic_init(&pool->limit_changes, 0);
+    atomic_init(&pool->controller.busy, false);
+    pool->controller.direction = 1;
+    pool->controller.last_time = sync_now_ns();
+    atomic_init(&pool->next_control_ns, pool->controller.last_time + TP_CONTROL_INTERVAL_NS);
+
+    atomic_init(&pool->inject_count, 0);
+    atomic_init(&pool->priority_count, 0);
+    atomic_init(&pool->sleeping, 0);
+    atomic_init(&pool->shutdown, false);
     atomic_init(&pool->active_work_items, 0);
-    atomic_init(&pool->completed_work_items, 0);
-    atomic_init(&pool->total_submitted, 0);
     atomic_init(&pool->queued_work_items, 0);
 
-    if (!InitializeCriticalSectionAndSpinCount(&pool->stats_lock, 4000)) {
+    if (!sync_mutex_init(&pool->lock)) {
         free(pool);
         return NULL;
     }
-
-    pool->pool = CreateThreadpool(NULL);
-    if (!pool->pool) {
-        DeleteCriticalSection(&pool->stats_lock);
+    if (!sync_cond_init(&pool->wake)) {
+        sync_mutex_destroy(&pool->lock);
+        free(pool);
+        return NULL;
+    }
+    if (!sync_cond_init(&pool->idle)) {
+        sync_cond_destroy(&pool->wake);
+        sync_mutex_destroy(&pool->lock);
+        free(pool);
+        return NULL;
+    }
+    if (!sync_cond_init(&pool->throttle)) {
+        sync_cond_destroy(&pool->idle);
+        sync_cond_destroy(&pool->wake);
+        sync_mutex_destroy(&pool->lock);
         free(pool);
         return NULL;
     }
 
-    if (config->max_threads > 0) {
-        SetThreadpoolThreadMaximum(pool->pool, (DWORD)config->max_threads);
-        SetThreadpoolThreadMinimum(pool->pool, 1);
+    pool->items = slab_pool_create(sizeof(work_item_t), pool->worker_count);
+    pool->workers = calloc(pool->worker_count, sizeof(tp_worker_t));
+    if (!pool->items || !pool->workers ||
+        !sync_counter_init(&pool->completed_work_items, pool->worker_count) ||
+        !sync_counter_init(&pool->total_submitted, pool->worker_count) ||
+        !sync_counter_init(&pool->stolen_work_items, pool->worker_count) ||
+        !sync_counter_init(&pool->busy_ns, pool->worker_count)) {
+        thread_pool_destroy(pool);
+        return NULL;
     }
 
-    InitializeThreadpoolEnvironment(&pool->callback_environ);
-    SetThreadpoolCallbackPool(&pool->callback_environ, pool->pool);
+    for (size_t i = 0; i < pool->worker_count; i++) {
+        tp_worker_t *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i;
+        worker->rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+        atomic_init(&worker->top, 0);
+        atomic_init(&worker->bottom, 0);
+
+        tp_buffer_t *buffer = tp_buffer_create(TP_DEQUE_INITIAL_CAPACITY);
+        atomic_init(&worker->buffer, buffer);
+        if (!buffer) {
+            thread_pool_destroy(pool);
+            return NULL;
+        }
+    }
 
-    pool->cleanup_group = CreateThreadpoolCleanupGroup();
-    if (pool->cleanup_group) {
-        SetThreadpoolCallbackCleanupGroup(&pool->callback_environ, pool->cleanup_group, NULL);
+    // Buffers are all in place before any thread may try to steal.
+    for (size_t i = 0; i < pool->worker_count; i++) {
+        tp_worker_t *worker = &pool->workers[i];
+        worker->started = sync_thread_start(&worker->thread, tp_worker_main, worker);
+        if (!worker->started) {
+            thread_pool_destroy(pool);
+            return NULL;
+        }
     }
 
     return pool;
 }
 
+static work_item_t* tp_item_create(thread_pool_t *pool, work_function_t work_func, void *user_data) {
+    if (cancel_token_cancelled(pool->config.cancel)) {
+        return NULL;
+    }
+
+    // Out-of-range indices map to the shared slab list and counter shard.
+    size_t index = thread_pool_worker_index(pool);
+    work_item_t *item = slab_alloc(pool->items, index);
+    if (!item) return NULL;
+
+    item->work_func = work_func;
+    item->user_data = user_data;
+    item->next = NULL;
+
+    atomic_fetch_add(&pool->active_work_items, 1);
+    atomic_fetch_add(&pool->queued_work_items, 1);
+    sync_counter_add(&pool->total_submitted, index, 1);
+    return item;
+}
+
 bool thread_pool_submit(thread_pool_t *pool, work_function_t work_func, void *user_data) {
     if (!pool || !work_func) return false;
 
-    if (pool->config.stop_flag && atomic_load(pool->config.stop_flag)) {
-        return false;
+    work_item_t *item = tp_item_create(pool, work_func, user_data);
+    if (!item) return false;
+
+    tp_worker_t *self = tp_current_worker;
+    bool local = self && self->pool == pool;
+
+    if (!local || !tp_deque_push(self, item)) {
+        sync_mutex_lock(&pool->lock);
+        if (pool->inject_tail) {
+            pool->inject_tail->next = item;
+        } else {
+            pool->inject_head = item;
+        }
+        pool->inject_tail = item;
+        atomic_fetch_add(&pool->inject_count, 1);
+        sync_mutex_unlock(&pool->lock);
     }
 
-    work_item_t *item = malloc(sizeof(work_item_t));
+    tp_wake_one(pool);
+    return true;
+}
+
+bool thread_pool_submit_priority(thread_pool_t *pool, work_function_t work_func, void *user_data,
+                                 unsigned priority) {
+    if (!pool || !work_func) return false;
+
+    work_item_t *item = tp_item_create(pool, work_func, user_data);
     if (!item) return false;
 
-    item->work_func = work_func;
-    item->user_data = user_data;
-    item->pool = pool;
+    size_t level = priority < THREAD_POOL_PRIORITY_LEVELS ? priority : THREAD_POOL_PRIORITY_LEVELS - 1;
 
-    PTP_WORK work = CreateThreadpoolWork(thread_pool_work_callback, item, &pool->callback_environ);
-    if (!work) {
-        free(item);
-        return false;
+    sync_mutex_lock(&pool->lock);
+    if (pool->priority_tail[level]) {
+        pool->priority_tail[level]->next = item;
+    } else {
+        pool->priority_head[level] = item;
     }
+    pool->priority_tail[level] = item;
+    atomic_fetch_add(&pool->priority_count, 1);
+    sync_mutex_unlock(&pool->lock);
 
-    atomic_fetch_add(&pool->queued_work_items, 1);
-    atomic_fetch_add(&pool->total_submitted, 1);
+    tp_wake_one(pool);
+    return true;
+}
 
-    SubmitThreadpoolWork(work);
+size_t thread_pool_worker_count(thread_pool_t *pool) {
+    return pool ? pool->worker_count : 0;
+}
 
-    atomic_fetch_add(&pool->active_work_items, 1);
+size_t thread_pool_worker_index(thread_pool_t *pool) {
+    tp_worker_t *self = tp_current_worker;
+    return self && self->pool == pool ? self->index : THREAD_POOL_NOT_A_WORKER;
+}
 
-    return true;
+bool thread_pool_has_idle_capacity(thread_pool_t *pool) {
+    if (!pool) return false;
+    return atomic_load_explicit(&pool->queued_work_items, memory_order_relaxed) <
+           atomic_load_explicit(&pool->active_limit, memory_order_relaxed);
 }
 
-bool thread_pool_wait_completion(thread_pool_t *pool, DWORD timeout_ms) {
+bool thread_pool_wait_completion(thread_pool_t *pool, uint32_t timeout_ms) {
     if (!pool) return false;
 
-    DWORD start_time = GetTickCount();
+    uint64_t interval_ns = (uint64_t)(pool->config.progress_interval_ms ? pool->config.progress_interval_ms
+                                                                        : THREAD_POOL_DEFAULT_PROGRESS_MS) * 1000000u;
+    uint64_t start = sync_now_ns();
+    uint64_t deadline = timeout_ms == THREAD_POOL_INFINITE ? UINT64_MAX : start + (uint64_t)timeout_ms * 1000000u;
+    uint64_t next_progress = start + interval_ns;
+    bool completed = true;
 
+    // The token's own deadline is another reason to wake up: checking it
+    // here latches it, so workers polling only the flag stop promptly.
+    uint64_t cancel_at = cancel_token_deadline(pool->config.cancel);
+
+    sync_mutex_lock(&pool->lock);
     while (atomic_load(&pool->active_work_items) > 0) {
-        if (timeout_ms != INFINITE) {
-            DWORD elapsed = GetTickCount() - start_time;
-            if (elapsed >= timeout_ms) {
-                return false;
-            }
+        if (cancel_token_check(pool->config.cancel)) {
+            break;
         }
 
-        if (pool->config.stop_flag && atomic_load(pool->config.stop_flag)) {
+        uint64_t now = sync_now_ns();
+        if (now >= deadline) {
+            completed = false;
             break;
         }
 
-        if (pool->config.progress_cb) {
-            size_t completed = atomic_load(&pool->completed_work_items);
-            size_t active = atomic_load(&pool->active_work_items);
+        if (now >= next_progress) {
+            next_progress = now + interval_ns;
+            if (pool->config.progress_cb) {
+                size_t finished = (size_t)sync_counter_read(&pool->completed_work_items);
+                size_t active = atomic_load(&pool->active_work_items);
+
+                sync_mutex_unlock(&pool->lock);
+                bool keep_going = pool->config.progress_cb(finished, active, pool->config.progress_user_data);
+                sync_mutex_lock(&pool->lock);
 
-            if (!pool->config.progress_cb(completed, active, pool->config.progress_user_data)) {
-                if (pool->config.stop_flag) {
-                    atomic_store(pool->config.stop_flag, true);
+                if (!keep_going) {
+                    cancel_token_cancel(pool->config.cancel, CANCEL_REASON_REQUESTED);
+                    break;
                 }
-                break;
+                continue;
             }
         }
 
-        Sleep(10);
+        uint64_t wake_at = next_progress < deadline ? next_progress : deadline;
+        if (cancel_at < wake_at) {
+            wake_at = cancel_at > now ? cancel_at : now;
+        }
+        uint64_t wait_ms = (wake_at - now + 999999u) / 1000000u;
+        sync_cond_wait(&pool->idle, &pool->lock, (uint32_t)(wait_ms > 0 ? wait_ms : 1));
     }
+    sync_mutex_unlock(&pool->lock);
 
-    return true;
+    return completed;
 }
 
 void thread_pool_destroy(thread_pool_t *pool) {
     if (!pool) return;
 
-    if (pool->config.stop_flag) {
-        atomic_store(pool->config.stop_flag, true);
-    }
+    sync_mutex_lock(&pool->lock);
+    atomic_store(&pool->shutdown, true);
+    sync_cond_broadcast(&pool->wake);
+    sync_cond_broadcast(&pool->throttle);
+    sync_mutex_unlock(&pool->lock);
 
-    if (pool->cleanup_group) {
-        CloseThreadpoolCleanupGroupMembers(pool->cleanup_group, FALSE, NULL);
-        CloseThreadpoolCleanupGroup(pool->cleanup_group);
-    }
-
-    DestroyThreadpoolEnvironment(&pool->callback_environ);
+    if (pool->workers) {
+        for (size_t i = 0; i < pool->worker_count; i++) {
+            if (pool->workers[i].started) {
+                sync_thread_join(&pool->workers[i].thread);
+            }
+        }
 
-    if (pool->pool) {
-        CloseThreadpool(pool->pool);
+        for (size_t i = 0; i < pool->worker_count; i++) {
+            tp_worker_t *worker = &pool->workers[i];
+            free(atomic_load(&worker->buffer));
+            while (worker->retired) {
+                tp_buffer_t *next = worker->retired->retired_next;
+                free(worker->retired);
+                worker->retired = next;
+            }
+        }
+        free(pool->workers);
     }
 
-    DeleteCriticalSection(&pool->stats_lock);
+    // Items still queued (only when a worker failed to start) go with the slab.
+    slab_pool_destroy(pool->items);
+    sync_counter_destroy(&pool->completed_work_items);
+    sync_counter_destroy(&pool->total_submitted);
+    sync_counter_destroy(&pool->stolen_work_items);
+    sync_counter_destroy(&pool->busy_ns);
+
+    sync_cond_destroy(&pool->throttle);
+    sync_cond_destroy(&pool->idle);
+    sync_cond_destroy(&pool->wake);
+    sync_mutex_destroy(&pool->lock);
     free(pool);
 }
 
 bool thread_pool_get_stats(thread_pool_t *pool, thread_pool_stats_t *stats) {
     if (!pool || !stats) return false;
 
-    EnterCriticalSection(&pool->stats_lock);
-
     stats->active_threads = atomic_load(&pool->active_work_items);
     stats->queued_work_items = atomic_load(&pool->queued_work_items);
-    stats->completed_work_items = atomic_load(&pool->completed_work_items);
-    stats->total_submitted = atomic_load(&pool->total_submitted);
-
-    LeaveCriticalSection(&pool->stats_lock);
+    stats->completed_work_items = (size_t)sync_counter_read(&pool->completed_work_items);
+    stats->total_submitted = (size_t)sync_counter_read(&pool->total_submitted);
+    stats->stolen_work_items = (size_t)sync_counter_read(&pool->stolen_work_items);
+    stats->concurrency = atomic_load(&pool->active_limit);
+    stats->peak_concurrency = atomic_load(&pool->peak_limit);
+    stats->min_concurrency = pool->min_active;
+    stats->max_concurrency = pool->worker_count;
+    stats->concurrency_changes = atomic_load(&pool->limit_changes);
     return true;
-}
\ No newline at end of file
+}
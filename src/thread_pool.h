@@ -1,10 +1,15 @@
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
 
-#include <windows.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdatomic.h>
+#include "cancel.h"
+
+#define THREAD_POOL_INFINITE UINT32_MAX
+#define THREAD_POOL_DEFAULT_PROGRESS_MS 100
+#define THREAD_POOL_AUTO_MAX 64
 
 typedef struct thread_pool thread_pool_t;
 
@@ -13,19 +18,57 @@ typedef void (*work_function_t)(void *context, void *user_data);
 typedef bool (*progress_callback_t)(size_t processed_files, size_t queued_dirs, void *user_data);
 
 typedef struct {
-    size_t max_threads;
+    // Workers are started for max_threads, but only a varying number of them
+    // run at once: the pool measures completed items per second and item
+    // latency, and moves the active count within [min_threads, max_threads].
+    // Setting both bounds to the same value fixes the count.
+    size_t max_threads;               // 0 = four per CPU, at most THREAD_POOL_AUTO_MAX
+    size_t min_threads;               // 0 = 1
+    size_t initial_threads;           // 0 = one per CPU, within the bounds
     size_t queue_size_hint;
     progress_callback_t progress_cb;
     void *progress_user_data;
-    atomic_bool *stop_flag;
+    uint32_t progress_interval_ms;    // 0 = THREAD_POOL_DEFAULT_PROGRESS_MS
+    cancel_token_t *cancel;           // optional; stops submissions and waits
 } thread_pool_config_t;
 
 thread_pool_t* thread_pool_create(const thread_pool_config_t *config);
 
+// Submissions from a worker go to the front of its own deque (LIFO); other
+// threads feed a shared FIFO queue. Once the cancel token fires nothing new
+// is accepted, but every accepted item is still run so work functions can
+// release what they own; they are expected to notice the token and return
+// quickly.
 bool thread_pool_submit(thread_pool_t *pool, work_function_t work_func, void *user_data);
 
-bool thread_pool_wait_completion(thread_pool_t *pool, DWORD timeout_ms);
+// Prioritised items wait in one shared queue and are taken before any
+// other work, lowest priority value first and FIFO within a value. Values
+// at or above THREAD_POOL_PRIORITY_LEVELS share the last level.
+#define THREAD_POOL_PRIORITY_LEVELS 32
+bool thread_pool_submit_priority(thread_pool_t *pool, work_function_t work_func, void *user_data,
+                                 unsigned priority);
+
+size_t thread_pool_worker_count(thread_pool_t *pool);
+
+// Index of the calling worker in [0, worker_count), or
+// THREAD_POOL_NOT_A_WORKER on any other thread. Lets callers keep
+// per-worker state without locks.
+#define THREAD_POOL_NOT_A_WORKER ((size_t)-1)
+size_t thread_pool_worker_index(thread_pool_t *pool);
+
+// True while fewer items are queued than workers are currently allowed to
+// run, i.e. a new submission would most likely start running right away.
+bool thread_pool_has_idle_capacity(thread_pool_t *pool);
+
+// Blocks until every submitted item has finished, the cancel token fires
+// (including by reaching its deadline), or timeout_ms elapses (returns false
+// only in that last case). The wakeup
+// comes straight from the worker that finishes the last item; the progress
+// callback runs on this thread every progress_interval_ms meanwhile.
+bool thread_pool_wait_completion(thread_pool_t *pool, uint32_t timeout_ms);
 
+// Runs whatever is still queued, then joins the workers. Cancel the token
+// first to make that quick.
 void thread_pool_destroy(thread_pool_t *pool);
 
 typedef struct {
@@ -33,8 +76,14 @@ typedef struct {
     size_t queued_work_items;
     size_t completed_work_items;
     size_t total_submitted;
+    size_t stolen_work_items;
+    size_t concurrency;               // workers currently allowed to run
+    size_t peak_concurrency;
+    size_t min_concurrency;
+    size_t max_concurrency;
+    size_t concurrency_changes;
 } thread_pool_stats_t;
 
 bool thread_pool_get_stats(thread_pool_t *pool, thread_pool_stats_t *stats);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,214 @@
+#include "topk.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+typedef struct {
+    uint64_t rank;
+    const char *root;
+    char *path;
+    uint64_t size;
+    FILETIME mtime;
+    content_match_t *matches;
+} topk_entry_t;
+
+typedef struct topk_heap {
+    topk_entry_t *entries;
+    size_t count;
+    struct topk_heap *next;
+} topk_heap_t;
+
+struct topk_set {
+    size_t k;
+    bool ascending;
+    uint64_t id;
+    topk_heap_t *heaps;
+    CRITICAL_SECTION lock;
+};
+
+// Worker threads outlive a single search, so the cached heap is tagged with
+// the id of the set it belongs to rather than its (reusable) address.
+static _Thread_local struct {
+    uint64_t set_id;
+    topk_heap_t *heap;
+} topk_tls;
+
+static atomic_uint_fast64_t topk_next_id = 1;
+
+topk_set_t* topk_create(size_t k, bool ascending) {
+    if (k == 0) return NULL;
+
+    topk_set_t *set = calloc(1, sizeof(topk_set_t));
+    if (!set) return NULL;
+
+    if (!InitializeCriticalSectionAndSpinCount(&set->lock, 4000)) {
+        free(set);
+        return NULL;
+    }
+
+    set->k = k;
+    set->ascending = ascending;
+    set->id = atomic_fetch_add(&topk_next_id, 1);
+    return set;
+}
+
+static topk_heap_t* topk_thread_heap(topk_set_t *set) {
+    if (topk_tls.set_id == set->id) {
+        return topk_tls.heap;
+    }
+
+    topk_heap_t *heap = calloc(1, sizeof(topk_heap_t));
+    if (!heap) return NULL;
+
+    heap->entries = malloc(set->k * sizeof(topk_entry_t));
+    if (!heap->entries) {
+        free(heap);
+        return NULL;
+    }
+
+    EnterCriticalSection(&set->lock);
+    heap->next = set->heaps;
+    set->heaps = heap;
+    LeaveCriticalSection(&set->lock);
+
+    topk_tls.set_id = set->id;
+    topk_tls.heap = heap;
+    return heap;
+}
+
+// Min-heap on rank: the root is the weakest entry currently kept.
+static void topk_sift_down(topk_entry_t *entries, size_t count, size_t i) {
+    for (;;) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+
+        if (left < count && entries[left].rank < entries[smallest].rank) smallest = left;
+        if (right < count && entries[right].rank < entries[smallest].rank) smallest = right;
+        if (smallest == i) return;
+
+        topk_entry_t tmp = entries[i];
+        entries[i] = entries[smallest];
+        entries[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+static void topk_sift_up(topk_entry_t *entries, size_t i) {
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (entries[parent].rank <= entries[i].rank) return;
+
+        topk_entry_t tmp = entries[i];
+        entries[i] = entries[parent];
+        entries[parent] = tmp;
+        i = parent;
+    }
+}
+
+bool topk_offer(topk_set_t *set, uint64_t key, const char *root, const char *path,
+                uint64_t size, FILETIME mtime, content_match_t *matches) {
+    if (!set || !path) {
+        content_free_matches(matches);
+        return false;
+    }
+
+    uint64_t rank = set->ascending ? ~key : key;
+
+    topk_heap_t *heap = topk_thread_heap(set);
+    if (!heap) {
+        content_free_matches(matches);
+        return false;
+    }
+
+    // Reject before copying anything: most files never enter the heap.
+    if (heap->count == set->k && rank <= heap->entries[0].rank) {
+        content_free_matches(matches);
+        return false;
+    }
+
+    char *copy = _strdup(path);
+    if (!copy) {
+        content_free_matches(matches);
+        return false;
+    }
+
+    topk_entry_t entry = { rank, root, copy, size, mtime, matches };
+
+    if (heap->count < set->k) {
+        heap->entries[heap->count] = entry;
+        topk_sift_up(heap->entries, heap->count);
+        heap->count++;
+    } else {
+        free(heap->entries[0].path);
+        content_free_matches(heap->entries[0].matches);
+        heap->entries[0] = entry;
+        topk_sift_down(heap->entries, heap->count, 0);
+    }
+
+    return true;
+}
+
+static int topk_entry_compare(const void *a, const void *b) {
+    const topk_entry_t *ea = (const topk_entry_t*)a;
+    const topk_entry_t *eb = (const topk_entry_t*)b;
+
+    if (ea->rank != eb->rank) {
+        return ea->rank > eb->rank ? -1 : 1;
+    }
+    return strcmp(ea->path, eb->path);
+}
+
+void topk_emit(topk_set_t *set, topk_emit_callback_t emit, void *user_data) {
+    if (!set || !emit) return;
+
+    size_t total = 0;
+    for (topk_heap_t *heap = set->heaps; heap; heap = heap->next) {
+        total += heap->count;
+    }
+    if (total == 0) return;
+
+    topk_entry_t *merged = malloc(total * sizeof(topk_entry_t));
+    if (!merged) return;
+
+    size_t n = 0;
+    for (topk_heap_t *heap = set->heaps; heap; heap = heap->next) {
+        memcpy(merged + n, heap->entries, heap->count * sizeof(topk_entry_t));
+        n += heap->count;
+        heap->count = 0;
+    }
+
+    qsort(merged, total, sizeof(topk_entry_t), topk_entry_compare);
+
+    bool keep_going = true;
+    for (size_t i = 0; i < total; i++) {
+        if (keep_going && i < set->k) {
+            keep_going = emit(merged[i].root, merged[i].path, merged[i].size, merged[i].mtime,
+                              merged[i].matches, user_data);
+        } else {
+            content_free_matches(merged[i].matches);
+        }
+        free(merged[i].path);
+    }
+
+    free(merged);
+}
+
+void topk_destroy(topk_set_t *set) {
+    if (!set) return;
+
+    topk_heap_t *heap = set->heaps;
+    while (heap) {
+        topk_heap_t *next = heap->next;
+        for (size_t i = 0; i < heap->count; i++) {
+            free(heap->entries[i].path);
+            content_free_matches(heap->entries[i].matches);
+        }
+        free(heap->entries);
+        free(heap);
+        heap = next;
+    }
+
+    DeleteCriticalSection(&set->lock);
+    free(set);
+}
@@ -0,0 +1,32 @@
+#ifndef TOPK_H
+#define TOPK_H
+
+#include "content.h"
+#include <windows.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct topk_set topk_set_t;
+
+// Takes ownership of matches, which may be NULL.
+typedef bool (*topk_emit_callback_t)(const char *root, const char *path, uint64_t size, FILETIME mtime,
+                                     content_match_t *matches, void *user_data);
+
+// Keeps the k entries with the largest keys (smallest when ascending) using
+// one bounded heap per calling thread.
+topk_set_t* topk_create(size_t k, bool ascending);
+
+// Returns true if the entry made it into the calling thread's heap. The path
+// is only copied when it does; root is stored as-is and must outlive the set.
+// The set takes ownership of matches either way, and frees them with the
+// entry if it is pushed out.
+bool topk_offer(topk_set_t *set, uint64_t key, const char *root, const char *path,
+                uint64_t size, FILETIME mtime, content_match_t *matches);
+
+// Merges the per-thread heaps and emits the final k entries best first.
+void topk_emit(topk_set_t *set, topk_emit_callback_t emit, void *user_data);
+
+void topk_destroy(topk_set_t *set);
+
+#endif
@@ -62,6 +62,25 @@ int parse_size_arg(const char *arg, uint64_t *size) {
     return 0;
 }
 
+void format_size_human(uint64_t size, char *buffer, size_t buffer_size) {
+    if (!buffer || buffer_size == 0) return;
+
+    static const char *units[] = { "KB", "MB", "GB", "TB", "PB" };
+
+    if (size < 1024) {
+        snprintf(buffer, buffer_size, "%llu B", (unsigned long long)size);
+        return;
+    }
+
+    double value = size / 1024.0;
+    size_t unit = 0;
+    while (value >= 1024.0 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+        value /= 1024.0;
+        unit++;
+    }
+    snprintf(buffer, buffer_size, "%.1f %s", value, units[unit]);
+}
+
 int parse_size_with_operator(const char *arg, uint64_t *size, char *operator) {
     if (!arg || !size || !operator) return -1;
 
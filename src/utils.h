@@ -10,6 +10,7 @@ int parse_date_string(const char *date_str, FILETIME *file_time);
 void format_filetime_iso(const FILETIME *file_time, char *buffer, size_t buffer_size);
 
 int parse_size_arg(const char *arg, uint64_t *size);
+void format_size_human(uint64_t size, char *buffer, size_t buffer_size);
 int parse_size_with_operator(const char *arg, uint64_t *size, char *operator);
 
 extern const char* text_extensions[];